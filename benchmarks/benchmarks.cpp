@@ -0,0 +1,189 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* Micro-benchmarks of the setup and per-task overheads of root-readspeed itself, on synthetic datasets generated on
+   first use in the working directory. The datasets are deterministic, so they can also serve as standard inputs to
+   compare storage at different sites. */
+
+#include "ReadSpeed.hxx"
+
+#include <benchmark/benchmark.h>
+
+#include <TFile.h>
+#include <TROOT.h> // ROOT::EnableThreadSafety
+#include <TSystem.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace ReadSpeed;
+
+namespace {
+
+// Number of values (ints, or floats of vectors) in a synthetic dataset: wider datasets have fewer entries, so that all
+// datasets have about the same size and can be written quickly the first time the benchmarks run.
+constexpr int kValuesPerDataset = 1000000;
+
+enum EBranchType : int { kScalar, kVector };
+
+// The shape of a synthetic dataset. Files with the same shape have the same contents.
+struct DatasetSpec {
+   int fNBranches;
+   int fClusterSize;
+   /// Compression settings, i.e. 100 * algorithm + level (see ROOT::RCompressionSetting).
+   int fCompression;
+   EBranchType fBranchType;
+
+   // kValuesPerDataset values spread over the branches (vectors hold 4.5 floats per entry on average), but at least
+   // one cluster.
+   int Entries() const
+   {
+      const int valuesPerEntry = fNBranches * (fBranchType == kVector ? 5 : 1);
+      return std::max(fClusterSize, kValuesPerDataset / valuesPerEntry);
+   }
+
+   std::string FileName() const
+   {
+      return "rsbench_" + std::to_string(fNBranches) + "br_" + std::to_string(fClusterSize) + "cl_" +
+             std::to_string(fCompression) + (fBranchType == kVector ? "_vec_" : "_scalar_") +
+             std::to_string(Entries()) + "ev.root";
+   }
+
+   std::vector<std::string> BranchNames() const
+   {
+      std::vector<std::string> names;
+      for (int i = 0; i < fNBranches; ++i)
+         names.push_back("b" + std::to_string(i));
+      return names;
+   }
+};
+
+// Write the dataset described by spec, with spec.Entries() entries in tree "t", unless the file already exists.
+// Scalar branches hold an int, vector branches a std::vector<float> of 0 to 9 elements.
+// The threads of multi-thread benchmarks all call this for the same file: it is written by the first of them, while
+// the others wait for it to be complete.
+std::string RequireDataset(const DatasetSpec &spec)
+{
+   static std::mutex writeMutex;
+   const std::lock_guard<std::mutex> lock(writeMutex);
+   const auto fileName = spec.FileName();
+   if (gSystem->AccessPathName(fileName.c_str()) == false) // then the file already exists
+      return fileName;
+
+   TFile f(fileName.c_str(), "recreate", "", spec.fCompression);
+   TTree t("t", "t");
+   t.SetAutoFlush(spec.fClusterSize);
+
+   const auto branchNames = spec.BranchNames();
+   std::vector<int> scalars(spec.fNBranches);
+   std::vector<std::vector<float>> vectors(spec.fNBranches);
+   for (int i = 0; i < spec.fNBranches; ++i) {
+      if (spec.fBranchType == kScalar)
+         t.Branch(branchNames[i].c_str(), &scalars[i]);
+      else
+         t.Branch(branchNames[i].c_str(), &vectors[i]);
+   }
+
+   const int nEntries = spec.Entries();
+   for (int e = 0; e < nEntries; ++e) {
+      for (int i = 0; i < spec.fNBranches; ++i) {
+         scalars[i] = e + i;
+         vectors[i].assign((e + i) % 10, float(e));
+      }
+      t.Fill();
+   }
+   t.Write();
+   return fileName;
+}
+
+// Arguments: number of files, cluster size.
+void BM_GetClusters(benchmark::State &state)
+{
+   const auto fileName = RequireDataset({1, int(state.range(1)), 101, kScalar});
+   const Data d{{"t"}, std::vector<std::string>(state.range(0), fileName), {"b0"}};
+   for (auto _ : state)
+      benchmark::DoNotOptimize(GetClusters(d));
+   state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetClusters)->ArgsProduct({{1, 16}, {1000, 100000}})->Unit(benchmark::kMillisecond);
+
+// Arguments: number of files, clusters per file, maximum number of tasks per file.
+void BM_MergeClusters(benchmark::State &state)
+{
+   const auto nClusters = state.range(1);
+   std::vector<std::vector<EntryRange>> clusters(state.range(0));
+   for (auto &fileClusters : clusters)
+      for (Long64_t i = 0; i < nClusters; ++i)
+         fileClusters.push_back({i * 1000, (i + 1) * 1000});
+
+   for (auto _ : state) {
+      // the copy is part of the timed region, as in the multi-thread setup
+      auto copy = clusters;
+      benchmark::DoNotOptimize(MergeClusters(std::move(copy), state.range(2)));
+   }
+   state.SetItemsProcessed(state.iterations() * state.range(0) * nClusters);
+}
+BENCHMARK(BM_MergeClusters)->ArgsProduct({{1, 1000, 20000}, {10, 1000}, {1, 24}});
+
+// Arguments: number of branches in the tree, whether the regexes match all branches or only a few.
+void BM_GetMatchingBranchNames(benchmark::State &state)
+{
+   const auto fileName = RequireDataset({int(state.range(0)), 10000, 101, kScalar});
+   std::unique_ptr<TFile> f(TFile::Open(fileName.c_str()));
+   auto *t = f->Get<TTree>("t");
+   // every regex must match some branch of the smallest dataset too, or matching throws
+   const std::vector<std::string> regexes = state.range(1) ? std::vector<std::string>{"b.*"}
+                                                           : std::vector<std::string>{"b1", "b2.*", "b[3-5]"};
+   for (auto _ : state)
+      benchmark::DoNotOptimize(GetMatchingBranchNames(*t, regexes));
+   state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetMatchingBranchNames)->ArgsProduct({{10, 100, 1000}, {0, 1}});
+
+// Read one cluster per iteration with ReadTree, each thread cycling through the clusters of the same file, starting
+// from a different cluster (each thread opens the file once and then reuses it, as in real runs): the cost of a whole
+// task, including the I/O and decompression of its data. Arguments: number of branches, cluster size, compression
+// settings, branch type.
+void BM_ReadTreeTask(benchmark::State &state)
+{
+   const DatasetSpec spec{int(state.range(0)), int(state.range(1)), int(state.range(2)),
+                          static_cast<EBranchType>(state.range(3))};
+   const auto fileName = RequireDataset(spec);
+   const auto branchNames = spec.BranchNames();
+   const Data d{{"t"}, {fileName}, branchNames};
+   const auto clusters = GetClusters(d)[0];
+
+   std::size_t clusterIdx = state.thread_index() % clusters.size();
+   ULong64_t bytesRead = 0;
+   for (auto _ : state) {
+      bytesRead += ReadTree("t", fileName, branchNames, clusters[clusterIdx]).fUncompressedBytesRead;
+      clusterIdx = (clusterIdx + 1) % clusters.size();
+   }
+   state.SetItemsProcessed(state.iterations());
+   state.SetBytesProcessed(bytesRead);
+}
+BENCHMARK(BM_ReadTreeTask)
+   ->ArgsProduct({{1, 10, 100},
+                  {1000, 10000},
+                  {101, 404, 505}, // zlib, lz4 and zstd
+                  {kScalar, kVector}})
+   ->ThreadRange(1, 8)
+   ->UseRealTime();
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+   // ReadTree is called concurrently by the threads of multi-thread benchmarks
+   ROOT::EnableThreadSafety();
+   benchmark::Initialize(&argc, argv);
+   if (benchmark::ReportUnrecognizedArguments(argc, argv))
+      return 1;
+   benchmark::RunSpecifiedBenchmarks();
+   benchmark::Shutdown();
+   return 0;
+}
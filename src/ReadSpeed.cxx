@@ -2,306 +2,3542 @@
    See the LICENSE file in the top directory for more information. */
 
 #include "ReadSpeed.hxx"
+#include "ReadSpeedAllocations.hxx"
+#include "ReadSpeedIndex.hxx"
+#include "ReadSpeedRNTuple.hxx"
 
 #include <ROOT/TSeq.hxx>
 #include <ROOT/TThreadExecutor.hxx>
 #include <ROOT/TTreeProcessorMT.hxx>   // for TTreeProcessorMT::GetTasksPerWorkerHint
 #include <ROOT/RDF/InterfaceUtils.hxx> // for ROOT::Internal::RDF::GetTopLevelBranchNames
+#include <Bytes.h> // for frombuf
+#include <RZip.h>  // for R__unzip
+#include <TBasket.h>
 #include <TBranch.h>
+#include <TBufferFile.h>
+#include <TEnv.h>
+#include <TFriendElement.h>
+#include <TLeaf.h>
 #include <TStopwatch.h>
+#include <TSystem.h>
 #include <TTree.h>
+#include <TTreeCache.h>
+
+#include <fcntl.h>        // for posix_fadvise
+#include <sys/resource.h> // for getrusage
+#include <unistd.h>       // for close
+#ifdef __linux__
+#include <linux/perf_event.h> // for perf_event_attr
+#include <pthread.h>          // for pthread_setaffinity_np
+#include <sched.h>            // for sched_getaffinity
+#include <sys/ioctl.h>        // for ioctl
+#include <sys/syscall.h>      // for SYS_perf_event_open
+#endif
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <cmath> // std::ceil
+#include <cctype> // std::isspace
+#include <chrono>
+#include <condition_variable>
+#include <cmath>   // std::ceil
+#include <cerrno>  // errno
+#include <cstring> // std::strerror
+#include <ctime>   // clock_gettime
+#include <deque>
+#include <exception> // std::exception_ptr
+#include <fstream>
+#include <limits>
 #include <memory>
-#include <stdexcept>
+#include <mutex>
+#include <numeric>
+#include <random>
 #include <set>
-#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <thread> // std::this_thread::get_id
+#include <unordered_map>
 
 using namespace ReadSpeed;
 
-std::vector<std::string> ReadSpeed::GetMatchingBranchNames(const std::string &fileName, const std::string &treeName,
-                                                           const std::vector<std::string> &regexes)
+// Defined here rather than in ReadSpeedAllocations.cxx, which is not part of the library.
+thread_local ReadSpeed::Internal::AllocationCounts ReadSpeed::Internal::gAllocationCounts{false, 0, 0};
+bool ReadSpeed::Internal::gCountAllocations = false;
+using ReadSpeed::Internal::gAllocationCounts;
+
+namespace {
+
+// Like TStopwatch, but measures the CPU time of the calling thread only:
+// TStopwatch reports the CPU time of the whole process, which is meaningless for a single task of a multi-thread run.
+class ThreadStopwatch {
+   std::chrono::steady_clock::time_point fRealStart;
+   double fCpuStart = 0.;
+   double fRealTime = 0.;
+   double fCpuTime = 0.;
+
+   static double GetThreadCpuTime()
+   {
+      timespec ts;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      return ts.tv_sec + ts.tv_nsec * 1e-9;
+   }
+
+public:
+   void Start()
+   {
+      fRealStart = std::chrono::steady_clock::now();
+      fCpuStart = GetThreadCpuTime();
+   }
+
+   void Stop()
+   {
+      fRealTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - fRealStart).count();
+      fCpuTime = GetThreadCpuTime() - fCpuStart;
+   }
+
+   double RealTime() const { return fRealTime; }
+   double CpuTime() const { return fCpuTime; }
+};
+
+// Incremented at the beginning of each run, so that per-thread caches do not carry state over from previous runs.
+std::atomic<unsigned int> gRunNumber{0};
+
+// Apply the process-wide TTreeCache settings in opts for the duration of a run, restoring the previous ones afterwards.
+// They are picked up by the caches created during the run: files are re-opened at the beginning of each run.
+class CacheSettingsGuard {
+   const bool fSetLearnEntries;
+   const bool fSetAsyncPrefetch;
+   const Int_t fOldLearnEntries;
+   const Int_t fOldAsyncPrefetch;
+
+public:
+   explicit CacheSettingsGuard(const Options &opts)
+      : fSetLearnEntries(opts.fCacheLearnEntries > 0), fSetAsyncPrefetch(opts.fAsyncPrefetch),
+        fOldLearnEntries(TTreeCache::GetLearnEntries()),
+        fOldAsyncPrefetch(gEnv->GetValue("TFile.AsyncPrefetching", 0))
+   {
+      if (fSetLearnEntries)
+         TTreeCache::SetLearnEntries(opts.fCacheLearnEntries);
+      if (fSetAsyncPrefetch)
+         gEnv->SetValue("TFile.AsyncPrefetching", 1);
+   }
+   CacheSettingsGuard(const CacheSettingsGuard &) = delete;
+   CacheSettingsGuard &operator=(const CacheSettingsGuard &) = delete;
+
+   ~CacheSettingsGuard()
+   {
+      if (fSetLearnEntries)
+         TTreeCache::SetLearnEntries(fOldLearnEntries);
+      if (fSetAsyncPrefetch)
+         gEnv->SetValue("TFile.AsyncPrefetching", fOldAsyncPrefetch);
+   }
+};
+
+// Progress of the reading tasks run by one thread, as cumulative counters since the thread started reading.
+// Counters are only written by their thread and read concurrently by ProgressSampler, so relaxed atomics suffice.
+// The alignment keeps the counters of different threads on different cache lines.
+struct alignas(64) ProgressCounters {
+   std::atomic<ULong64_t> fUncompressedBytesRead{0};
+   std::atomic<ULong64_t> fCompressedBytesRead{0};
+   std::atomic<unsigned int> fActiveTasks{0};
+};
+
+// The counters of all threads that ever read with progress sampling enabled. Elements are never removed, so the
+// sampler can read them after their thread has exited, and a deque never moves its elements when growing.
+std::mutex gProgressCountersMutex;
+std::deque<ProgressCounters> gProgressCounters;
+
+ProgressCounters &GetThreadProgressCounters()
 {
-   TFile *f = TFile::Open(fileName.c_str(), "READ_WITHOUT_GLOBALREGISTRATION");
-   if (f == nullptr || f->IsZombie())
-      throw std::runtime_error("Could not open file '" + fileName + '\'');
-   std::unique_ptr<TTree> t(f->Get<TTree>(treeName.c_str()));
-   if (t == nullptr)
-      throw std::runtime_error("Could not retrieve tree '" + treeName + "' from file '" + fileName + '\'');
+   thread_local ProgressCounters *counters = nullptr;
+   if (counters == nullptr) {
+      std::lock_guard<std::mutex> lock(gProgressCountersMutex);
+      gProgressCounters.emplace_back();
+      counters = &gProgressCounters.back();
+   }
+   return *counters;
+}
 
-   const auto unfilteredBranchNames = ROOT::Internal::RDF::GetTopLevelBranchNames(*t);
-   std::set<std::string> usedRegexes;
-   std::vector<std::string> branchNames;
+void AddRelaxed(std::atomic<ULong64_t> &counter, ULong64_t value)
+{
+   // this thread is the only writer: no need for an atomic read-modify-write
+   counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Count the allocations made with operator new by the calling thread between construction and Stop.
+// Nothing is counted unless the executable links the operator new of ReadSpeedAllocations.cxx.
+class AllocationCounter {
+   ULong64_t fStartAllocations;
+   ULong64_t fStartBytes;
+   bool fStopped = false;
 
-   auto filterBranchName = [regexes, &usedRegexes](std::string bName) {
-      const auto matchBranch = [&usedRegexes, bName](std::string regex) {
-         std::regex branchRegex(regex);
-         bool match = std::regex_match(bName, branchRegex);
+public:
+   AllocationCounter()
+      : fStartAllocations(gAllocationCounts.fNAllocations), fStartBytes(gAllocationCounts.fAllocatedBytes)
+   {
+      gAllocationCounts.fActive = true;
+   }
+   AllocationCounter(const AllocationCounter &) = delete;
+   AllocationCounter &operator=(const AllocationCounter &) = delete;
 
-         if (match)
-            usedRegexes.insert(regex);
+   ~AllocationCounter()
+   {
+      if (!fStopped)
+         gAllocationCounts.fActive = false;
+   }
 
-         return match;
-      };
+   // Stop counting and add the allocations counted to those of byteData.
+   void Stop(ByteData &byteData)
+   {
+      gAllocationCounts.fActive = false;
+      fStopped = true;
+      byteData.fNAllocations += gAllocationCounts.fNAllocations - fStartAllocations;
+      byteData.fAllocatedBytes += gAllocationCounts.fAllocatedBytes - fStartBytes;
+   }
+};
 
-      const auto iterator = std::find_if(regexes.begin(), regexes.end(), matchBranch);
-      return iterator != regexes.end();
-   };
-   std::copy_if(unfilteredBranchNames.begin(), unfilteredBranchNames.end(), std::back_inserter(branchNames),
-                filterBranchName);
+// Peak resident set size of the process, in bytes, -1 if it cannot be retrieved. On Linux this is the high-water mark
+// since the last call to ResetPeakRSS, elsewhere since the process started.
+Long64_t GetPeakRSS()
+{
+#ifdef __linux__
+   std::ifstream status("/proc/self/status");
+   std::string line;
+   while (std::getline(status, line))
+      if (line.compare(0, 6, "VmHWM:") == 0)
+         return std::stoll(line.substr(6)) * 1024; // reported in kB
+#endif
+   rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return -1;
+#ifdef __APPLE__
+   return usage.ru_maxrss; // in bytes on macOS
+#else
+   return usage.ru_maxrss * 1024ll; // in kB everywhere else
+#endif
+}
 
-   if (branchNames.empty())
-      throw std::runtime_error("Provided branch regexes didn't match any branches in the tree.");
-   if (usedRegexes.size() != regexes.size()) {
-      std::string errString =
-         "The following regexes didn't match any branches in the tree, this is probably unintended:\n";
-      for (const auto &regex : regexes) {
-         if (usedRegexes.find(regex) == usedRegexes.end())
-            errString += '\t' + regex + '\n';
+// Reset the peak resident set size of the process to the current one, if the kernel allows it (Linux only).
+void ResetPeakRSS()
+{
+#ifdef __linux__
+   std::ofstream clearRefs("/proc/self/clear_refs");
+   clearRefs << "5";
+#endif
+}
+
+// The memory statistics of a run that read through ReadTree, except for the peak RSS (see RunTrials).
+MemoryStats MakeMemoryStats(const ByteData &byteData)
+{
+   MemoryStats stats;
+   stats.fPeakBasketBytes = byteData.fBasketBytes;
+   if (Internal::gCountAllocations) {
+      stats.fNAllocations = byteData.fNAllocations;
+      stats.fAllocatedBytes = byteData.fAllocatedBytes;
+   }
+   return stats;
+}
+
+#ifdef __linux__
+// Open a hardware counter for the calling thread, in user space only, as part of the group of groupFd (-1 opens a new
+// group). Return the file descriptor, or -1 on failure.
+int OpenPerfEvent(UInt_t type, ULong64_t config, int groupFd)
+{
+   perf_event_attr attr{};
+   attr.size = sizeof(attr);
+   attr.type = type;
+   attr.config = config;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv = 1;
+   attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+   return static_cast<int>(syscall(SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1, groupFd, /*flags=*/0ul));
+}
+#endif
+
+[[noreturn]] void ThrowPerfCountersError(int error)
+{
+#ifdef __linux__
+   throw std::runtime_error("Could not open hardware performance counters with perf_event_open: " +
+                            std::string(std::strerror(error)) +
+                            ". Check /proc/sys/kernel/perf_event_paranoid, or whether the CPU exposes them at all "
+                            "(e.g. in virtual machines).");
+#else
+   (void)error;
+   throw std::runtime_error("Hardware performance counters are only supported on Linux.");
+#endif
+}
+
+// The hardware counters of one thread, opened as a group on construction and closed on destruction. If any of them
+// cannot be opened none is, see IsOpen.
+class ThreadPerfCounters {
+   std::vector<int> fFds;
+   /// errno of the failed perf_event_open call, if any.
+   int fError = 0;
+
+public:
+   ThreadPerfCounters()
+   {
+#ifdef __linux__
+      const std::pair<UInt_t, ULong64_t> events[] = {{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                                                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                                                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                                                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+      for (const auto &e : events) {
+         const auto fd = OpenPerfEvent(e.first, e.second, fFds.empty() ? -1 : fFds.front());
+         if (fd < 0) {
+            fError = errno;
+            Close();
+            return;
+         }
+         fFds.push_back(fd);
       }
-      throw std::runtime_error(errString);
+#endif
    }
+   ThreadPerfCounters(const ThreadPerfCounters &) = delete;
+   ThreadPerfCounters &operator=(const ThreadPerfCounters &) = delete;
+   ~ThreadPerfCounters() { Close(); }
 
-   return branchNames;
+   bool IsOpen() const { return !fFds.empty(); }
+   int GetError() const { return fError; }
+
+   void Close()
+   {
+      for (const auto fd : fFds)
+         close(fd);
+      fFds.clear();
+   }
+
+   // The counts since the counters were opened, scaled up if the kernel had to multiplex them with other events.
+   PerfCounters Read() const
+   {
+      PerfCounters counters;
+      // number of counters, time enabled, time running, then one value per counter
+      ULong64_t values[3 + 4] = {};
+      if (fFds.empty() || read(fFds.front(), values, sizeof(values)) != sizeof(values))
+         return counters;
+      const auto scale = values[2] > 0 ? double(values[1]) / values[2] : 0.;
+      counters.fCycles = std::llround(values[3] * scale);
+      counters.fInstructions = std::llround(values[4] * scale);
+      counters.fLLCMisses = std::llround(values[5] * scale);
+      counters.fBranchMisses = std::llround(values[6] * scale);
+      return counters;
+   }
+};
+
+// Hardware counters of the calling thread since its first call, opened by that call and kept open until the thread
+// exits. Zeros if perf is false, without opening the counters. Throws if they cannot be opened on this thread.
+PerfCounters ReadThreadPerfCounters(bool perf)
+{
+   if (!perf)
+      return {};
+   thread_local ThreadPerfCounters counters;
+   if (!counters.IsOpen())
+      ThrowPerfCountersError(counters.GetError());
+   return counters.Read();
 }
 
-// Read branches listed in branchNames in tree treeName in file fileName, return number of uncompressed bytes read.
-ByteData ReadSpeed::ReadTree(const std::string &treeName, const std::string &fileName,
-                             const std::vector<std::string> &branchNames, EntryRange range)
+// The counts between counter readings start and end.
+PerfCounters operator-(const PerfCounters &end, const PerfCounters &start)
 {
-   // This logic avoids re-opening the same file many times if not needed
-   // Given the static lifetime of `f`, we cannot use a `unique_ptr<TFile>` lest we have issues at teardown
-   // (e.g. because this file outlives ROOT global lists). Instead we rely on ROOT's memory management.
-   thread_local TFile *f;
-   if (f == nullptr || f->GetName() != fileName) {
-      delete f;
-      f = TFile::Open(fileName.c_str(), "READ_WITHOUT_GLOBALREGISTRATION"); // TFile::Open uses plug-ins if needed
+   PerfCounters diff;
+   diff.fCycles = end.fCycles - start.fCycles;
+   diff.fInstructions = end.fInstructions - start.fInstructions;
+   diff.fLLCMisses = end.fLLCMisses - start.fLLCMisses;
+   diff.fBranchMisses = end.fBranchMisses - start.fBranchMisses;
+   return diff;
+}
+
+// Throw if the group of hardware counters of Options::fPerfCounters cannot be opened on this system, before a run
+// starts rather than from its first task.
+void CheckPerfCounters()
+{
+   const ThreadPerfCounters counters;
+   if (!counters.IsOpen())
+      ThrowPerfCountersError(counters.GetError());
+}
+
+// Sample the sum of the progress counters of all threads every interval seconds on a background thread, from
+// construction until Stop is called. Does nothing if interval is not positive.
+class ProgressSampler {
+   using Clock = std::chrono::steady_clock;
+
+   const double fInterval;
+   Clock::time_point fStart;
+   ProgressSample fBaseline;
+   std::vector<ProgressSample> fSamples;
+   std::mutex fMutex;
+   std::condition_variable fCondition;
+   bool fStopRequested = false;
+   std::thread fThread;
+
+   ProgressSample Sample()
+   {
+      ProgressSample s;
+      s.fTime = std::chrono::duration<double>(Clock::now() - fStart).count();
+      std::lock_guard<std::mutex> lock(gProgressCountersMutex);
+      for (const auto &c : gProgressCounters) {
+         s.fUncompressedBytesRead += c.fUncompressedBytesRead.load(std::memory_order_relaxed);
+         s.fCompressedBytesRead += c.fCompressedBytesRead.load(std::memory_order_relaxed);
+         s.fActiveTasks += c.fActiveTasks.load(std::memory_order_relaxed);
+      }
+      s.fUncompressedBytesRead -= fBaseline.fUncompressedBytesRead;
+      s.fCompressedBytesRead -= fBaseline.fCompressedBytesRead;
+      return s;
    }
 
-   if (f == nullptr || f->IsZombie())
-      throw std::runtime_error("Could not open file '" + fileName + '\'');
-   std::unique_ptr<TTree> t(f->Get<TTree>(treeName.c_str()));
-   if (t == nullptr)
-      throw std::runtime_error("Could not retrieve tree '" + treeName + "' from file '" + fileName + '\'');
+   void Run()
+   {
+      const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(fInterval));
+      auto next = fStart + interval;
+      std::unique_lock<std::mutex> lock(fMutex);
+      while (!fCondition.wait_until(lock, next, [this] { return fStopRequested; })) {
+         fSamples.push_back(Sample());
+         next += interval;
+      }
+   }
 
-   t->SetBranchStatus("*", 0);
+public:
+   explicit ProgressSampler(double interval) : fInterval(interval)
+   {
+      if (fInterval <= 0.)
+         return;
+      fStart = Clock::now();
+      fBaseline = Sample();
+      fSamples.push_back({});
+      fThread = std::thread([this] { Run(); });
+   }
+   ProgressSampler(const ProgressSampler &) = delete;
+   ProgressSampler &operator=(const ProgressSampler &) = delete;
 
-   std::vector<TBranch *> branches;
-   for (const auto &bName : branchNames) {
-      auto *b = t->GetBranch(bName.c_str());
-      if (b == nullptr)
-         throw std::runtime_error("Could not retrieve branch '" + bName + "' from tree '" + t->GetName() +
-                                  "' in file '" + t->GetCurrentFile()->GetName() + '\'');
+   ~ProgressSampler() { Stop(); }
 
-      b->SetStatus(1);
-      branches.push_back(b);
+   // Stop sampling, take a last sample and return all samples.
+   std::vector<ProgressSample> Stop()
+   {
+      if (!fThread.joinable())
+         return std::move(fSamples);
+      {
+         std::lock_guard<std::mutex> lock(fMutex);
+         fStopRequested = true;
+      }
+      fCondition.notify_one();
+      fThread.join();
+      fSamples.push_back(Sample());
+      return std::move(fSamples);
    }
+};
 
-   const auto nEntries = t->GetEntries();
-   if (range.fStart == -1ll)
-      range = EntryRange{0ll, nEntries};
-   else if (range.fEnd > nEntries)
-      throw std::runtime_error("Range end (" + std::to_string(range.fEnd) + ") is beyod the end of tree '" +
-                               t->GetName() + "' in file '" + t->GetCurrentFile()->GetName() + "' with " +
-                               std::to_string(nEntries) + " entries.");
+// TTreeCache only exposes the ratio of its hits and misses over its whole lifetime, while a task needs the counts of
+// its own reads. The counters are protected members: this class is never instantiated, it only gives access to them.
+class TreeCacheCounters : public TTreeCache {
+public:
+   // The basket reads served so far by the TTreeCache of t (fCacheHits) and those it did not have (fCacheMisses). A
+   // tree without a TTreeCache has none.
+   static CacheStats Get(TTree &t)
+   {
+      CacheStats stats;
+      const auto *cache = dynamic_cast<TTreeCache *>(t.GetCurrentFile()->GetCacheRead(&t));
+      if (cache != nullptr) {
+         stats.fCacheHits = cache->*(&TreeCacheCounters::fNReadOk);
+         stats.fCacheMisses = cache->*(&TreeCacheCounters::fNReadMiss);
+      }
+      return stats;
+   }
+};
 
-   ULong64_t bytesRead = 0;
-   const ULong64_t fileStartBytes = f->GetBytesRead();
-   for (auto e = range.fStart; e < range.fEnd; ++e)
-      for (const auto &b : branches)
-         bytesRead += b->GetEntry(e);
+bool SelectsEntries(const Options &opts)
+{
+   return opts.fEntries.fStart >= 0 || opts.fEntries.fEnd >= 0 || opts.fMaxEntriesPerFile >= 0 ||
+          opts.fSampleClusters > 0.;
+}
+
+// Apply the entry selection and the cluster sampling requested in opts to clusters. The number of entries and
+// clusters selected before sampling are written to the fTotalEntries and fTotalClusters fields of projection.
+std::vector<std::vector<EntryRange>>
+SelectClusters(const std::vector<std::vector<EntryRange>> &clusters, const Options &opts, Projection &projection)
+{
+   auto selected = ClipClusters(clusters, opts.fEntries, opts.fMaxEntriesPerFile);
+   if (opts.fSampleClusters <= 0.)
+      return selected;
+
+   projection.fTotalEntries = 0;
+   projection.fTotalClusters = 0;
+   for (const auto &fileClusters : selected) {
+      projection.fTotalClusters += fileClusters.size();
+      for (const auto &c : fileClusters)
+         projection.fTotalEntries += c.fEnd - c.fStart;
+   }
+   return SampleClusters(selected, opts.fSampleClusters, opts.fSampleSeed);
+}
+
+// Return the cost of each of the selected clusters of a file for size-aware partitioning: the compressed bytes of the
+// clusters of the file they overlap with (in proportion to the overlap, for clusters shortened by an entry selection),
+// or their number of entries if the size of the clusters of the file is not known.
+std::vector<double> GetClusterCosts(const std::vector<EntryRange> &selected, const std::vector<EntryRange> &clusters,
+                                    const std::vector<ULong64_t> &clusterBytes)
+{
+   std::vector<double> costs;
+   costs.reserve(selected.size());
+   const bool haveBytes = !clusters.empty() && clusterBytes.size() == clusters.size();
+   auto cluster = 0u;
+   for (const auto &range : selected) {
+      if (!haveBytes) {
+         costs.push_back(range.fEnd - range.fStart);
+         continue;
+      }
+      // selected ranges are sorted, so the first cluster to look at never goes back
+      while (cluster < clusters.size() && clusters[cluster].fEnd <= range.fStart)
+         ++cluster;
+      double cost = 0.;
+      for (auto c = cluster; c < clusters.size() && clusters[c].fStart < range.fEnd; ++c) {
+         const auto overlap = std::min(range.fEnd, clusters[c].fEnd) - std::max(range.fStart, clusters[c].fStart);
+         cost += double(clusterBytes[c]) * overlap / (clusters[c].fEnd - clusters[c].fStart);
+      }
+      costs.push_back(cost);
+   }
+   return costs;
+}
 
-   const ULong64_t fileBytesRead = f->GetBytesRead() - fileStartBytes;
-   return {bytesRead, fileBytesRead};
+// GetClusterCosts for each file.
+std::vector<std::vector<double>>
+GetClusterCosts(const std::vector<std::vector<EntryRange>> &selected, const DatasetLayout &layout)
+{
+   static const std::vector<EntryRange> kNoClusters;
+   static const std::vector<ULong64_t> kNoBytes;
+   std::vector<std::vector<double>> costs(selected.size());
+   for (auto fileIdx = 0u; fileIdx < selected.size(); ++fileIdx) {
+      const bool haveLayout = fileIdx < layout.fClusters.size() && fileIdx < layout.fClusterBytes.size();
+      costs[fileIdx] = GetClusterCosts(selected[fileIdx], haveLayout ? layout.fClusters[fileIdx] : kNoClusters,
+                                       haveLayout ? layout.fClusterBytes[fileIdx] : kNoBytes);
+   }
+   return costs;
 }
 
-Result ReadSpeed::EvalThroughputST(const Data &d)
+// Split the selected clusters of each file into tasks for nThreads threads, 0 meaning a single-thread run that reads
+// each file with a single task. Sampled clusters are not contiguous, so each is read by a separate task.
+// layout provides the sizes of the clusters for EPartition::kBytes.
+std::vector<std::vector<EntryRange>> PartitionClusters(std::vector<std::vector<EntryRange>> clusters, bool sampled,
+                                                       unsigned int nThreads, EPartition partition,
+                                                       const DatasetLayout &layout)
 {
-   auto treeIdx = 0;
-   ULong64_t uncompressedBytesRead = 0;
-   ULong64_t compressedBytesRead = 0;
+   if (sampled)
+      return clusters;
+
+   if (nThreads == 0) {
+      // the selected clusters of a file are contiguous
+      for (auto &fileClusters : clusters)
+         if (!fileClusters.empty())
+            fileClusters = {EntryRange{fileClusters.front().fStart, fileClusters.back().fEnd}};
+      return clusters;
+   }
+
+   const auto nTasks = ROOT::TTreeProcessorMT::GetTasksPerWorkerHint() * nThreads;
+   if (partition == EPartition::kBytes) {
+      return MergeClustersByCost(clusters, GetClusterCosts(clusters, layout), nTasks);
+   }
+
+   const unsigned int maxTasksPerFile = std::ceil(float(nTasks) / float(clusters.size()));
+   return MergeClusters(std::move(clusters), maxTasksPerFile);
+}
+
+// What a run reads: the entry ranges of its tasks, one element per file, and what they were selected from.
+struct Workload {
+   std::vector<std::vector<EntryRange>> fTasks;
+   /// If the tasks are a random sample of clusters, one per task.
+   bool fSampled = false;
+   /// Number of entries and clusters the sample was taken from, if fSampled.
+   Projection fSelection;
+   /// Time spent selecting and partitioning clusters, in seconds.
+   double fSetupRealTime = 0.;
+   double fSetupCpuTime = 0.;
+};
 
+Workload MakeWorkload(const DatasetLayout &layout, unsigned int nThreads, const Options &opts)
+{
    TStopwatch sw;
+   sw.Start();
+   Workload w;
+   w.fSampled = opts.fSampleClusters > 0.;
+   const auto &clusters = layout.fClusters;
+   w.fTasks = PartitionClusters(SelectsEntries(opts) ? SelectClusters(clusters, opts, w.fSelection) : clusters,
+                                w.fSampled, nThreads, opts.fPartition, layout);
+   sw.Stop();
+   w.fSetupRealTime = sw.RealTime();
+   w.fSetupCpuTime = sw.CpuTime();
+   return w;
+}
 
-   for (const auto &fName : d.fFileNames) {
-      std::vector<std::string> branchNames;
-      if (d.fUseRegex)
-         branchNames = GetMatchingBranchNames(fName, d.fTreeNames[treeIdx], d.fBranchNames);
-      else
-         branchNames = d.fBranchNames;
+// An open file together with the tree and branches that were last read from it.
+struct OpenFile {
+   TFile *fFile = nullptr;
+   /// Owned by this object: it must be deleted before fFile.
+   TTree *fTree = nullptr;
+   std::string fTreeName;
+   /// Friends of fTree, and their trees and files other than fFile. The friend trees and their files are owned by the
+   /// friend elements of fTree, which close the files when fTree is deleted.
+   std::vector<FriendTree> fFriends;
+   std::vector<TTree *> fFriendTrees;
+   std::vector<TFile *> fFriendFiles;
+   /// Names of the branches last read from fTree. Only these branches are active.
+   std::vector<std::string> fBranchNames;
+   std::vector<TBranch *> fBranches;
+   /// fBranches and all their sub-branches, whose baskets are loaded when fBranches are read.
+   std::vector<TBranch *> fAllBranches;
 
-      sw.Start();
+   void Close()
+   {
+      delete fTree;
+      delete fFile;
+   }
 
-      const auto byteData = ReadTree(d.fTreeNames[treeIdx], fName, branchNames);
-      uncompressedBytesRead += byteData.fUncompressedBytesRead;
-      compressedBytesRead += byteData.fCompressedBytesRead;
+   ULong64_t GetBytesRead() const
+   {
+      ULong64_t bytes = fFile->GetBytesRead();
+      for (auto *f : fFriendFiles)
+         bytes += f->GetBytesRead();
+      return bytes;
+   }
 
-      if (d.fTreeNames.size() > 1)
-         ++treeIdx;
+   Int_t GetReadCalls() const
+   {
+      Int_t calls = fFile->GetReadCalls();
+      for (auto *f : fFriendFiles)
+         calls += f->GetReadCalls();
+      return calls;
+   }
+};
 
-      sw.Stop();
+// Report the progress of a reading task to the counters of its thread, if progress sampling is enabled.
+// The task counts as active for the lifetime of this object.
+class ProgressReporter {
+   ProgressCounters *fCounters = nullptr;
+   /// File the task reads from, if its bytes read should be reported by Update.
+   const OpenFile *fFile = nullptr;
+   ULong64_t fFileBytes = 0;
+
+public:
+   ProgressReporter(const Options &opts, const OpenFile *f = nullptr)
+      : fFile(f), fFileBytes(f != nullptr ? f->GetBytesRead() : 0)
+   {
+      if (opts.fSampleInterval <= 0.)
+         return;
+      fCounters = &GetThreadProgressCounters();
+      fCounters->fActiveTasks.store(fCounters->fActiveTasks.load(std::memory_order_relaxed) + 1,
+                                    std::memory_order_relaxed);
    }
+   ProgressReporter(const ProgressReporter &) = delete;
+   ProgressReporter &operator=(const ProgressReporter &) = delete;
 
-   return {sw.RealTime(), sw.CpuTime(), 0., 0., uncompressedBytesRead, compressedBytesRead, 0};
-}
+   ~ProgressReporter()
+   {
+      if (fCounters != nullptr)
+         fCounters->fActiveTasks.store(fCounters->fActiveTasks.load(std::memory_order_relaxed) - 1,
+                                       std::memory_order_relaxed);
+   }
 
-// Return a vector of EntryRanges per file, i.e. a vector of vectors of EntryRanges with outer size equal to
-// d.fFileNames.
-std::vector<std::vector<EntryRange>> ReadSpeed::GetClusters(const Data &d)
+   // Add uncompressedBytes to the bytes read and, if there is a file, the bytes read from it and its friends since
+   // the last call. Without a file, compressedBytes are added instead.
+   void Update(ULong64_t uncompressedBytes, ULong64_t compressedBytes = 0)
+   {
+      if (fCounters == nullptr)
+         return;
+      AddRelaxed(fCounters->fUncompressedBytesRead, uncompressedBytes);
+      if (fFile == nullptr) {
+         AddRelaxed(fCounters->fCompressedBytesRead, compressedBytes);
+         return;
+      }
+      const auto fileBytes = fFile->GetBytesRead();
+      AddRelaxed(fCounters->fCompressedBytesRead, fileBytes - fFileBytes);
+      fFileBytes = fileBytes;
+   }
+};
+
+// Open file fileName for reading, via plug-ins if needed (e.g. for remote files). Throws if it cannot be opened.
+TFile *OpenForReading(const std::string &fileName)
 {
-   auto treeIdx = 0;
-   const auto nFiles = d.fFileNames.size();
-   std::vector<std::vector<EntryRange>> ranges(nFiles);
-   for (auto fileIdx = 0u; fileIdx < nFiles; ++fileIdx) {
-      const auto &fileName = d.fFileNames[fileIdx];
-      std::unique_ptr<TFile> f(TFile::Open(fileName.c_str(), "READ_WITHOUT_GLOBALREGISTRATION"));
-      if (f == nullptr || f->IsZombie())
-         throw std::runtime_error("There was a problem opening file '" + fileName + '\'');
-      const auto &treeName = d.fTreeNames.size() > 1 ? d.fTreeNames[fileIdx] : d.fTreeNames[0];
-      auto *t = f->Get<TTree>(treeName.c_str()); // TFile owns this TTree
-      if (t == nullptr)
-         throw std::runtime_error("There was a problem retrieving TTree '" + treeName + "' from file '" + fileName +
-                                  '\'');
-
-      const auto nEntries = t->GetEntries();
-      auto it = t->GetClusterIterator(0);
-      Long64_t start = 0;
-      std::vector<EntryRange> rangesInFile;
-      while ((start = it.Next()) < nEntries)
-         rangesInFile.emplace_back(EntryRange{start, it.GetNextEntry()});
-      ranges[fileIdx] = std::move(rangesInFile);
-      if (d.fTreeNames.size() > 1)
-         ++treeIdx;
+   auto *f = TFile::Open(fileName.c_str(), "READ_WITHOUT_GLOBALREGISTRATION");
+   if (f == nullptr || f->IsZombie()) {
+      delete f;
+      throw std::runtime_error("Could not open file '" + fileName + '\'');
    }
-   return ranges;
+   return f;
 }
 
-// Mimic the logic of TTreeProcessorMT::MakeClusters: merge entry ranges together such that we
-// run around TTreeProcessorMT::GetTasksPerWorkerHint tasks per worker thread.
-// TODO it would be better to expose TTreeProcessorMT's actual logic and call the exact same method from here
-std::vector<std::vector<EntryRange>>
-ReadSpeed::MergeClusters(std::vector<std::vector<EntryRange>> &&clusters, unsigned int maxTasksPerFile)
+// Retrieve tree treeName from file f. Throws if it is not there.
+TTree *GetTree(TFile &f, const std::string &treeName)
 {
-   std::vector<std::vector<EntryRange>> mergedClusters(clusters.size());
+   auto *t = f.Get<TTree>(treeName.c_str());
+   if (t == nullptr)
+      throw std::runtime_error("Could not retrieve tree '" + treeName + "' from file '" + f.GetName() + '\'');
+   return t;
+}
 
-   auto clustersIt = clusters.begin();
-   auto mergedClustersIt = mergedClusters.begin();
-   for (; clustersIt != clusters.end(); clustersIt++, mergedClustersIt++) {
-      const auto nClustersInThisFile = clustersIt->size();
-      const auto nFolds = nClustersInThisFile / maxTasksPerFile;
-      // If the number of clusters is less than maxTasksPerFile
-      // we take the clusters as they are
-      if (nFolds == 0) {
-         *mergedClustersIt = *clustersIt;
-         continue;
+// Retrieve the branches called branchNames from t (or its friends). Throws if any of them is not there.
+std::vector<TBranch *> GetBranches(TTree &t, const std::vector<std::string> &branchNames)
+{
+   std::vector<TBranch *> branches;
+   for (const auto &bName : branchNames) {
+      auto *b = t.GetBranch(bName.c_str());
+      if (b == nullptr)
+         throw std::runtime_error("Could not retrieve branch '" + bName + "' from tree '" + t.GetName() +
+                                  "' in file '" + t.GetCurrentFile()->GetName() + '\'');
+      branches.push_back(b);
+   }
+   return branches;
+}
+
+class FileCache;
+
+/// The FileCache of each thread, by thread id, so that runs can look at the files of their workers once they are done.
+std::mutex gFileCachesMutex;
+std::unordered_map<std::thread::id, const FileCache *> gFileCaches;
+
+// Per-thread cache of open files, which avoids re-opening the same files and retrieving the same trees and branches
+// many times if not needed.
+// Given its static lifetime, we cannot use `unique_ptr<TFile>`s lest we have issues at teardown (e.g. because files
+// outlive ROOT global lists). Instead we rely on ROOT's memory management for files that are still open at exit.
+class FileCache {
+   /// Open files, least recently used first.
+   std::vector<OpenFile> fFiles;
+   /// Names of all files this thread opened during the current run, to tell first opens from re-opens.
+   std::set<std::string> fOpenedFiles;
+   /// Run during which the cache was last used.
+   unsigned int fRunNumber = 0;
+
+   void Clear()
+   {
+      for (auto &f : fFiles)
+         f.Close();
+      fFiles.clear();
+      fOpenedFiles.clear();
+   }
+
+public:
+   FileCache()
+   {
+      std::lock_guard<std::mutex> lock(gFileCachesMutex);
+      gFileCaches[std::this_thread::get_id()] = this;
+   }
+   FileCache(const FileCache &) = delete;
+   FileCache &operator=(const FileCache &) = delete;
+
+   ~FileCache()
+   {
+      std::lock_guard<std::mutex> lock(gFileCachesMutex);
+      gFileCaches.erase(std::this_thread::get_id());
+   }
+
+   // Return the open file called fileName, opening it (and closing the least recently used file if the cache holds
+   // more than maxOpenFiles files) if needed. On success, opens and reopens are incremented as appropriate.
+   // The reference is valid until the next call.
+   OpenFile &Get(const std::string &fileName, std::size_t maxOpenFiles, ULong64_t &opens, ULong64_t &reopens)
+   {
+      if (fRunNumber != gRunNumber) {
+         Clear();
+         fRunNumber = gRunNumber;
       }
-      // Otherwise, we have to merge clusters, distributing the reminder evenly
-      // between the first clusters
-      auto nReminderClusters = nClustersInThisFile % maxTasksPerFile;
-      const auto &clustersInThisFile = *clustersIt;
-      for (auto i = 0ULL; i < nClustersInThisFile; ++i) {
-         const auto start = clustersInThisFile[i].fStart;
-         // We lump together at least nFolds clusters, therefore
-         // we need to jump ahead of nFolds-1.
-         i += (nFolds - 1);
-         // We now add a cluster if we have some reminder left
-         if (nReminderClusters > 0) {
-            i += 1U;
-            nReminderClusters--;
-         }
-         const auto end = clustersInThisFile[i].fEnd;
-         mergedClustersIt->emplace_back(EntryRange({start, end}));
+
+      auto it = std::find_if(fFiles.begin(), fFiles.end(),
+                             [&](const OpenFile &f) { return f.fFile->GetName() == fileName; });
+      if (it != fFiles.end()) {
+         std::rotate(it, it + 1, fFiles.end()); // mark as most recently used
+         return fFiles.back();
       }
-      assert(nReminderClusters == 0 && "This should never happen, cluster-merging logic is broken.");
+
+      auto *f = OpenForReading(fileName);
+      ++opens;
+      if (!fOpenedFiles.insert(fileName).second)
+         ++reopens;
+
+      while (!fFiles.empty() && fFiles.size() >= std::max(maxOpenFiles, std::size_t(1))) {
+         fFiles.front().Close();
+         fFiles.erase(fFiles.begin());
+      }
+      fFiles.emplace_back();
+      fFiles.back().fFile = f;
+      return fFiles.back();
    }
 
-   return mergedClusters;
+   // The file returned by the last call to Get during the current run, if any.
+   const OpenFile *GetMostRecentlyUsed() const
+   {
+      return fRunNumber == gRunNumber && !fFiles.empty() ? &fFiles.back() : nullptr;
+   }
+};
+
+FileCache &GetThreadFileCache()
+{
+   thread_local FileCache fileCache;
+   return fileCache;
 }
 
-Result ReadSpeed::EvalThroughputMT(const Data &d, unsigned nThreads)
+// The baskets of a top-level branch's sub-branches are read by the top-level branch's GetEntry too.
+void CollectBranchesRecursively(TBranch *b, std::vector<TBranch *> &branches)
 {
-   ROOT::TThreadExecutor pool(nThreads);
-   const auto actualThreads = ROOT::GetThreadPoolSize();
-   if (actualThreads != nThreads)
-      std::cerr << "Running with " << actualThreads << " threads even though " << nThreads << " were requested.\n";
+   branches.push_back(b);
+   auto *subBranches = b->GetListOfBranches();
+   for (int i = 0; i < subBranches->GetEntriesFast(); ++i)
+      CollectBranchesRecursively(static_cast<TBranch *>(subBranches->UncheckedAt(i)), branches);
+}
 
-   TStopwatch clsw;
-   clsw.Start();
-   const unsigned int maxTasksPerFile =
-      std::ceil(float(ROOT::TTreeProcessorMT::GetTasksPerWorkerHint() * actualThreads) / float(d.fFileNames.size()));
+// Memory held by the basket buffers loaded by the branches last read from f (sub-branches included), and by the
+// TTreeCaches of its tree and friend trees.
+ULong64_t GetBasketMemory(const OpenFile &f)
+{
+   ULong64_t bytes = 0;
+   for (auto *b : f.fAllBranches) {
+      auto *baskets = b->GetListOfBaskets();
+      for (int i = 0; i < baskets->GetEntriesFast(); ++i)
+         if (auto *basket = static_cast<TBasket *>(baskets->UncheckedAt(i)))
+            bytes += basket->GetBufferSize();
+   }
+   if (f.fTree == nullptr)
+      return bytes;
+   if (auto *cache = f.fFile->GetCacheRead(f.fTree))
+      bytes += cache->GetBufferSize();
+   for (auto *ft : f.fFriendTrees)
+      if (auto *cache = ft->GetCurrentFile()->GetCacheRead(ft))
+         bytes += cache->GetBufferSize();
+   return bytes;
+}
 
-   const auto rangesPerFile = MergeClusters(GetClusters(d), maxTasksPerFile);
-   clsw.Stop();
+// The basket memory (see GetBasketMemory) of the file the thread threadId read its last TTree task from. Meant to be
+// sampled outside of the timed region, since it walks the baskets of all branches read, and while threadId is not
+// reading.
+ULong64_t GetThreadBasketMemory(std::thread::id threadId)
+{
+   std::lock_guard<std::mutex> lock(gFileCachesMutex);
+   const auto cache = gFileCaches.find(threadId);
+   const auto *f = cache != gFileCaches.end() ? cache->second->GetMostRecentlyUsed() : nullptr;
+   return f != nullptr ? GetBasketMemory(*f) : 0;
+}
 
-   size_t nranges =
-      std::accumulate(rangesPerFile.begin(), rangesPerFile.end(), 0u, [](size_t s, auto &r) { return s + r.size(); });
-   std::cout << "Total number of tasks: " << nranges << '\n';
+struct BasketLocation {
+   /// Index of the basket in its branch.
+   Int_t fIndex;
+   /// Offset of the basket's key in the file.
+   Long64_t fSeek;
+   /// Size of the basket's key (header plus compressed payload) on disk.
+   Int_t fBytes;
+};
 
-   auto treeIdx = 0;
-   std::vector<std::vector<std::string>> fileBranchNames;
-   for (const auto &fName : d.fFileNames) {
-      std::vector<std::string> branchNames;
-      if (d.fUseRegex)
-         branchNames = GetMatchingBranchNames(fName, d.fTreeNames[treeIdx], d.fBranchNames);
-      else
-         branchNames = d.fBranchNames;
+// Return the on-disk location of the baskets of branch b that contain entries in range.
+// Baskets that are stored in memory together with the TTree object are skipped: they have no on-disk location.
+std::vector<BasketLocation> GetBasketsInRange(TBranch &b, EntryRange range)
+{
+   const Long64_t *basketEntries = b.GetBasketEntry();
+   const Int_t *basketBytes = b.GetBasketBytes();
+   const auto nBaskets = b.GetWriteBasket();
 
-      fileBranchNames.push_back(branchNames);
+   std::vector<BasketLocation> baskets;
+   // basketEntries[i + 1] is always valid: basketEntries[nBaskets] is the first entry of the basket being written.
+   // The first basket with entries in range is the one before the first basket that starts after range.fStart.
+   const auto firstAfter = std::upper_bound(basketEntries, basketEntries + nBaskets, range.fStart) - basketEntries;
+   for (Int_t i = std::max<Int_t>(firstAfter - 1, 0); i < nBaskets && basketEntries[i] < range.fEnd; ++i) {
+      if (basketEntries[i + 1] <= range.fStart)
+         continue;
+      const auto seek = b.GetBasketSeek(i);
+      if (seek == 0 || basketBytes[i] == 0)
+         continue;
+      baskets.push_back({i, seek, basketBytes[i]});
+   }
+   return baskets;
+}
 
-      if (d.fTreeNames.size() > 1)
-         ++treeIdx;
+// Fill the size on disk, basket count and compression settings of the part of branch b in range.
+void FillBranchMetadata(TBranch &b, EntryRange range, BranchStats &stats)
+{
+   std::vector<TBranch *> allBranches;
+   CollectBranchesRecursively(&b, allBranches);
+   for (auto *subBranch : allBranches) {
+      for (const auto &basket : GetBasketsInRange(*subBranch, range)) {
+         stats.fCompressedBytes += basket.fBytes;
+         ++stats.fNBaskets;
+      }
    }
+   stats.fCompressionSettings = b.GetCompressionSettings();
+}
 
-   // for each file, for each range, spawn a reading task
-   auto sumBytes = [](const std::vector<ByteData> &bytesData) -> ByteData {
-      const auto uncompressedBytes =
-         std::accumulate(bytesData.begin(), bytesData.end(), 0ull,
-                         [](ULong64_t sum, const ByteData &o) { return sum + o.fUncompressedBytesRead; });
-      const auto compressedBytes =
-         std::accumulate(bytesData.begin(), bytesData.end(), 0ull,
-                         [](ULong64_t sum, const ByteData &o) { return sum + o.fCompressedBytesRead; });
-
-      return {uncompressedBytes, compressedBytes};
-   };
+// Decompress a basket as it is stored on disk (a TKey header followed by the compressed payload) into unzipped,
+// in the same way TBasket::ReadBasketBuffers does. Return the number of uncompressed bytes.
+Int_t UnzipBasket(char *rawBasket, Int_t rawBytes, std::vector<unsigned char> &unzipped)
+{
+   // Layout of the TKey header: Nbytes (4 bytes), Version (2), ObjLen (4), Datime (4), KeyLen (2), ...
+   char *cursor = rawBasket + 6;
+   Int_t objLen = 0;
+   frombuf(cursor, &objLen);
+   cursor = rawBasket + 14;
+   Short_t keyLen = 0;
+   frombuf(cursor, &keyLen);
 
-   auto processFile = [&](int fileIdx) {
-      const auto &fileName = d.fFileNames[fileIdx];
-      const auto &treeName = d.fTreeNames.size() > 1 ? d.fTreeNames[fileIdx] : d.fTreeNames[0];
-      const auto &branchNames = fileBranchNames[fileIdx];
+   if (objLen <= rawBytes - keyLen)
+      return objLen; // the payload is stored uncompressed, nothing to do
 
-      auto readRange = [&](const EntryRange &range) -> ByteData {
-         return ReadTree(treeName, fileName, branchNames, range);
-      };
+   unzipped.resize(objLen);
+   auto *src = reinterpret_cast<unsigned char *>(rawBasket) + keyLen;
+   auto *tgt = unzipped.data();
+   Int_t totalOut = 0;
+   while (totalOut < objLen) {
+      int nIn = 0, nOut = 0, nUnzipped = 0;
+      if (R__unzip_header(&nIn, src, &nOut) != 0)
+         break;
+      R__unzip(&nIn, src, &nOut, tgt, &nUnzipped);
+      if (nUnzipped == 0)
+         break;
+      src += nIn;
+      tgt += nUnzipped;
+      totalOut += nUnzipped;
+   }
 
-      return pool.MapReduce(readRange, rangesPerFile[fileIdx], sumBytes);
-   };
+   if (totalOut != objLen)
+      throw std::runtime_error("Could not decompress basket: expected " + std::to_string(objLen) +
+                               " uncompressed bytes, got " + std::to_string(totalOut));
+   return objLen;
+}
 
-   TStopwatch sw;
+// Upper bound of the compressed bytes read in one go by ReadRaw and ReadInPhases: larger than any realistic basket, and
+// in the same ballpark as a TTreeCache.
+constexpr ULong64_t kMaxRawReadBytes = 64 * 1024 * 1024;
+
+// Read branches' compressed baskets in range (sub-branches included) straight from the file, with vectored reads of
+// up to kMaxRawReadBytes each, without decompressing them. Return the raw I/O times.
+ByteData ReadRaw(TFile &f, const std::vector<TBranch *> &branches, EntryRange range)
+{
+   std::vector<TBranch *> allBranches;
+   for (auto *b : branches)
+      CollectBranchesRecursively(b, allBranches);
+
+   std::vector<BasketLocation> baskets;
+   for (auto *b : allBranches) {
+      const auto branchBaskets = GetBasketsInRange(*b, range);
+      baskets.insert(baskets.end(), branchBaskets.begin(), branchBaskets.end());
+   }
+   // reading in file order lets the file merge adjacent baskets into fewer, larger reads
+   std::sort(baskets.begin(), baskets.end(),
+             [](const BasketLocation &a, const BasketLocation &b) { return a.fSeek < b.fSeek; });
+
+   std::vector<char> buffer;
+   std::vector<Long64_t> seeks;
+   std::vector<Int_t> sizes;
+   ThreadStopwatch sw;
+   const ULong64_t fileStartBytes = f.GetBytesRead();
    sw.Start();
-   const auto totalByteData = pool.MapReduce(processFile, ROOT::TSeqUL{d.fFileNames.size()}, sumBytes);
+   for (auto first = baskets.begin(); first != baskets.end();) {
+      seeks.clear();
+      sizes.clear();
+      ULong64_t batchSize = 0;
+      auto last = first;
+      // always read at least one basket, even if it is larger than kMaxRawReadBytes
+      for (; last != baskets.end() && (last == first || batchSize + last->fBytes <= kMaxRawReadBytes); ++last) {
+         seeks.push_back(last->fSeek);
+         sizes.push_back(last->fBytes);
+         batchSize += last->fBytes;
+      }
+      buffer.resize(batchSize);
+      if (f.ReadBuffers(buffer.data(), seeks.data(), sizes.data(), seeks.size()))
+         throw std::runtime_error(std::string("Could not read baskets from file '") + f.GetName() + '\'');
+      first = last;
+   }
    sw.Stop();
 
-   return {sw.RealTime(),
-           sw.CpuTime(),
-           clsw.RealTime(),
-           clsw.CpuTime(),
-           totalByteData.fUncompressedBytesRead,
-           totalByteData.fCompressedBytesRead,
-           actualThreads};
+   ByteData byteData;
+   byteData.fCompressedBytesRead = f.GetBytesRead() - fileStartBytes;
+   byteData.fPhaseTimes.fIORealTime = sw.RealTime();
+   byteData.fPhaseTimes.fIOCpuTime = sw.CpuTime();
+   return byteData;
 }
 
-Result ReadSpeed::EvalThroughput(const Data &d, unsigned nThreads)
+// Read the baskets of branches of t that contain entries in range in three separately timed phases: their compressed
+// bytes are first prefetched into the TTreeCache of t with a single vectored read, then loaded from the cache by the
+// branches, which decompress them, then deserialized entry by entry. Each basket is read from the file once: the
+// cache holds all the baskets of a batch, so every basket load is a cache hit and the cache never fills itself.
+// The range is processed in batches of baskets of up to kMaxRawReadBytes, so that memory use does not grow with the
+// range: the times of each phase are summed over the batches.
+ByteData ReadInPhases(TTree &t, const std::vector<TBranch *> &branches, EntryRange range, bool perf)
 {
-   if (d.fTreeNames.empty())
-      throw std::runtime_error("Please provide at least one tree name");
-   if (d.fFileNames.empty())
-      throw std::runtime_error("Please provide at least one file name");
-   if (d.fBranchNames.empty())
+   auto &f = *t.GetCurrentFile();
+   if (f.GetCacheRead(&t) == nullptr)
+      t.SetCacheSize(kMaxRawReadBytes);
+   auto *cache = dynamic_cast<TTreeCache *>(f.GetCacheRead(&t));
+   if (cache == nullptr)
+      throw std::runtime_error("Could not create a TTreeCache for tree '" + std::string(t.GetName()) + "' in file '" +
+                               f.GetName() + '\'');
+   // the cache must stay enabled to serve the baskets prefetched below. It does not learn, and should it ever miss,
+   // it only refills itself with the selected branches, restricted to the entries of the current batch.
+   for (auto *b : branches)
+      if (t.AddBranchToCache(b, /*subbranches=*/true) < 0)
+         throw std::runtime_error("Could not add branch '" + std::string(b->GetName()) +
+                                  "' to the TTreeCache of tree '" + t.GetName() + "' in file '" + f.GetName() + '\'');
+   t.StopCacheLearningPhase();
+
+   std::vector<TBranch *> allBranches;
+   for (auto *b : branches)
+      CollectBranchesRecursively(b, allBranches);
+
+   // each basket belongs to the batch that contains its first entry in range
+   struct PhaseBasket {
+      Long64_t fFirstEntry;
+      TBranch *fBranch;
+      BasketLocation fLocation;
+   };
+   std::vector<PhaseBasket> baskets;
+   for (auto *b : allBranches)
+      for (const auto &basket : GetBasketsInRange(*b, range))
+         baskets.push_back({std::max(b->GetBasketEntry()[basket.fIndex], range.fStart), b, basket});
+   std::stable_sort(baskets.begin(), baskets.end(),
+                    [](const PhaseBasket &a, const PhaseBasket &b) { return a.fFirstEntry < b.fFirstEntry; });
+
+   PhaseTimes times;
+   ThreadStopwatch sw;
+   const ULong64_t fileStartBytes = f.GetBytesRead();
+   ULong64_t bytesRead = 0;
+   std::vector<char> firstBasket;
+   Long64_t batchStart = range.fStart;
+   for (auto first = baskets.begin(); batchStart < range.fEnd;) {
+      // forget the baskets of the previous batch, which the branches already loaded
+      cache->Prefetch(0, 0);
+      ULong64_t batchSize = 0;
+      auto last = first;
+      // always take at least one basket, even if it is larger than kMaxRawReadBytes
+      for (; last != baskets.end() && (last == first || batchSize + last->fLocation.fBytes <= kMaxRawReadBytes);
+           ++last) {
+         cache->Prefetch(last->fLocation.fSeek, last->fLocation.fBytes);
+         batchSize += last->fLocation.fBytes;
+      }
+      // the batch deserializes the entries up to the first one of the next batch, if any: consecutive batches that
+      // start at the same entry leave its deserialization to the last of them
+      const Long64_t batchEnd = last != baskets.end() ? last->fFirstEntry : range.fEnd;
+      t.SetCacheEntryRange(batchStart, std::max(batchStart, batchEnd));
+
+      // Phase 1: raw I/O. The first access to the cache reads all the baskets prefetched in it with a vectored read.
+      auto counters = ReadThreadPerfCounters(perf);
+      sw.Start();
+      if (first != last) {
+         firstBasket.resize(first->fLocation.fBytes);
+         if (cache->ReadBuffer(firstBasket.data(), first->fLocation.fSeek, first->fLocation.fBytes) != 1)
+            throw std::runtime_error(std::string("Could not read baskets from file '") + f.GetName() + '\'');
+      }
+      sw.Stop();
+      times.fIOCounters += ReadThreadPerfCounters(perf) - counters;
+      times.fIORealTime += sw.RealTime();
+      times.fIOCpuTime += sw.CpuTime();
+
+      // Phase 2: decompression. The branches load the baskets of the batch, whose bytes are copied from the cache.
+      counters = ReadThreadPerfCounters(perf);
+      sw.Start();
+      for (; first != last; ++first)
+         if (first->fBranch->GetBasket(first->fLocation.fIndex) == nullptr)
+            throw std::runtime_error("Could not load basket " + std::to_string(first->fLocation.fIndex) +
+                                     " of branch '" + first->fBranch->GetName() + "' from file '" + f.GetName() +
+                                     '\'');
+      sw.Stop();
+      times.fUnzipCounters += ReadThreadPerfCounters(perf) - counters;
+      times.fUnzipRealTime += sw.RealTime();
+      times.fUnzipCpuTime += sw.CpuTime();
+
+      if (batchEnd <= batchStart)
+         continue;
+
+      // Phase 3: deserialization of the entries of the batch from the loaded baskets
+      counters = ReadThreadPerfCounters(perf);
+      sw.Start();
+      for (auto e = batchStart; e < batchEnd; ++e)
+         for (auto *b : branches)
+            bytesRead += b->GetEntry(e);
+      sw.Stop();
+      times.fDeserializeCounters += ReadThreadPerfCounters(perf) - counters;
+      times.fDeserializeRealTime += sw.RealTime();
+      times.fDeserializeCpuTime += sw.CpuTime();
+
+      // a basket that also holds entries of the next batch is the current one of its branch, which DropBaskets keeps
+      for (auto *b : allBranches)
+         b->DropBaskets();
+      batchStart = batchEnd;
+   }
+   for (auto *b : allBranches)
+      b->DropBaskets("all");
+   cache->Prefetch(0, 0);
+
+   ByteData byteData;
+   byteData.fUncompressedBytesRead = bytesRead;
+   byteData.fCompressedBytesRead = f.GetBytesRead() - fileStartBytes;
+   byteData.fPhaseTimes = times;
+   return byteData;
+}
+
+// Read all entries in range, whole baskets at a time via ROOT's bulk I/O interface for branches that support it and
+// entry by entry for the others. Return the number of uncompressed bytes read.
+ULong64_t ReadBulk(const std::vector<TBranch *> &branches, EntryRange range)
+{
+   ULong64_t bytesRead = 0;
+   TBufferFile buf(TBuffer::kWrite, 32 * 1024);
+   std::vector<TBranch *> nonBulkBranches;
+   for (auto *b : branches) {
+      if (!b->SupportsBulkRead()) {
+         nonBulkBranches.push_back(b);
+         continue;
+      }
+
+      // bulk-readable branches have a single fixed-size leaf
+      const auto *leaf = static_cast<TLeaf *>(b->GetListOfLeaves()->UncheckedAt(0));
+      const ULong64_t entrySize = leaf->GetLenType() * leaf->GetLenStatic();
+      const Long64_t *basketEntries = b->GetBasketEntry();
+      // the last basket might be in memory but it can be read in bulk too
+      const auto nBaskets = b->GetWriteBasket() + 1;
+      for (auto e = range.fStart; e < range.fEnd;) {
+         // GetBulkEntries always returns the entries of the whole basket that contains e, deserialized
+         const auto basket = std::upper_bound(basketEntries, basketEntries + nBaskets, e) - basketEntries - 1;
+         const auto nEntries = b->GetBulkRead().GetBulkEntries(e, buf);
+         if (nEntries <= 0)
+            throw std::runtime_error(std::string("Could not read entry ") + std::to_string(e) + " of branch '" +
+                                     b->GetName() + "' in bulk");
+         const auto basketEnd = basketEntries[basket] + nEntries;
+         bytesRead += (std::min(basketEnd, range.fEnd) - e) * entrySize;
+         e = basketEnd;
+      }
+   }
+
+   for (auto e = range.fStart; e < range.fEnd; ++e)
+      for (auto *b : nonBulkBranches)
+         bytesRead += b->GetEntry(e);
+
+   return bytesRead;
+}
+
+} // anonymous namespace
+
+namespace {
+// Attach friends to t and return their trees. The friend elements of t open the files of the friends that are not in
+// the file of t, and own them: these files are added to friendFiles, if not null.
+std::vector<TTree *> AddFriendTrees(TTree &t, const std::vector<FriendTree> &friends, std::vector<TFile *> *friendFiles)
+{
+   std::vector<TTree *> trees;
+   for (const auto &fr : friends) {
+      auto *fe = t.AddFriend(fr.fTreeName.c_str(), fr.fFileName.c_str());
+      auto *ft = fe != nullptr ? fe->GetTree() : nullptr;
+      if (ft == nullptr)
+         throw std::runtime_error("Could not retrieve friend tree '" + fr.fTreeName + "' from file '" +
+                                  (fr.fFileName.empty() ? t.GetCurrentFile()->GetName() : fr.fFileName) + '\'');
+      trees.push_back(ft);
+      auto *ff = ft->GetCurrentFile();
+      if (friendFiles != nullptr && ff != t.GetCurrentFile() &&
+          std::find(friendFiles->begin(), friendFiles->end(), ff) == friendFiles->end())
+         friendFiles->push_back(ff);
+   }
+   return trees;
+}
+} // anonymous namespace
+
+std::size_t BranchMatcher::SchemaHash::operator()(const std::vector<std::string> &branchNames) const
+{
+   std::size_t h = branchNames.size();
+   for (const auto &name : branchNames)
+      h ^= std::hash<std::string>{}(name) + 0x9e3779b9 + (h << 6) + (h >> 2);
+   return h;
+}
+
+BranchMatcher::BranchMatcher(const std::vector<std::string> &regexes) : fRegexStrings(regexes)
+{
+   fRegexes.reserve(regexes.size());
+   for (const auto &regex : regexes)
+      fRegexes.emplace_back(regex);
+}
+
+std::vector<std::string> BranchMatcher::GetMatchingBranchNames(const std::string &fileName, const std::string &treeName,
+                                                               const std::vector<FriendTree> &friends)
+{
+   std::unique_ptr<TFile> f(OpenForReading(fileName));
+   std::unique_ptr<TTree> t(GetTree(*f, treeName));
+   AddFriendTrees(*t, friends, nullptr);
+
+   return GetMatchingBranchNames(*t);
+}
+
+std::vector<std::string> BranchMatcher::GetMatchingBranchNames(TTree &t)
+{
+   return MatchBranchNames(ROOT::Internal::RDF::GetTopLevelBranchNames(t));
+}
+
+std::vector<std::string> BranchMatcher::MatchBranchNames(std::vector<std::string> unfilteredBranchNames)
+{
+   {
+      std::lock_guard<std::mutex> lock(fMutex);
+      const auto cached = fCache.find(unfilteredBranchNames);
+      if (cached != fCache.end())
+         return cached->second;
+   }
+
+   // Matching happens outside of the lock so that trees with different schemas can be matched concurrently.
+   // As before, a branch is only attributed to the first regex it matches.
+   std::vector<bool> usedRegexes(fRegexes.size(), false);
+   std::vector<std::string> branchNames;
+   for (const auto &bName : unfilteredBranchNames) {
+      for (auto regexIdx = 0u; regexIdx < fRegexes.size(); ++regexIdx) {
+         if (std::regex_match(bName, fRegexes[regexIdx])) {
+            usedRegexes[regexIdx] = true;
+            branchNames.emplace_back(bName);
+            break;
+         }
+      }
+   }
+
+   if (branchNames.empty())
+      throw std::runtime_error("Provided branch regexes didn't match any branches in the tree.");
+   if (std::find(usedRegexes.begin(), usedRegexes.end(), false) != usedRegexes.end()) {
+      std::string errString =
+         "The following regexes didn't match any branches in the tree, this is probably unintended:\n";
+      for (auto regexIdx = 0u; regexIdx < fRegexes.size(); ++regexIdx) {
+         if (!usedRegexes[regexIdx])
+            errString += '\t' + fRegexStrings[regexIdx] + '\n';
+      }
+      throw std::runtime_error(errString);
+   }
+
+   std::lock_guard<std::mutex> lock(fMutex);
+   fCache.emplace(std::move(unfilteredBranchNames), branchNames);
+   return branchNames;
+}
+
+std::vector<std::string> ReadSpeed::GetMatchingBranchNames(const std::string &fileName, const std::string &treeName,
+                                                           const std::vector<std::string> &regexes)
+{
+   return BranchMatcher(regexes).GetMatchingBranchNames(fileName, treeName);
+}
+
+std::vector<std::string> ReadSpeed::GetMatchingBranchNames(TTree &t, const std::vector<std::string> &regexes)
+{
+   return BranchMatcher(regexes).GetMatchingBranchNames(t);
+}
+
+// Read branches listed in branchNames in tree treeName in file fileName, return number of uncompressed bytes read.
+ByteData ReadSpeed::ReadTree(const std::string &treeName, const std::string &fileName,
+                             const std::vector<std::string> &branchNames, EntryRange range, const Options &opts,
+                             const std::vector<FriendTree> &friends)
+{
+   ThreadStopwatch setupSw;
+   setupSw.Start();
+
+   ULong64_t fileOpens = 0;
+   ULong64_t fileReopens = 0;
+   auto &openFile = GetThreadFileCache().Get(fileName, opts.fOpenFilesPerThread, fileOpens, fileReopens);
+   auto *f = openFile.fFile;
+
+   // the tree and its branches are only retrieved again if they differ from the previous task's on this file
+   if (openFile.fTree == nullptr || openFile.fTreeName != treeName || openFile.fFriends != friends) {
+      delete openFile.fTree;
+      openFile.fTree = nullptr;
+      openFile.fTreeName = treeName;
+      openFile.fFriends.clear();
+      openFile.fFriendTrees.clear();
+      openFile.fFriendFiles.clear();
+      openFile.fBranchNames.clear();
+      openFile.fBranches.clear();
+      openFile.fAllBranches.clear();
+      openFile.fTree = GetTree(*f, treeName);
+      openFile.fFriendTrees = AddFriendTrees(*openFile.fTree, friends, &openFile.fFriendFiles);
+      openFile.fFriends = friends;
+      fileOpens += openFile.fFriendFiles.size();
+      if (opts.fCacheSize >= 0) {
+         openFile.fTree->SetCacheSize(opts.fCacheSize);
+         for (auto *ft : openFile.fFriendTrees)
+            ft->SetCacheSize(opts.fCacheSize);
+      }
+   }
+   auto *t = openFile.fTree;
+   // the tree and its friends, each with its own TTreeCache
+   std::vector<TTree *> trees{t};
+   trees.insert(trees.end(), openFile.fFriendTrees.begin(), openFile.fFriendTrees.end());
+
+   if (openFile.fBranchNames != branchNames || openFile.fBranches.empty()) {
+      t->SetBranchStatus("*", 0);
+      openFile.fBranchNames.clear();
+      openFile.fBranches.clear();
+      openFile.fAllBranches.clear();
+
+      auto branches = GetBranches(*t, branchNames);
+      for (auto *b : branches)
+         b->SetStatus(1);
+      if (opts.fCacheAddBranches) {
+         for (auto *tree : trees)
+            tree->DropBranchFromCache("*", /*subbranches=*/true);
+         for (auto *b : branches)
+            if (b->GetTree()->AddBranchToCache(b, /*subbranches=*/true) < 0)
+               throw std::runtime_error("Could not add branch '" + std::string(b->GetName()) +
+                                        "' to the TTreeCache of tree '" + b->GetTree()->GetName() + "' in file '" +
+                                        b->GetTree()->GetCurrentFile()->GetName() + '\'');
+         for (auto *tree : trees)
+            tree->StopCacheLearningPhase();
+      }
+      for (auto *b : branches)
+         CollectBranchesRecursively(b, openFile.fAllBranches);
+      openFile.fBranchNames = branchNames;
+      openFile.fBranches = std::move(branches);
+   }
+   const auto &branches = openFile.fBranches;
+
+   const auto nEntries = t->GetEntries();
+   if (range.fStart == -1ll)
+      range = EntryRange{0ll, nEntries};
+   else if (range.fEnd > nEntries)
+      throw std::runtime_error("Range end (" + std::to_string(range.fEnd) + ") is beyod the end of tree '" +
+                               t->GetName() + "' in file '" + t->GetCurrentFile()->GetName() + "' with " +
+                               std::to_string(nEntries) + " entries.");
+   for (auto *ft : openFile.fFriendTrees)
+      if (ft->GetEntries() < range.fEnd)
+         throw std::runtime_error("Friend tree '" + std::string(ft->GetName()) + "' in file '" +
+                                  ft->GetCurrentFile()->GetName() + "' has fewer entries than tree '" + t->GetName() +
+                                  "' in file '" + fileName + '\'');
+
+   if (opts.fCacheAddBranches)
+      for (auto *tree : trees)
+         tree->SetCacheEntryRange(range.fStart, range.fEnd);
+
+   setupSw.Stop();
+
+   const auto readCallsStart = openFile.GetReadCalls();
+   std::vector<CacheStats> cacheStart;
+   for (auto *tree : trees)
+      cacheStart.push_back(TreeCacheCounters::Get(*tree));
+   // entry-by-entry reads report their progress after each entry, the others at the end of the task
+   ProgressReporter progress(opts, &openFile);
+   AllocationCounter allocations;
+   const auto countersStart = ReadThreadPerfCounters(opts.fPerfCounters);
+   ByteData byteData;
+   if (opts.fRawIO) {
+      byteData = ReadRaw(*f, branches, range);
+      progress.Update(byteData.fUncompressedBytesRead);
+   } else if (opts.fSplitPhases) {
+      byteData = ReadInPhases(*t, branches, range, opts.fPerfCounters);
+      progress.Update(byteData.fUncompressedBytesRead);
+   } else if (opts.fBulkRead) {
+      const ULong64_t fileStartBytes = openFile.GetBytesRead();
+      byteData.fUncompressedBytesRead = ReadBulk(branches, range);
+      byteData.fCompressedBytesRead = openFile.GetBytesRead() - fileStartBytes;
+      progress.Update(byteData.fUncompressedBytesRead);
+   } else if (opts.fReadOrder == EReadOrder::kBranchMajor) {
+      const ULong64_t fileStartBytes = openFile.GetBytesRead();
+      ULong64_t bytesRead = 0;
+      for (auto *b : branches) {
+         ThreadStopwatch sw;
+         sw.Start();
+         ULong64_t branchBytesRead = 0;
+         for (auto e = range.fStart; e < range.fEnd; ++e) {
+            const auto entryBytes = b->GetEntry(e);
+            branchBytesRead += entryBytes;
+            progress.Update(entryBytes);
+         }
+         sw.Stop();
+         bytesRead += branchBytesRead;
+         auto &stats = byteData.fBranchStats[b->GetName()];
+         stats.fRealTime += sw.RealTime();
+         stats.fUncompressedBytesRead += branchBytesRead;
+      }
+      byteData.fUncompressedBytesRead = bytesRead;
+      byteData.fCompressedBytesRead = openFile.GetBytesRead() - fileStartBytes;
+   } else if (opts.fPerBranch) {
+      // same loop as below, but timing each GetEntry call
+      using Clock = std::chrono::steady_clock;
+      const ULong64_t fileStartBytes = openFile.GetBytesRead();
+      std::vector<Clock::duration> branchTimes(branches.size(), Clock::duration::zero());
+      std::vector<ULong64_t> branchBytesRead(branches.size(), 0ull);
+      for (auto e = range.fStart; e < range.fEnd; ++e) {
+         ULong64_t entryBytes = 0;
+         for (std::size_t i = 0u; i < branches.size(); ++i) {
+            const auto start = Clock::now();
+            const auto bytes = branches[i]->GetEntry(e);
+            branchTimes[i] += Clock::now() - start;
+            branchBytesRead[i] += bytes;
+            entryBytes += bytes;
+         }
+         progress.Update(entryBytes);
+      }
+      for (std::size_t i = 0u; i < branches.size(); ++i) {
+         auto &stats = byteData.fBranchStats[branches[i]->GetName()];
+         stats.fRealTime += std::chrono::duration<double>(branchTimes[i]).count();
+         stats.fUncompressedBytesRead += branchBytesRead[i];
+         byteData.fUncompressedBytesRead += branchBytesRead[i];
+      }
+      byteData.fCompressedBytesRead = openFile.GetBytesRead() - fileStartBytes;
+   } else {
+      ULong64_t bytesRead = 0;
+      const ULong64_t fileStartBytes = openFile.GetBytesRead();
+      for (auto e = range.fStart; e < range.fEnd; ++e) {
+         ULong64_t entryBytes = 0;
+         for (const auto &b : branches)
+            entryBytes += b->GetEntry(e);
+         bytesRead += entryBytes;
+         progress.Update(entryBytes);
+      }
+
+      byteData.fUncompressedBytesRead = bytesRead;
+      byteData.fCompressedBytesRead = openFile.GetBytesRead() - fileStartBytes;
+   }
+   byteData.fPerfCounters = ReadThreadPerfCounters(opts.fPerfCounters) - countersStart;
+   allocations.Stop(byteData);
+
+   byteData.fCacheStats.fReadCalls = openFile.GetReadCalls() - readCallsStart;
+   // a cache created during the task, e.g. by TTree's automatic configuration, starts counting from 0. Each tree has
+   // its own cache, so this is checked tree by tree.
+   for (auto treeIdx = 0u; treeIdx < trees.size(); ++treeIdx) {
+      const auto cacheEnd = TreeCacheCounters::Get(*trees[treeIdx]);
+      const auto &start = cacheStart[treeIdx];
+      const bool restarted = cacheEnd.fCacheHits < start.fCacheHits || cacheEnd.fCacheMisses < start.fCacheMisses;
+      byteData.fCacheStats.fCacheHits += cacheEnd.fCacheHits - (restarted ? 0 : start.fCacheHits);
+      byteData.fCacheStats.fCacheMisses += cacheEnd.fCacheMisses - (restarted ? 0 : start.fCacheMisses);
+   }
+   for (auto *b : branches) {
+      auto it = byteData.fBranchStats.find(b->GetName());
+      if (it != byteData.fBranchStats.end())
+         FillBranchMetadata(*b, range, it->second);
+   }
+
+   byteData.fFileOpens = fileOpens;
+   byteData.fFileReopens = fileReopens;
+   byteData.fNTasks = 1;
+   byteData.fTaskSetupRealTime = setupSw.RealTime();
+   byteData.fTaskSetupCpuTime = setupSw.CpuTime();
+   return byteData;
+}
+
+ByteData ReadSpeed::ReadRNTuple(const std::string &ntupleName, const std::string &fileName,
+                                const std::vector<std::string> &fieldNames, EntryRange range, const Options &opts)
+{
+   ThreadStopwatch setupSw;
+   setupSw.Start();
+
+   // as for TTrees, each thread keeps its reader open across tasks, and opens files again at the start of each run
+   thread_local std::unique_ptr<RNTupleTaskReader> reader;
+   thread_local std::set<std::string> openedFiles;
+   thread_local unsigned int runNumber = 0;
+   if (runNumber != gRunNumber) {
+      reader.reset();
+      openedFiles.clear();
+      runNumber = gRunNumber;
+   }
+   // per-field statistics need a reader per field, to time fields and count their bytes separately
+   const bool perField = opts.fPerBranch || opts.fReadOrder == EReadOrder::kBranchMajor;
+   ByteData byteData;
+   if (reader == nullptr || !reader->Reads(ntupleName, fileName, fieldNames, perField)) {
+      reader.reset();
+      reader = std::make_unique<RNTupleTaskReader>(ntupleName, fileName, fieldNames, perField);
+      byteData.fFileOpens = 1;
+      if (!openedFiles.insert(fileName).second)
+         byteData.fFileReopens = 1;
+   }
+
+   const auto nEntries = reader->GetEntries();
+   if (range.fStart == -1ll)
+      range = EntryRange{0ll, nEntries};
+   else if (range.fEnd > nEntries)
+      throw std::runtime_error("Range end (" + std::to_string(range.fEnd) + ") is beyond the end of RNTuple '" +
+                               ntupleName + "' in file '" + fileName + "' with " + std::to_string(nEntries) +
+                               " entries.");
+   setupSw.Stop();
+
+   std::vector<RNTupleTaskReader::Bytes> fieldStartBytes;
+   if (perField)
+      for (auto i = 0u; i < fieldNames.size(); ++i)
+         fieldStartBytes.push_back(reader->GetFieldBytes(i));
+   const auto startBytes = reader->GetBytes();
+   // the reader counts bytes per page, not per entry, so progress is reported at the end of the task
+   ProgressReporter progress(opts);
+   AllocationCounter allocations;
+   const auto countersStart = ReadThreadPerfCounters(opts.fPerfCounters);
+   if (opts.fReadOrder == EReadOrder::kBranchMajor) {
+      for (auto i = 0u; i < fieldNames.size(); ++i) {
+         ThreadStopwatch sw;
+         sw.Start();
+         for (auto e = range.fStart; e < range.fEnd; ++e)
+            reader->LoadFieldEntry(i, e);
+         sw.Stop();
+         byteData.fBranchStats[fieldNames[i]].fRealTime += sw.RealTime();
+      }
+   } else if (opts.fPerBranch) {
+      // same loop as LoadEntries, but timing each field
+      using Clock = std::chrono::steady_clock;
+      std::vector<Clock::duration> fieldTimes(fieldNames.size(), Clock::duration::zero());
+      for (auto e = range.fStart; e < range.fEnd; ++e) {
+         for (std::size_t i = 0u; i < fieldNames.size(); ++i) {
+            const auto start = Clock::now();
+            reader->LoadFieldEntry(i, e);
+            fieldTimes[i] += Clock::now() - start;
+         }
+      }
+      for (std::size_t i = 0u; i < fieldNames.size(); ++i)
+         byteData.fBranchStats[fieldNames[i]].fRealTime += std::chrono::duration<double>(fieldTimes[i]).count();
+   } else {
+      reader->LoadEntries(range);
+   }
+   byteData.fPerfCounters = ReadThreadPerfCounters(opts.fPerfCounters) - countersStart;
+   allocations.Stop(byteData);
+   const auto endBytes = reader->GetBytes();
+
+   byteData.fUncompressedBytesRead = endBytes.fUncompressed - startBytes.fUncompressed;
+   byteData.fCompressedBytesRead = endBytes.fCompressed - startBytes.fCompressed;
+   progress.Update(byteData.fUncompressedBytesRead, byteData.fCompressedBytesRead);
+   if (perField) {
+      for (auto i = 0u; i < fieldNames.size(); ++i) {
+         const auto fieldEndBytes = reader->GetFieldBytes(i);
+         auto &stats = byteData.fBranchStats[fieldNames[i]];
+         stats.fUncompressedBytesRead += fieldEndBytes.fUncompressed - fieldStartBytes[i].fUncompressed;
+         stats.fCompressedBytes += fieldEndBytes.fCompressed - fieldStartBytes[i].fCompressed;
+      }
+   }
+   byteData.fNTasks = 1;
+   byteData.fTaskSetupRealTime = setupSw.RealTime();
+   byteData.fTaskSetupCpuTime = setupSw.CpuTime();
+   return byteData;
+}
+
+namespace {
+const std::string &GetTreeName(const Data &d, std::size_t fileIdx)
+{
+   return d.fTreeNames.size() > 1 ? d.fTreeNames[fileIdx] : d.fTreeNames[0];
+}
+
+// The friends of the tree of file fileIdx of d.
+std::vector<FriendTree> GetFriendTrees(const Data &d, std::size_t fileIdx)
+{
+   std::vector<FriendTree> friends;
+   for (const auto &fr : d.fFriends)
+      friends.push_back({fr.fTreeName, fr.fFileNames.empty() ? std::string() : fr.fFileNames[fileIdx]});
+   return friends;
+}
+
+// What the runs need to know about the format of a dataset (see EFormat): each format implements it once, and the
+// runs go through GetFormatReader instead of checking the format themselves.
+class FormatReader {
+public:
+   virtual ~FormatReader() = default;
+
+   // Throw if opts cannot be used to read d in this format.
+   virtual void Validate(const Data &d, const Options &opts) const = 0;
+
+   // Throw if the data of d cannot be loaded and recompressed by EvalRecompression.
+   virtual void ValidateRecompression(const Data &d) const = 0;
+
+   // Open file fileIdx of d once to retrieve both its cluster boundaries and, if requested, the names of the
+   // branches to read. If d.fUseRegex is set, branch names are matched with matcher.
+   virtual FileLayout GetFileLayout(const Data &d, std::size_t fileIdx, bool matchBranches,
+                                    BranchMatcher *matcher) const = 0;
+
+   // Match the branch regexes of d against the branches (or fields) of file fileIdx of d.
+   virtual std::vector<std::string> MatchBranchNames(const Data &d, std::size_t fileIdx,
+                                                     BranchMatcher &matcher) const = 0;
+
+   // Read one task of file fileIdx of d.
+   virtual ByteData ReadTask(const Data &d, std::size_t fileIdx, const std::vector<std::string> &branchNames,
+                             EntryRange range, const Options &opts) const = 0;
+
+   // The memory held by the thread threadId for the data it read last, see ByteData::fBasketBytes.
+   virtual ULong64_t GetThreadMemory(std::thread::id threadId) const = 0;
+};
+
+// TTrees, read with ReadTree together with their friends.
+class TreeFormatReader final : public FormatReader {
+public:
+   void Validate(const Data &d, const Options &opts) const final;
+
+   void ValidateRecompression(const Data &d) const final
+   {
+      if (!d.fFriends.empty())
+         throw std::runtime_error("Recompression cannot be used together with friend trees");
+   }
+
+   FileLayout GetFileLayout(const Data &d, std::size_t fileIdx, bool matchBranches,
+                            BranchMatcher *matcher) const final;
+
+   std::vector<std::string> MatchBranchNames(const Data &d, std::size_t fileIdx, BranchMatcher &matcher) const final
+   {
+      return matcher.GetMatchingBranchNames(d.fFileNames[fileIdx], GetTreeName(d, fileIdx), GetFriendTrees(d, fileIdx));
+   }
+
+   ByteData ReadTask(const Data &d, std::size_t fileIdx, const std::vector<std::string> &branchNames,
+                     EntryRange range, const Options &opts) const final
+   {
+      return ReadTree(GetTreeName(d, fileIdx), d.fFileNames[fileIdx], branchNames, range, opts,
+                      GetFriendTrees(d, fileIdx));
+   }
+
+   ULong64_t GetThreadMemory(std::thread::id threadId) const final { return GetThreadBasketMemory(threadId); }
+};
+
+// RNTuples, read with ReadRNTuple.
+class RNTupleFormatReader final : public FormatReader {
+public:
+   void Validate(const Data &d, const Options &opts) const final;
+
+   void ValidateRecompression(const Data &) const final
+   {
+      throw std::runtime_error("Recompression cannot be used when reading RNTuples");
+   }
+
+   FileLayout GetFileLayout(const Data &d, std::size_t fileIdx, bool matchBranches,
+                            BranchMatcher *matcher) const final;
+
+   std::vector<std::string> MatchBranchNames(const Data &d, std::size_t fileIdx, BranchMatcher &matcher) const final
+   {
+      return matcher.MatchBranchNames(GetRNTupleLayout(GetTreeName(d, fileIdx), d.fFileNames[fileIdx]).fFieldNames);
+   }
+
+   ByteData ReadTask(const Data &d, std::size_t fileIdx, const std::vector<std::string> &branchNames,
+                     EntryRange range, const Options &opts) const final
+   {
+      return ReadRNTuple(GetTreeName(d, fileIdx), d.fFileNames[fileIdx], branchNames, range, opts);
+   }
+
+   // the pages of the readers are not tracked
+   ULong64_t GetThreadMemory(std::thread::id) const final { return 0; }
+};
+
+const FormatReader &GetFormatReader(EFormat format)
+{
+   static const TreeFormatReader treeReader;
+   static const RNTupleFormatReader ntupleReader;
+   if (format == EFormat::kRNTuple)
+      return ntupleReader;
+   return treeReader;
+}
+
+// Match the branch regexes of d against the branches (or fields) of file fileIdx of d, and of its friends.
+std::vector<std::string> MatchFileBranchNames(const Data &d, std::size_t fileIdx, BranchMatcher &matcher)
+{
+   return GetFormatReader(d.fFormat).MatchBranchNames(d, fileIdx, matcher);
+}
+
+// Read one task of file fileIdx of d with the reader of its format.
+ByteData ReadTask(const Data &d, std::size_t fileIdx, const std::vector<std::string> &branchNames, EntryRange range,
+                  const Options &opts)
+{
+   return GetFormatReader(d.fFormat).ReadTask(d, fileIdx, branchNames, range, opts);
+}
+
+// Read the tasks of w one after the other on the calling thread. Each task is read with one call to ReadTree (or
+// ReadRNTuple).
+// If fileBranchNames is null, the branches of each file are resolved right before reading it (outside of the timed
+// region).
+Result EvalThroughputSTImpl(const Data &d, const Workload &w,
+                            const std::vector<std::vector<std::string>> *fileBranchNames, const Options &opts)
+{
+   ByteData total;
+
+   std::unique_ptr<BranchMatcher> matcher;
+   if (d.fUseRegex && fileBranchNames == nullptr)
+      matcher = std::make_unique<BranchMatcher>(d.fBranchNames);
+   std::vector<TaskStats> sampledClusters;
+
+   const CacheSettingsGuard cacheSettings(opts);
+   ++gRunNumber;
+   TStopwatch sw;
+   sw.Reset(); // TStopwatch starts running on construction, but we only want to time the reading of each file
+   ProgressSampler sampler(opts.fSampleInterval);
+
+   for (auto fileIdx = 0u; fileIdx < d.fFileNames.size(); ++fileIdx) {
+      std::vector<std::string> branchNames;
+      if (fileBranchNames != nullptr)
+         branchNames = (*fileBranchNames)[fileIdx];
+      else if (d.fUseRegex)
+         branchNames = MatchFileBranchNames(d, fileIdx, *matcher);
+      else
+         branchNames = d.fBranchNames;
+
+      sw.Start(/*reset=*/false);
+
+      for (const auto &range : w.fTasks[fileIdx]) {
+         const auto start = std::chrono::steady_clock::now();
+         auto byteData = ReadTask(d, fileIdx, branchNames, range, opts);
+         const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+         // walking the baskets of all branches read takes time: the run's stopwatch is paused meanwhile
+         sw.Stop();
+         byteData.fBasketBytes = GetFormatReader(d.fFormat).GetThreadMemory(std::this_thread::get_id());
+         sw.Start(/*reset=*/false);
+         // sampled clusters are timed one by one to project the run to the whole selection
+         if (w.fSampled) {
+            sampledClusters.push_back({fileIdx, range, 0u, elapsed.count(), 0., byteData.fTaskSetupRealTime,
+                                       byteData.fUncompressedBytesRead, byteData.fCompressedBytesRead});
+         }
+         total += byteData;
+      }
+
+      sw.Stop();
+   }
+
+   auto timeSeries = sampler.Stop();
+
+   Projection projection;
+   if (w.fSampled)
+      projection = ProjectFromSample(sampledClusters, sw.RealTime(), w.fSelection.fTotalEntries,
+                                     w.fSelection.fTotalClusters);
+
+   Result result{};
+   result.fRealTime = sw.RealTime();
+   result.fCpuTime = sw.CpuTime();
+   result.fUncompressedBytesRead = total.fUncompressedBytesRead;
+   result.fCompressedBytesRead = total.fCompressedBytesRead;
+   result.fPhaseTimes = total.fPhaseTimes;
+   result.fFileOpens = total.fFileOpens;
+   result.fFileReopens = total.fFileReopens;
+   result.fNTasks = total.fNTasks;
+   result.fTaskSetupRealTime = total.fTaskSetupRealTime;
+   result.fTaskSetupCpuTime = total.fTaskSetupCpuTime;
+   result.fBranchStats = std::move(total.fBranchStats);
+   result.fCacheStats = total.fCacheStats;
+   result.fProjection = projection;
+   result.fTimeSeries = std::move(timeSeries);
+   result.fMemory = MakeMemoryStats(total);
+   result.fPerfCounters = total.fPerfCounters;
+   return result;
+}
+} // anonymous namespace
+
+Result ReadSpeed::EvalThroughputST(const Data &d, const Options &opts)
+{
+   // with an entry selection, the clusters of each file are retrieved beforehand, outside of the timed region;
+   // otherwise each file is read whole, with no need to open it before
+   Workload w;
+   if (SelectsEntries(opts)) {
+      DatasetLayout layout;
+      layout.fClusters = GetClusters(d);
+      w = MakeWorkload(layout, 0, opts);
+   } else {
+      w.fTasks.assign(d.fFileNames.size(), {EntryRange{-1, -1}});
+   }
+   return EvalThroughputSTImpl(d, w, nullptr, opts);
+}
+
+namespace {
+// Retrieve size and modification time of a file from the filesystem, or leave them untouched if that fails.
+// Return whether it succeeded.
+bool StatFile(const std::string &fileName, FileMetadata &metadata)
+{
+   FileStat_t stat;
+   if (gSystem->GetPathInfo(fileName.c_str(), stat) != 0)
+      return false;
+   metadata.fFileSize = stat.fSize;
+   metadata.fModTime = stat.fMtime;
+   return true;
+}
+
+// The uncompressed size of the fields and the UUID of the file are not retrieved.
+FileLayout RNTupleFormatReader::GetFileLayout(const Data &d, std::size_t fileIdx, bool matchBranches,
+                                              BranchMatcher *matcher) const
+{
+   const auto &fileName = d.fFileNames[fileIdx];
+   const auto &ntupleName = GetTreeName(d, fileIdx);
+   auto ntuple = GetRNTupleLayout(ntupleName, fileName);
+
+   FileLayout layout;
+   layout.fClusters = std::move(ntuple.fClusters);
+   auto &metadata = layout.fMetadata;
+   metadata.fTreeName = ntupleName;
+   metadata.fEntries = ntuple.fEntries;
+   StatFile(fileName, metadata);
+
+   if (matchBranches) {
+      layout.fBranchNames = d.fUseRegex ? matcher->MatchBranchNames(ntuple.fFieldNames) : d.fBranchNames;
+      layout.fClusterBytes.assign(layout.fClusters.size(), 0);
+      for (const auto &fieldName : layout.fBranchNames) {
+         // missing fields are reported when reading
+         const auto it = ntuple.fFieldClusterBytes.find(fieldName);
+         if (it == ntuple.fFieldClusterBytes.end())
+            continue;
+         for (auto clusterIdx = 0u; clusterIdx < it->second.size(); ++clusterIdx) {
+            layout.fClusterBytes[clusterIdx] += it->second[clusterIdx];
+            metadata.fZipBytes += it->second[clusterIdx];
+         }
+      }
+   }
+
+   return layout;
+}
+
+FileLayout TreeFormatReader::GetFileLayout(const Data &d, std::size_t fileIdx, bool matchBranches,
+                                          BranchMatcher *matcher) const
+{
+   const auto &fileName = d.fFileNames[fileIdx];
+   std::unique_ptr<TFile> f(TFile::Open(fileName.c_str(), "READ_WITHOUT_GLOBALREGISTRATION"));
+   if (f == nullptr || f->IsZombie())
+      throw std::runtime_error("There was a problem opening file '" + fileName + '\'');
+   const auto &treeName = GetTreeName(d, fileIdx);
+   auto *t = f->Get<TTree>(treeName.c_str()); // TFile owns this TTree
+   if (t == nullptr)
+      throw std::runtime_error("There was a problem retrieving TTree '" + treeName + "' from file '" + fileName +
+                               '\'');
+
+   FileLayout layout;
+   const auto nEntries = t->GetEntries();
+   auto it = t->GetClusterIterator(0);
+   Long64_t start = 0;
+   while ((start = it.Next()) < nEntries)
+      layout.fClusters.emplace_back(EntryRange{start, it.GetNextEntry()});
+
+   auto &metadata = layout.fMetadata;
+   metadata.fTreeName = treeName;
+   metadata.fUUID = f->GetUUID().AsString();
+   metadata.fEntries = nEntries;
+   StatFile(fileName, metadata);
+
+   if (matchBranches) {
+      // cluster sizes include the baskets of the selected branches of friends
+      AddFriendTrees(*t, GetFriendTrees(d, fileIdx), nullptr);
+      layout.fBranchNames = d.fUseRegex ? matcher->GetMatchingBranchNames(*t) : d.fBranchNames;
+      layout.fClusterBytes.assign(layout.fClusters.size(), 0);
+      std::vector<Long64_t> clusterStarts;
+      for (const auto &c : layout.fClusters)
+         clusterStarts.push_back(c.fStart);
+      for (const auto &bName : layout.fBranchNames) {
+         // missing branches are reported when reading
+         if (auto *b = t->GetBranch(bName.c_str())) {
+            metadata.fZipBytes += b->GetZipBytes("*");
+            metadata.fTotBytes += b->GetTotBytes("*");
+            std::vector<TBranch *> allBranches;
+            CollectBranchesRecursively(b, allBranches);
+            for (auto *subBranch : allBranches) {
+               const Long64_t *basketEntries = subBranch->GetBasketEntry();
+               for (const auto &basket : GetBasketsInRange(*subBranch, {0, nEntries})) {
+                  const auto it = std::upper_bound(clusterStarts.begin(), clusterStarts.end(),
+                                                   basketEntries[basket.fIndex]);
+                  if (it != clusterStarts.begin())
+                     layout.fClusterBytes[it - clusterStarts.begin() - 1] += basket.fBytes;
+               }
+            }
+         }
+      }
+   }
+
+   return layout;
+}
+
+// Open file fileIdx of d once to retrieve both its cluster boundaries and, if requested, the names of the branches
+// to read. If d.fUseRegex is set, branch names are matched with matcher.
+FileLayout GetFileLayout(const Data &d, std::size_t fileIdx, bool matchBranches, BranchMatcher *matcher)
+{
+   return GetFormatReader(d.fFormat).GetFileLayout(d, fileIdx, matchBranches, matcher);
+}
+} // anonymous namespace
+
+std::vector<int> ReadSpeed::ParseCpuList(const std::string &cpuList)
+{
+   std::vector<int> cpus;
+   std::istringstream in(cpuList);
+   std::string item;
+   while (std::getline(in, item, ',')) {
+      item.erase(std::remove_if(item.begin(), item.end(), [](char c) { return std::isspace(c); }), item.end());
+      if (item.empty())
+         continue;
+      const auto dash = item.find('-');
+      std::size_t firstEnd = 0, lastEnd = 0;
+      int first = 0, last = 0;
+      try {
+         first = std::stoi(item.substr(0, dash), &firstEnd);
+         last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1), &lastEnd);
+      } catch (const std::logic_error &) {
+         throw std::runtime_error("Malformed CPU list '" + cpuList + '\'');
+      }
+      const bool trailing = firstEnd != item.substr(0, dash).size() ||
+                            (dash != std::string::npos && lastEnd != item.size() - dash - 1);
+      if (trailing || first < 0 || last < first)
+         throw std::runtime_error("Malformed CPU list '" + cpuList + '\'');
+      for (auto cpu = first; cpu <= last; ++cpu)
+         cpus.push_back(cpu);
+   }
+   return cpus;
+}
+
+// Return a vector of EntryRanges per file, i.e. a vector of vectors of EntryRanges with outer size equal to
+// d.fFileNames.
+std::vector<std::vector<EntryRange>> ReadSpeed::GetClusters(const Data &d)
+{
+   const auto nFiles = d.fFileNames.size();
+   std::vector<std::vector<EntryRange>> ranges(nFiles);
+   for (auto fileIdx = 0u; fileIdx < nFiles; ++fileIdx)
+      ranges[fileIdx] = GetFileLayout(d, fileIdx, /*matchBranches=*/false, nullptr).fClusters;
+   return ranges;
+}
+
+// Mimic the logic of TTreeProcessorMT::MakeClusters: merge entry ranges together such that we
+// run around TTreeProcessorMT::GetTasksPerWorkerHint tasks per worker thread.
+// TODO it would be better to expose TTreeProcessorMT's actual logic and call the exact same method from here
+std::vector<std::vector<EntryRange>>
+ReadSpeed::MergeClusters(std::vector<std::vector<EntryRange>> &&clusters, unsigned int maxTasksPerFile)
+{
+   std::vector<std::vector<EntryRange>> mergedClusters(clusters.size());
+
+   auto clustersIt = clusters.begin();
+   auto mergedClustersIt = mergedClusters.begin();
+   for (; clustersIt != clusters.end(); clustersIt++, mergedClustersIt++) {
+      const auto nClustersInThisFile = clustersIt->size();
+      const auto nFolds = nClustersInThisFile / maxTasksPerFile;
+      // If the number of clusters is less than maxTasksPerFile
+      // we take the clusters as they are
+      if (nFolds == 0) {
+         *mergedClustersIt = *clustersIt;
+         continue;
+      }
+      // Otherwise, we have to merge clusters, distributing the reminder evenly
+      // between the first clusters
+      auto nReminderClusters = nClustersInThisFile % maxTasksPerFile;
+      const auto &clustersInThisFile = *clustersIt;
+      for (auto i = 0ULL; i < nClustersInThisFile; ++i) {
+         const auto start = clustersInThisFile[i].fStart;
+         // We lump together at least nFolds clusters, therefore
+         // we need to jump ahead of nFolds-1.
+         i += (nFolds - 1);
+         // We now add a cluster if we have some reminder left
+         if (nReminderClusters > 0) {
+            i += 1U;
+            nReminderClusters--;
+         }
+         const auto end = clustersInThisFile[i].fEnd;
+         mergedClustersIt->emplace_back(EntryRange({start, end}));
+      }
+      assert(nReminderClusters == 0 && "This should never happen, cluster-merging logic is broken.");
+   }
+
+   return mergedClusters;
+}
+
+std::vector<std::vector<EntryRange>>
+ReadSpeed::MergeClustersByCost(const std::vector<std::vector<EntryRange>> &clusters,
+                               const std::vector<std::vector<double>> &costs, unsigned int nTasks)
+{
+   double totalCost = 0.;
+   for (const auto &fileCosts : costs)
+      totalCost = std::accumulate(fileCosts.begin(), fileCosts.end(), totalCost);
+   const double targetCost = totalCost / std::max(nTasks, 1u);
+
+   std::vector<std::vector<EntryRange>> merged(clusters.size());
+   for (auto fileIdx = 0u; fileIdx < clusters.size(); ++fileIdx) {
+      const auto &fileClusters = clusters[fileIdx];
+      if (fileClusters.empty())
+         continue;
+      auto taskStart = fileClusters.front().fStart;
+      double taskCost = 0.;
+      for (auto i = 0u; i < fileClusters.size(); ++i) {
+         const auto cost = costs[fileIdx][i];
+         // close the task before this cluster if adding it would overshoot the target by more than it undershoots
+         if (taskCost > 0. && taskCost + cost / 2. > targetCost) {
+            merged[fileIdx].push_back({taskStart, fileClusters[i].fStart});
+            taskStart = fileClusters[i].fStart;
+            taskCost = 0.;
+         }
+         taskCost += cost;
+      }
+      merged[fileIdx].push_back({taskStart, fileClusters.back().fEnd});
+   }
+   return merged;
+}
+
+std::vector<std::vector<EntryRange>> ReadSpeed::ClipClusters(const std::vector<std::vector<EntryRange>> &clusters,
+                                                             EntryRange range, Long64_t maxEntriesPerFile)
+{
+   std::vector<std::vector<EntryRange>> clipped(clusters.size());
+   for (auto fileIdx = 0u; fileIdx < clusters.size(); ++fileIdx) {
+      if (clusters[fileIdx].empty())
+         continue;
+      auto start = range.fStart >= 0 ? range.fStart : clusters[fileIdx].front().fStart;
+      auto end = range.fEnd >= 0 ? range.fEnd : clusters[fileIdx].back().fEnd;
+      if (maxEntriesPerFile >= 0)
+         end = std::min(end, std::max(start, clusters[fileIdx].front().fStart) + maxEntriesPerFile);
+      for (const auto &c : clusters[fileIdx]) {
+         const EntryRange r{std::max(c.fStart, start), std::min(c.fEnd, end)};
+         if (r.fStart < r.fEnd)
+            clipped[fileIdx].emplace_back(r);
+      }
+   }
+   return clipped;
+}
+
+std::vector<std::vector<EntryRange>>
+ReadSpeed::SampleClusters(const std::vector<std::vector<EntryRange>> &clusters, double sample, unsigned int seed)
+{
+   const auto nTotalClusters =
+      std::accumulate(clusters.begin(), clusters.end(), std::size_t(0),
+                      [](std::size_t s, const std::vector<EntryRange> &c) { return s + c.size(); });
+   if (nTotalClusters == 0)
+      return clusters;
+   const auto nRequested = sample < 1. ? std::llround(sample * nTotalClusters) : std::llround(sample);
+   const auto nSampled = std::min(std::max<std::size_t>(nRequested, 1), nTotalClusters);
+
+   // proportional allocation of the sample to the files, rounding with the largest remainder method
+   std::vector<std::size_t> nPerFile(clusters.size());
+   std::vector<std::pair<double, std::size_t>> remainders; // (remainder, file index)
+   std::size_t nAllocated = 0;
+   for (auto fileIdx = 0u; fileIdx < clusters.size(); ++fileIdx) {
+      const auto quota = double(nSampled) * clusters[fileIdx].size() / nTotalClusters;
+      nPerFile[fileIdx] = static_cast<std::size_t>(quota);
+      nAllocated += nPerFile[fileIdx];
+      remainders.emplace_back(quota - nPerFile[fileIdx], fileIdx);
+   }
+   std::stable_sort(remainders.begin(), remainders.end(),
+                    [](const std::pair<double, std::size_t> &a, const std::pair<double, std::size_t> &b) {
+                       return a.first > b.first;
+                    });
+   for (auto i = 0u; nAllocated < nSampled; ++i, ++nAllocated)
+      ++nPerFile[remainders[i].second];
+
+   std::mt19937 rng(seed);
+   std::vector<std::vector<EntryRange>> sampled(clusters.size());
+   for (auto fileIdx = 0u; fileIdx < clusters.size(); ++fileIdx) {
+      // partial Fisher-Yates shuffle of the cluster indices
+      std::vector<std::size_t> indices(clusters[fileIdx].size());
+      std::iota(indices.begin(), indices.end(), 0);
+      for (auto i = 0u; i < nPerFile[fileIdx]; ++i) {
+         std::uniform_int_distribution<std::size_t> dist(i, indices.size() - 1);
+         std::swap(indices[i], indices[dist(rng)]);
+      }
+      indices.resize(nPerFile[fileIdx]);
+      std::sort(indices.begin(), indices.end());
+      for (const auto idx : indices)
+         sampled[fileIdx].emplace_back(clusters[fileIdx][idx]);
+   }
+   return sampled;
+}
+
+Projection ReadSpeed::ProjectFromSample(const std::vector<TaskStats> &sample, double realTime, ULong64_t totalEntries,
+                                        std::size_t totalClusters)
+{
+   Projection p;
+   p.fTotalEntries = totalEntries;
+   p.fTotalClusters = totalClusters;
+   p.fSampledClusters = sample.size();
+   double sampledTime = 0.;
+   ULong64_t uncompressedBytes = 0;
+   ULong64_t compressedBytes = 0;
+   for (const auto &t : sample) {
+      p.fSampledEntries += t.fRange.fEnd - t.fRange.fStart;
+      sampledTime += t.fRealTime;
+      uncompressedBytes += t.fUncompressedBytesRead;
+      compressedBytes += t.fCompressedBytesRead;
+   }
+   if (p.fSampledEntries == 0 || sampledTime <= 0.)
+      return p;
+
+   // Scale the wall-clock time of the run by the ratio of selected to sampled entries: this assumes the overhead of
+   // the run and the parallel efficiency stay the same when reading all selected entries.
+   const auto scale = double(totalEntries) / p.fSampledEntries;
+   p.fRealTime = realTime * scale;
+   p.fRealTimeLow = p.fRealTimeHigh = p.fRealTime;
+   p.fUncompressedBytesRead = static_cast<ULong64_t>(uncompressedBytes * scale);
+   p.fCompressedBytesRead = static_cast<ULong64_t>(compressedBytes * scale);
+
+   const auto n = sample.size();
+   if (n < 2)
+      return p;
+   // Variance of the ratio estimator of the time per entry, with finite population correction, treating the
+   // stratified sample as a simple random sample of clusters (which slightly overestimates the variance).
+   const auto timePerEntry = sampledTime / p.fSampledEntries;
+   double residuals = 0.;
+   for (const auto &t : sample) {
+      const auto r = t.fRealTime - timePerEntry * (t.fRange.fEnd - t.fRange.fStart);
+      residuals += r * r;
+   }
+   const auto meanEntries = double(p.fSampledEntries) / n;
+   const auto fpc = totalClusters > n ? 1. - double(n) / totalClusters : 0.;
+   const auto stdErr = std::sqrt(fpc * residuals / (n - 1) / n) / meanEntries; // of timePerEntry
+   // the relative error of the time per entry carries over to the projected real time
+   const auto halfWidth = 1.96 * stdErr / timePerEntry * p.fRealTime;
+   p.fRealTimeLow = std::max(0., p.fRealTime - halfWidth);
+   p.fRealTimeHigh = p.fRealTime + halfWidth;
+   return p;
+}
+
+double ReadSpeed::Percentile(std::vector<double> values, double p)
+{
+   if (values.empty())
+      return 0.;
+   const auto rank = std::max(static_cast<size_t>(std::ceil(p / 100. * values.size())), size_t(1)) - 1;
+   std::nth_element(values.begin(), values.begin() + rank, values.end());
+   return values[rank];
+}
+
+SummaryStats ReadSpeed::Summarize(const std::vector<double> &values)
+{
+   SummaryStats stats;
+   if (values.empty())
+      return stats;
+
+   const auto n = values.size();
+   stats.fMean = std::accumulate(values.begin(), values.end(), 0.) / n;
+   stats.fMin = *std::min_element(values.begin(), values.end());
+   if (n > 1) {
+      const auto squares = std::accumulate(values.begin(), values.end(), 0., [&stats](double sum, double v) {
+         return sum + (v - stats.fMean) * (v - stats.fMean);
+      });
+      stats.fStdDev = std::sqrt(squares / (n - 1));
+   }
+   auto sorted = values;
+   std::sort(sorted.begin(), sorted.end());
+   stats.fMedian = n % 2 == 1 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.;
+   return stats;
+}
+
+double ReadSpeed::AllocatedBytesPerMB(const Result &r)
+{
+   if (r.fMemory.fNAllocations < 0 || r.fUncompressedBytesRead == 0)
+      return -1.;
+   return r.fMemory.fAllocatedBytes / (r.fUncompressedBytesRead / 1024. / 1024.);
+}
+
+double ReadSpeed::InstructionsPerCycle(const PerfCounters &c)
+{
+   return c.fCycles > 0 ? double(c.fInstructions) / c.fCycles : 0.;
+}
+
+DatasetLayout ReadSpeed::GetDatasetLayout(const Data &d, ROOT::TThreadExecutor *pool, const std::string &indexFile)
+{
+   TStopwatch sw;
+   sw.Start();
+
+   // the layouts in the index are only usable if they were computed for the same branch selection, format and friends
+   std::vector<std::string> friendTreeNames;
+   for (const auto &fr : d.fFriends)
+      friendTreeNames.push_back(fr.fTreeName);
+   Index index;
+   if (!indexFile.empty()) {
+      index = LoadIndex(indexFile);
+      if (index.fBranchSelection != d.fBranchNames || index.fUseRegex != d.fUseRegex || index.fFormat != d.fFormat ||
+          index.fFriendTreeNames != friendTreeNames)
+         index = Index{d.fBranchNames, d.fUseRegex, d.fFormat, friendTreeNames, {}};
+   }
+
+   const auto nFiles = d.fFileNames.size();
+   // regexes are compiled once, and trees with the same schema are matched once, for the whole dataset
+   std::unique_ptr<BranchMatcher> matcher;
+   if (d.fUseRegex)
+      matcher = std::make_unique<BranchMatcher>(d.fBranchNames);
+   // returns the layout, and whether it was found in the index
+   auto getFileLayout = [&](std::size_t fileIdx) {
+      const auto &fileName = d.fFileNames[fileIdx];
+      const auto &treeName = GetTreeName(d, fileIdx);
+      const auto indexed = index.fFiles.find({fileName, treeName});
+      if (indexed != index.fFiles.end()) {
+         // a file that cannot be stat'ed (e.g. deleted or moved) never matches its entry
+         FileMetadata current;
+         const bool statted = StatFile(fileName, current);
+         const auto &stored = indexed->second.fMetadata;
+         // indexes written before cluster sizes were recorded do not have them
+         const bool hasClusterBytes = indexed->second.fClusterBytes.size() == indexed->second.fClusters.size();
+         if (statted && stored.fTreeName == treeName && stored.fFileSize != -1 &&
+             stored.fFileSize == current.fFileSize && stored.fModTime == current.fModTime && hasClusterBytes)
+            return std::make_pair(indexed->second, true);
+      }
+      return std::make_pair(GetFileLayout(d, fileIdx, /*matchBranches=*/true, matcher.get()), false);
+   };
+   std::vector<std::pair<FileLayout, bool>> fileLayouts;
+   if (pool != nullptr) {
+      fileLayouts = pool->Map(getFileLayout, ROOT::TSeqUL{nFiles});
+   } else {
+      for (auto fileIdx = 0u; fileIdx < nFiles; ++fileIdx)
+         fileLayouts.emplace_back(getFileLayout(fileIdx));
+   }
+
+   DatasetLayout layout;
+   layout.fClusters.reserve(nFiles);
+   layout.fBranchNames.reserve(nFiles);
+   layout.fMetadata.reserve(nFiles);
+   layout.fClusterBytes.reserve(nFiles);
+   for (auto fileIdx = 0u; fileIdx < nFiles; ++fileIdx) {
+      auto &fileLayout = fileLayouts[fileIdx].first;
+      if (fileLayouts[fileIdx].second)
+         ++layout.fNFilesFromIndex;
+      else if (!indexFile.empty())
+         index.fFiles[{d.fFileNames[fileIdx], GetTreeName(d, fileIdx)}] = fileLayout;
+      layout.fClusters.emplace_back(std::move(fileLayout.fClusters));
+      layout.fBranchNames.emplace_back(std::move(fileLayout.fBranchNames));
+      layout.fMetadata.emplace_back(std::move(fileLayout.fMetadata));
+      layout.fClusterBytes.emplace_back(std::move(fileLayout.fClusterBytes));
+   }
+
+   if (!indexFile.empty()) {
+      std::cout << "Files set up from index '" << indexFile << "': " << layout.fNFilesFromIndex << '/' << nFiles
+                << '\n';
+      if (layout.fNFilesFromIndex != nFiles)
+         SaveIndex(index, indexFile);
+   }
+
+   sw.Stop();
+   layout.fSetupRealTime = sw.RealTime();
+   layout.fSetupCpuTime = sw.CpuTime();
+   return layout;
+}
+
+namespace {
+// Per-worker queues of task indices for work-stealing scheduling. Workers pop tasks from the front of their own queue
+// and, once it is empty, steal from the back of the others', preferring tasks that read the same file as the last task
+// they ran so that ReadTree can reuse the file it has open.
+// Workers are expected to be distinct threads that Claim their queue before popping from it. Queues that no thread
+// claims (the pool might run the workers on fewer threads than it has) are stolen from by workers of any group once
+// their own group has run out of tasks.
+class WorkStealingQueues {
+   struct Queue {
+      std::mutex fMutex;
+      std::deque<std::size_t> fTasks;
+      bool fClaimed = false;
+   };
+
+   std::vector<Queue> fQueues;
+   /// File index of each task.
+   const std::vector<unsigned int> &fTaskFiles;
+
+   /// Group of each worker: workers only steal tasks from workers of the same group.
+   std::vector<unsigned int> fWorkerGroups;
+
+public:
+   // Tasks are distributed in contiguous blocks, so that each worker starts with the tasks of as few files as possible.
+   WorkStealingQueues(std::size_t nWorkers, const std::vector<unsigned int> &taskFiles)
+      : WorkStealingQueues(std::vector<unsigned int>(nWorkers, 0u), {AllTasks(taskFiles.size())}, taskFiles)
+   {
+   }
+
+   // Like the constructor above, but the tasks in groupTasks[g] are only distributed to the workers of group g, as
+   // given by workerGroups, and only stolen by them.
+   WorkStealingQueues(const std::vector<unsigned int> &workerGroups,
+                      const std::vector<std::vector<std::size_t>> &groupTasks,
+                      const std::vector<unsigned int> &taskFiles)
+      : fQueues(workerGroups.size()), fTaskFiles(taskFiles), fWorkerGroups(workerGroups)
+   {
+      for (auto group = 0u; group < groupTasks.size(); ++group) {
+         std::vector<std::size_t> workers;
+         for (auto workerIdx = 0u; workerIdx < workerGroups.size(); ++workerIdx)
+            if (workerGroups[workerIdx] == group)
+               workers.push_back(workerIdx);
+         const auto &tasks = groupTasks[group];
+         const auto nTasks = tasks.size();
+         const auto nWorkers = workers.size();
+         for (auto i = 0u; i < nWorkers; ++i)
+            for (auto t = i * nTasks / nWorkers; t < (i + 1) * nTasks / nWorkers; ++t)
+               fQueues[workers[i]].fTasks.push_back(tasks[t]);
+      }
+   }
+
+   static std::vector<std::size_t> AllTasks(std::size_t nTasks)
+   {
+      std::vector<std::size_t> tasks(nTasks);
+      std::iota(tasks.begin(), tasks.end(), 0u);
+      return tasks;
+   }
+
+   // Mark the queue of worker workerIdx as served by a thread.
+   void Claim(std::size_t workerIdx)
+   {
+      std::lock_guard<std::mutex> lock(fQueues[workerIdx].fMutex);
+      fQueues[workerIdx].fClaimed = true;
+   }
+
+   // Retrieve the next task for worker workerIdx, whose last task read file lastFile. Return false if no task is left.
+   bool Pop(std::size_t workerIdx, std::size_t lastFile, std::size_t &taskIdx)
+   {
+      {
+         auto &own = fQueues[workerIdx];
+         std::lock_guard<std::mutex> lock(own.fMutex);
+         if (!own.fTasks.empty()) {
+            taskIdx = own.fTasks.front();
+            own.fTasks.pop_front();
+            return true;
+         }
+      }
+
+      const auto nWorkers = fQueues.size();
+      // first tasks of the same file in the same group, then any task in the same group, then any task left in the
+      // unclaimed queues of other groups
+      enum class ESteal { kSameFile, kSameGroup, kUnclaimed };
+      for (const auto steal : {ESteal::kSameFile, ESteal::kSameGroup, ESteal::kUnclaimed}) {
+         for (auto i = 1u; i < nWorkers; ++i) {
+            const auto victimIdx = (workerIdx + i) % nWorkers;
+            const bool sameGroup = fWorkerGroups[victimIdx] == fWorkerGroups[workerIdx];
+            if (sameGroup == (steal == ESteal::kUnclaimed))
+               continue;
+            auto &victim = fQueues[victimIdx];
+            std::lock_guard<std::mutex> lock(victim.fMutex);
+            if (victim.fTasks.empty() || (steal == ESteal::kUnclaimed && victim.fClaimed))
+               continue;
+            if (steal != ESteal::kSameFile) {
+               taskIdx = victim.fTasks.back();
+               victim.fTasks.pop_back();
+               return true;
+            }
+            const auto sameFile = std::find_if(victim.fTasks.rbegin(), victim.fTasks.rend(),
+                                               [&](std::size_t t) { return fTaskFiles[t] == lastFile; });
+            if (sameFile != victim.fTasks.rend()) {
+               taskIdx = *sameFile;
+               victim.fTasks.erase(std::next(sameFile).base());
+               return true;
+            }
+         }
+      }
+
+      return false; // tasks are never added, so if all queues are empty we are done
+   }
+};
+
+struct NumaNode {
+   int fId;
+   std::vector<int> fCpus;
+};
+
+// Return the CPUs this process is allowed to run on, grouped by NUMA node as reported by sysfs. Nodes without such
+// CPUs are left out; if the topology cannot be read, all allowed CPUs are reported as node 0. Empty if the allowed
+// CPUs cannot be retrieved, or on platforms other than Linux.
+std::vector<NumaNode> GetNumaNodes()
+{
+   std::vector<NumaNode> nodes;
+#ifdef __linux__
+   cpu_set_t allowed;
+   CPU_ZERO(&allowed);
+   if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      return nodes;
+   auto readLine = [](const std::string &path) {
+      std::ifstream f(path);
+      std::string line;
+      std::getline(f, line);
+      return line;
+   };
+   auto allowedOnly = [&allowed](const std::vector<int> &cpus) {
+      std::vector<int> res;
+      for (const auto cpu : cpus)
+         if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+            res.push_back(cpu);
+      return res;
+   };
+
+   const std::string sysfs = "/sys/devices/system/node/";
+   const auto online = readLine(sysfs + "online");
+   if (!online.empty()) {
+      for (const auto id : ParseCpuList(online)) {
+         auto cpus = allowedOnly(ParseCpuList(readLine(sysfs + "node" + std::to_string(id) + "/cpulist")));
+         if (!cpus.empty())
+            nodes.push_back({id, std::move(cpus)});
+      }
+   }
+   if (nodes.empty()) {
+      std::vector<int> all(CPU_SETSIZE);
+      std::iota(all.begin(), all.end(), 0);
+      nodes.push_back({0, allowedOnly(all)});
+   }
+#endif
+   return nodes;
+}
+
+// Pin the calling thread to the given CPUs for the lifetime of the object, then restore its previous affinity.
+// Does nothing if cpus is empty or the platform does not support it.
+class ThreadPinGuard {
+#ifdef __linux__
+   cpu_set_t fPrevious;
+   bool fPinned = false;
+#endif
+
+public:
+   explicit ThreadPinGuard(const std::vector<int> &cpus)
+   {
+#ifdef __linux__
+      if (cpus.empty())
+         return;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (const auto cpu : cpus)
+         if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+      fPinned = pthread_getaffinity_np(pthread_self(), sizeof(fPrevious), &fPrevious) == 0 &&
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+      (void)cpus;
+#endif
+   }
+   ThreadPinGuard(const ThreadPinGuard &) = delete;
+   ThreadPinGuard &operator=(const ThreadPinGuard &) = delete;
+   ~ThreadPinGuard()
+   {
+#ifdef __linux__
+      if (fPinned)
+         pthread_setaffinity_np(pthread_self(), sizeof(fPrevious), &fPrevious);
+#endif
+   }
+};
+
+// Where the workers of a multi-thread run are pinned.
+struct WorkerPlacement {
+   /// CPUs each worker is pinned to, empty if it is not pinned.
+   std::vector<std::vector<int>> fCpus;
+   /// Index in fNodes of the NUMA node each worker belongs to, 0 for all workers if they are not placed per node.
+   std::vector<unsigned int> fNodeIdx;
+   /// NUMA nodes workers are placed on, empty if they are not placed per node.
+   std::vector<int> fNodes;
+};
+
+WorkerPlacement PlaceWorkers(EPin pin, unsigned int nWorkers)
+{
+   WorkerPlacement placement{std::vector<std::vector<int>>(nWorkers), std::vector<unsigned int>(nWorkers, 0u), {}};
+   if (pin == EPin::kNone)
+      return placement;
+
+   const auto nodes = GetNumaNodes();
+   if (nodes.empty()) {
+      std::cerr << "Pinning threads is not supported on this platform, threads will not be pinned.\n";
+      return placement;
+   }
+
+   if (pin == EPin::kCores) {
+      std::vector<int> cpus;
+      for (const auto &node : nodes)
+         cpus.insert(cpus.end(), node.fCpus.begin(), node.fCpus.end());
+      if (nWorkers > cpus.size())
+         std::cerr << "Pinning " << nWorkers << " threads to " << cpus.size() << " CPUs, some will share a CPU.\n";
+      for (auto workerIdx = 0u; workerIdx < nWorkers; ++workerIdx)
+         placement.fCpus[workerIdx] = {cpus[workerIdx % cpus.size()]};
+      return placement;
+   }
+
+   // consecutive workers go to the same node, and nodes get the same number of workers (give or take one)
+   const auto nNodes = std::min<std::size_t>(nodes.size(), nWorkers);
+   for (auto nodeIdx = 0u; nodeIdx < nNodes; ++nodeIdx)
+      placement.fNodes.push_back(nodes[nodeIdx].fId);
+   for (auto workerIdx = 0u; workerIdx < nWorkers; ++workerIdx) {
+      const auto nodeIdx = workerIdx * nNodes / nWorkers;
+      placement.fNodeIdx[workerIdx] = nodeIdx;
+      placement.fCpus[workerIdx] = nodes[nodeIdx].fCpus;
+   }
+   return placement;
+}
+
+// Assign each file to one of the nodes of placement, largest first, to the node with the lowest resulting cost per
+// worker. fileCosts has the cost of reading each file.
+std::vector<unsigned int> AssignFilesToNodes(const std::vector<double> &fileCosts, const WorkerPlacement &placement)
+{
+   std::vector<unsigned int> nodeWorkers(placement.fNodes.size(), 0u);
+   for (const auto nodeIdx : placement.fNodeIdx)
+      ++nodeWorkers[nodeIdx];
+
+   std::vector<std::size_t> order(fileCosts.size());
+   std::iota(order.begin(), order.end(), 0u);
+   std::stable_sort(order.begin(), order.end(),
+                    [&fileCosts](std::size_t a, std::size_t b) { return fileCosts[a] > fileCosts[b]; });
+
+   std::vector<double> nodeCosts(nodeWorkers.size(), 0.);
+   std::vector<unsigned int> fileNodes(fileCosts.size(), 0u);
+   for (const auto fileIdx : order) {
+      auto best = 0u;
+      for (auto nodeIdx = 1u; nodeIdx < nodeCosts.size(); ++nodeIdx)
+         if ((nodeCosts[nodeIdx] + fileCosts[fileIdx]) / nodeWorkers[nodeIdx] <
+             (nodeCosts[best] + fileCosts[fileIdx]) / nodeWorkers[best])
+            best = nodeIdx;
+      fileNodes[fileIdx] = best;
+      nodeCosts[best] += fileCosts[fileIdx];
+   }
+   return fileNodes;
+}
+
+// The compressed baskets of the selected branches for one task of a pipelined run, in file order.
+struct FetchedTask {
+   std::vector<char> fData;
+   /// Size of each basket in fData.
+   std::vector<Int_t> fSizes;
+};
+
+// The queue of fetched tasks between the I/O threads and the workers of a pipelined run, holding at most capacity
+// tasks. Push blocks while the queue is full and Pop while it is empty; both add the time they waited to waitTime.
+class FetchQueue {
+   using Clock = std::chrono::steady_clock;
+
+   std::mutex fMutex;
+   std::condition_variable fNotFull;
+   std::condition_variable fNotEmpty;
+   std::deque<FetchedTask> fTasks;
+   const std::size_t fCapacity;
+   /// Number of producers that did not call Close yet.
+   std::size_t fProducers;
+   bool fAborted = false;
+   /// Buffers of tasks that were already decompressed, to be reused by the I/O threads.
+   std::vector<std::vector<char>> fFreeBuffers;
+   /// Integral of the number of queued tasks over time, to compute its average.
+   double fQueuedIntegral = 0.;
+   std::size_t fMaxQueued = 0;
+   Clock::time_point fLastChange = Clock::now();
+
+   // Must be called with fMutex locked, before the number of queued tasks changes.
+   void Account()
+   {
+      const auto now = Clock::now();
+      fQueuedIntegral += fTasks.size() * std::chrono::duration<double>(now - fLastChange).count();
+      fLastChange = now;
+   }
+
+   static void AddWait(Clock::time_point start, double &waitTime)
+   {
+      waitTime += std::chrono::duration<double>(Clock::now() - start).count();
+   }
+
+public:
+   FetchQueue(std::size_t capacity, std::size_t nProducers) : fCapacity(capacity), fProducers(nProducers) {}
+
+   // Return false, without queueing the task, if the run was aborted.
+   bool Push(FetchedTask &&task, double &waitTime)
+   {
+      std::unique_lock<std::mutex> lock(fMutex);
+      if (fTasks.size() >= fCapacity && !fAborted) {
+         const auto start = Clock::now();
+         fNotFull.wait(lock, [this] { return fTasks.size() < fCapacity || fAborted; });
+         AddWait(start, waitTime);
+      }
+      if (fAborted)
+         return false;
+      Account();
+      fTasks.emplace_back(std::move(task));
+      fMaxQueued = std::max(fMaxQueued, fTasks.size());
+      fNotEmpty.notify_one();
+      return true;
+   }
+
+   // Return false once all producers are done and the queue is empty, or if the run was aborted.
+   bool Pop(FetchedTask &task, double &waitTime)
+   {
+      std::unique_lock<std::mutex> lock(fMutex);
+      if (fTasks.empty() && fProducers > 0 && !fAborted) {
+         const auto start = Clock::now();
+         fNotEmpty.wait(lock, [this] { return !fTasks.empty() || fProducers == 0 || fAborted; });
+         AddWait(start, waitTime);
+      }
+      if (fAborted || fTasks.empty())
+         return false;
+      Account();
+      task = std::move(fTasks.front());
+      fTasks.pop_front();
+      fNotFull.notify_one();
+      return true;
+   }
+
+   // Called by each producer when it has no more tasks to push.
+   void Close()
+   {
+      std::lock_guard<std::mutex> lock(fMutex);
+      --fProducers;
+      fNotEmpty.notify_all();
+   }
+
+   // Stop producers and consumers early, e.g. because one of them failed.
+   void Abort()
+   {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fAborted = true;
+      fNotFull.notify_all();
+      fNotEmpty.notify_all();
+   }
+
+   std::vector<char> TakeBuffer()
+   {
+      std::lock_guard<std::mutex> lock(fMutex);
+      if (fFreeBuffers.empty())
+         return {};
+      auto buffer = std::move(fFreeBuffers.back());
+      fFreeBuffers.pop_back();
+      return buffer;
+   }
+
+   void ReturnBuffer(std::vector<char> &&buffer)
+   {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fFreeBuffers.emplace_back(std::move(buffer));
+   }
+
+   // Average number of queued tasks over duration seconds since construction.
+   double MeanQueued(double duration)
+   {
+      std::lock_guard<std::mutex> lock(fMutex);
+      Account();
+      return duration > 0. ? fQueuedIntegral / duration : 0.;
+   }
+
+   std::size_t MaxQueued()
+   {
+      std::lock_guard<std::mutex> lock(fMutex);
+      return fMaxQueued;
+   }
+};
+
+// Read the tasks of w in a pipeline: opts.fIOThreads threads fetch the compressed baskets of the selected branches of
+// each task, in order, into a queue of at most opts.fPipelineDepth tasks, from which the workers of pool decompress
+// them. Entries are not deserialized: uncompressed bytes are the sizes of the decompressed baskets.
+Result EvalThroughputPipelinedImpl(const Data &d, const DatasetLayout &layout, const Workload &w,
+                                   ROOT::TThreadExecutor &pool, const Options &opts)
+{
+   const auto actualThreads = ROOT::GetThreadPoolSize();
+   const auto nIOThreads = std::max(opts.fIOThreads, 1u);
+
+   struct Task {
+      unsigned int fFileIdx;
+      EntryRange fRange;
+   };
+   std::vector<Task> tasks;
+   for (auto fileIdx = 0u; fileIdx < w.fTasks.size(); ++fileIdx)
+      for (const auto &range : w.fTasks[fileIdx])
+         tasks.push_back({fileIdx, range});
+   std::cout << "Total number of tasks: " << tasks.size() << '\n';
+
+   FetchQueue queue(std::max(opts.fPipelineDepth, 1u), nIOThreads);
+   std::atomic<std::size_t> nextTask{0};
+   std::vector<ByteData> ioByteData(nIOThreads);
+   std::vector<double> ioWaitTimes(nIOThreads, 0.);
+   std::vector<ByteData> workerByteData(actualThreads);
+   std::vector<double> workerWaitTimes(actualThreads, 0.);
+   std::mutex errorMutex;
+   std::exception_ptr error;
+   auto fail = [&] {
+      {
+         std::lock_guard<std::mutex> lock(errorMutex);
+         if (!error)
+            error = std::current_exception();
+      }
+      queue.Abort();
+   };
+   const bool reportProgress = opts.fSampleInterval > 0.;
+
+   auto fetch = [&](unsigned int ioIdx) {
+      auto &byteData = ioByteData[ioIdx];
+      std::unique_ptr<TFile> f;
+      std::vector<TBranch *> allBranches;
+      auto openFileIdx = std::numeric_limits<unsigned int>::max();
+      std::vector<BasketLocation> baskets;
+      std::vector<Long64_t> seeks;
+      for (auto taskIdx = nextTask++; taskIdx < tasks.size(); taskIdx = nextTask++) {
+         const auto &task = tasks[taskIdx];
+         if (task.fFileIdx != openFileIdx) {
+            ThreadStopwatch setupSw;
+            setupSw.Start();
+            f.reset(OpenForReading(d.fFileNames[task.fFileIdx]));
+            auto *t = GetTree(*f, GetTreeName(d, task.fFileIdx)); // TFile owns this TTree
+            allBranches.clear();
+            for (auto *b : GetBranches(*t, layout.fBranchNames[task.fFileIdx]))
+               CollectBranchesRecursively(b, allBranches);
+            openFileIdx = task.fFileIdx;
+            ++byteData.fFileOpens;
+            setupSw.Stop();
+            byteData.fTaskSetupRealTime += setupSw.RealTime();
+            byteData.fTaskSetupCpuTime += setupSw.CpuTime();
+         }
+
+         baskets.clear();
+         for (auto *b : allBranches) {
+            const auto branchBaskets = GetBasketsInRange(*b, task.fRange);
+            baskets.insert(baskets.end(), branchBaskets.begin(), branchBaskets.end());
+         }
+         // reading in file order lets the file merge adjacent baskets into fewer, larger reads
+         std::sort(baskets.begin(), baskets.end(),
+                   [](const BasketLocation &a, const BasketLocation &b) { return a.fSeek < b.fSeek; });
+
+         FetchedTask fetched;
+         fetched.fData = queue.TakeBuffer();
+         seeks.clear();
+         std::size_t totalSize = 0;
+         for (const auto &basket : baskets) {
+            seeks.push_back(basket.fSeek);
+            fetched.fSizes.push_back(basket.fBytes);
+            totalSize += basket.fBytes;
+         }
+         fetched.fData.resize(totalSize);
+
+         ThreadStopwatch sw;
+         const ULong64_t fileStartBytes = f->GetBytesRead();
+         sw.Start();
+         if (!seeks.empty() &&
+             f->ReadBuffers(fetched.fData.data(), seeks.data(), fetched.fSizes.data(), seeks.size()))
+            throw std::runtime_error(std::string("Could not read baskets from file '") + f->GetName() + '\'');
+         sw.Stop();
+         const ULong64_t fileBytes = f->GetBytesRead() - fileStartBytes;
+         byteData.fCompressedBytesRead += fileBytes;
+         byteData.fPhaseTimes.fIORealTime += sw.RealTime();
+         byteData.fPhaseTimes.fIOCpuTime += sw.CpuTime();
+         if (reportProgress)
+            AddRelaxed(GetThreadProgressCounters().fCompressedBytesRead, fileBytes);
+
+         if (!queue.Push(std::move(fetched), ioWaitTimes[ioIdx]))
+            break;
+      }
+   };
+
+   // Workers are identified by thread, as in the work-stealing scheduler of EvalThroughputMTImpl: TBB may run several
+   // indices of Foreach one after the other on the same thread, which would otherwise decompress under several
+   // identities. The first index a thread runs claims the next worker slot, later indices on the same thread (which
+   // it only gets to once the queue is closed) and threads that find all slots taken return at once.
+   std::mutex slotsMutex;
+   std::unordered_map<std::thread::id, unsigned int> threadSlots;
+   auto decompress = [&](unsigned int) {
+      unsigned int workerIdx = 0;
+      {
+         std::lock_guard<std::mutex> lock(slotsMutex);
+         if (threadSlots.size() >= actualThreads)
+            return;
+         const auto slot = threadSlots.emplace(std::this_thread::get_id(), threadSlots.size());
+         if (!slot.second)
+            return;
+         workerIdx = slot.first->second;
+      }
+      try {
+         auto &byteData = workerByteData[workerIdx];
+         std::vector<unsigned char> unzipped;
+         FetchedTask task;
+         while (queue.Pop(task, workerWaitTimes[workerIdx])) {
+            // the I/O threads report the compressed bytes
+            ProgressReporter progress(opts);
+            ULong64_t taskBytes = 0;
+            ThreadStopwatch sw;
+            sw.Start();
+            char *rawBasket = task.fData.data();
+            for (const auto size : task.fSizes) {
+               taskBytes += UnzipBasket(rawBasket, size, unzipped);
+               rawBasket += size;
+            }
+            sw.Stop();
+            byteData.fUncompressedBytesRead += taskBytes;
+            byteData.fPhaseTimes.fUnzipRealTime += sw.RealTime();
+            byteData.fPhaseTimes.fUnzipCpuTime += sw.CpuTime();
+            ++byteData.fNTasks;
+            progress.Update(taskBytes);
+            task.fData.clear();
+            queue.ReturnBuffer(std::move(task.fData));
+         }
+      } catch (...) {
+         fail();
+      }
+   };
+
+   ProgressSampler sampler(opts.fSampleInterval);
+   TStopwatch sw;
+   sw.Start();
+   const auto start = std::chrono::steady_clock::now();
+   std::vector<std::thread> ioThreads;
+   for (auto ioIdx = 0u; ioIdx < nIOThreads; ++ioIdx)
+      ioThreads.emplace_back([&, ioIdx] {
+         try {
+            fetch(ioIdx);
+         } catch (...) {
+            fail();
+         }
+         queue.Close();
+      });
+   pool.Foreach(decompress, ROOT::TSeqU(actualThreads));
+   for (auto &t : ioThreads)
+      t.join();
+   sw.Stop();
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   auto timeSeries = sampler.Stop();
+   if (error)
+      std::rethrow_exception(error);
+
+   ByteData total;
+   for (const auto &b : ioByteData)
+      total += b;
+   for (const auto &b : workerByteData)
+      total += b;
+
+   Result result{};
+   result.fRealTime = sw.RealTime();
+   result.fCpuTime = sw.CpuTime();
+   result.fMTSetupRealTime = layout.fSetupRealTime + w.fSetupRealTime;
+   result.fMTSetupCpuTime = layout.fSetupCpuTime + w.fSetupCpuTime;
+   result.fUncompressedBytesRead = total.fUncompressedBytesRead;
+   result.fCompressedBytesRead = total.fCompressedBytesRead;
+   result.fThreadPoolSize = actualThreads;
+   result.fPhaseTimes = total.fPhaseTimes;
+   result.fFileOpens = total.fFileOpens;
+   result.fNTasks = total.fNTasks;
+   result.fTaskSetupRealTime = total.fTaskSetupRealTime;
+   result.fTaskSetupCpuTime = total.fTaskSetupCpuTime;
+   result.fTimeSeries = std::move(timeSeries);
+   auto &stats = result.fPipeline;
+   stats.fDepth = std::max(opts.fPipelineDepth, 1u);
+   stats.fNIOThreads = nIOThreads;
+   stats.fNWorkers = threadSlots.size();
+   stats.fIOWaitTime = std::accumulate(ioWaitTimes.begin(), ioWaitTimes.end(), 0.);
+   stats.fWorkerWaitTime = std::accumulate(workerWaitTimes.begin(), workerWaitTimes.end(), 0.);
+   stats.fMeanQueued = queue.MeanQueued(elapsed.count());
+   stats.fMaxQueued = queue.MaxQueued();
+   return result;
+}
+
+// Create a thread pool of size nThreads, warning if ROOT decided for a different size.
+std::unique_ptr<ROOT::TThreadExecutor> MakeThreadPool(unsigned nThreads)
+{
+   auto pool = std::make_unique<ROOT::TThreadExecutor>(nThreads);
+   const auto actualThreads = ROOT::GetThreadPoolSize();
+   if (actualThreads != nThreads)
+      std::cerr << "Running with " << actualThreads << " threads even though " << nThreads << " were requested.\n";
+   return pool;
+}
+
+// Read the tasks of w with the threads of pool. If newRun is false, the tasks are a batch of the same run as the
+// previous call and reuse the files it left open.
+Result EvalThroughputMTImpl(const Data &d, const DatasetLayout &layout, const Workload &w, ROOT::TThreadExecutor &pool,
+                            const Options &opts, bool newRun = true)
+{
+   // pipelined runs read files on their own I/O threads, neither TTreeCache nor the files of earlier runs are used
+   if (opts.fPipelineDepth > 0)
+      return EvalThroughputPipelinedImpl(d, layout, w, pool, opts);
+
+   const auto actualThreads = ROOT::GetThreadPoolSize();
+   const auto &rangesPerFile = w.fTasks;
+   Projection projection = w.fSelection;
+
+   size_t nranges =
+      std::accumulate(rangesPerFile.begin(), rangesPerFile.end(), 0u, [](size_t s, auto &r) { return s + r.size(); });
+   std::cout << "Total number of tasks: " << nranges << '\n';
+
+   // tasks write their statistics to their own slot, no synchronization needed
+   std::vector<size_t> firstTaskInFile(rangesPerFile.size());
+   for (auto fileIdx = 1u; fileIdx < rangesPerFile.size(); ++fileIdx)
+      firstTaskInFile[fileIdx] = firstTaskInFile[fileIdx - 1] + rangesPerFile[fileIdx - 1].size();
+   std::vector<TaskStats> taskStats(nranges);
+   std::vector<std::thread::id> taskThreads(nranges);
+
+   const auto &fileBranchNames = layout.fBranchNames;
+
+   auto sumBytes = [](const std::vector<ByteData> &bytesData) -> ByteData {
+      ByteData sum;
+      for (const auto &o : bytesData)
+         sum += o;
+      return sum;
+   };
+
+   auto readRange = [&](std::size_t fileIdx, std::size_t rangeIdx) -> ByteData {
+      const auto &range = rangesPerFile[fileIdx][rangeIdx];
+      ThreadStopwatch sw;
+      sw.Start();
+      auto byteData = ReadTask(d, fileIdx, fileBranchNames[fileIdx], range, opts);
+      sw.Stop();
+
+      const auto taskIdx = firstTaskInFile[fileIdx] + rangeIdx;
+      taskStats[taskIdx] = {static_cast<unsigned int>(fileIdx),
+                            range,
+                            0u, // thread indices are assigned at the end of the run
+                            sw.RealTime(),
+                            sw.CpuTime(),
+                            byteData.fTaskSetupRealTime,
+                            byteData.fUncompressedBytesRead,
+                            byteData.fCompressedBytesRead};
+      taskThreads[taskIdx] = std::this_thread::get_id();
+      return byteData;
+   };
+
+   const CacheSettingsGuard cacheSettings(opts);
+   if (newRun)
+      ++gRunNumber;
+   TStopwatch sw;
+   ByteData totalByteData{};
+   std::vector<ProgressSample> timeSeries;
+   std::vector<NumaNodeStats> numaStats;
+   if (opts.fScheduler == EScheduler::kWorkStealing || opts.fPin != EPin::kNone) {
+      std::vector<unsigned int> taskFiles(nranges);
+      for (auto fileIdx = 0u; fileIdx < rangesPerFile.size(); ++fileIdx)
+         std::fill_n(taskFiles.begin() + firstTaskInFile[fileIdx], rangesPerFile[fileIdx].size(), fileIdx);
+
+      // with NUMA pinning, the files are split among nodes and the workers of a node only run tasks of its files
+      const auto placement = PlaceWorkers(opts.fPin, actualThreads);
+      const auto nNodes = std::max<std::size_t>(placement.fNodes.size(), 1u);
+      std::vector<unsigned int> fileNodes(rangesPerFile.size(), 0u);
+      if (nNodes > 1) {
+         std::vector<double> fileCosts;
+         for (const auto &costs : GetClusterCosts(rangesPerFile, layout))
+            fileCosts.push_back(std::accumulate(costs.begin(), costs.end(), 0.));
+         fileNodes = AssignFilesToNodes(fileCosts, placement);
+      }
+      std::vector<std::vector<std::size_t>> nodeTasks(nNodes);
+      for (auto taskIdx = 0u; taskIdx < nranges; ++taskIdx)
+         nodeTasks[fileNodes[taskFiles[taskIdx]]].push_back(taskIdx);
+
+      ProgressSampler sampler(opts.fSampleInterval);
+      sw.Start();
+      const auto start = std::chrono::steady_clock::now();
+      WorkStealingQueues queues(placement.fNodeIdx, nodeTasks, taskFiles);
+      std::vector<ByteData> workerByteData(actualThreads, ByteData{});
+      std::vector<double> workerEndTimes(actualThreads, 0.);
+      // TBB does not guarantee that each index of Foreach runs on a thread of its own: a thread might run several
+      // indices one after the other, or a single thread all of them. Workers are therefore identified by thread: the
+      // first index a thread runs claims the next worker slot (queue, CPU and statistics), and later indices on the
+      // same thread return at once, since it only got to them after running out of tasks. Threads that find all
+      // slots taken (e.g. the caller of Foreach joining the TBB workers) return at once as well.
+      std::mutex slotsMutex;
+      std::unordered_map<std::thread::id, unsigned int> threadSlots;
+      auto worker = [&](unsigned int) {
+         unsigned int workerIdx = 0;
+         {
+            std::lock_guard<std::mutex> lock(slotsMutex);
+            if (threadSlots.size() >= actualThreads)
+               return;
+            const auto slot = threadSlots.emplace(std::this_thread::get_id(), threadSlots.size());
+            if (!slot.second)
+               return;
+            workerIdx = slot.first->second;
+         }
+         queues.Claim(workerIdx);
+         const ThreadPinGuard pin(placement.fCpus[workerIdx]);
+         std::size_t taskIdx = 0;
+         auto lastFile = std::numeric_limits<std::size_t>::max();
+         while (queues.Pop(workerIdx, lastFile, taskIdx)) {
+            lastFile = taskFiles[taskIdx];
+            workerByteData[workerIdx] += readRange(lastFile, taskIdx - firstTaskInFile[lastFile]);
+         }
+         workerEndTimes[workerIdx] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      };
+      pool.Foreach(worker, ROOT::TSeqU(actualThreads));
+      totalByteData = sumBytes(workerByteData);
+      sw.Stop();
+      timeSeries = sampler.Stop();
+
+      if (!placement.fNodes.empty()) {
+         numaStats.resize(placement.fNodes.size());
+         for (auto nodeIdx = 0u; nodeIdx < numaStats.size(); ++nodeIdx)
+            numaStats[nodeIdx].fNode = placement.fNodes[nodeIdx];
+         for (const auto nodeIdx : fileNodes)
+            ++numaStats[nodeIdx].fNFiles;
+         // only the slots claimed by a thread ran tasks
+         for (auto workerIdx = 0u; workerIdx < threadSlots.size(); ++workerIdx) {
+            auto &node = numaStats[placement.fNodeIdx[workerIdx]];
+            const auto &bytes = workerByteData[workerIdx];
+            ++node.fNThreads;
+            node.fNTasks += bytes.fNTasks;
+            node.fRealTime = std::max(node.fRealTime, workerEndTimes[workerIdx]);
+            node.fUncompressedBytesRead += bytes.fUncompressedBytesRead;
+            node.fCompressedBytesRead += bytes.fCompressedBytesRead;
+         }
+      }
+   } else {
+      // for each file, for each range, spawn a reading task
+      auto processFile = [&](std::size_t fileIdx) {
+         auto readRangeInFile = [&](std::size_t rangeIdx) { return readRange(fileIdx, rangeIdx); };
+         return pool.MapReduce(readRangeInFile, ROOT::TSeqUL{rangesPerFile[fileIdx].size()}, sumBytes);
+      };
+
+      ProgressSampler sampler(opts.fSampleInterval);
+      sw.Start();
+      totalByteData = pool.MapReduce(processFile, ROOT::TSeqUL{d.fFileNames.size()}, sumBytes);
+      sw.Stop();
+      timeSeries = sampler.Stop();
+   }
+
+   // number worker threads in order of appearance in the task list
+   std::unordered_map<std::thread::id, unsigned int> threadIndices;
+   std::vector<ThreadStats> threadStats;
+   for (auto taskIdx = 0u; taskIdx < nranges; ++taskIdx) {
+      const auto it = threadIndices.emplace(taskThreads[taskIdx], threadIndices.size()).first;
+      if (it->second == threadStats.size())
+         threadStats.emplace_back();
+      auto &task = taskStats[taskIdx];
+      task.fThreadIdx = it->second;
+      threadStats[task.fThreadIdx].fNTasks += 1;
+      threadStats[task.fThreadIdx].fBusyRealTime += task.fRealTime;
+   }
+   // sampled once the run is over, since it walks the baskets of all branches read: the workers are idle, and their
+   // files still hold the baskets and caches of their last task
+   for (const auto &thread : threadIndices) {
+      auto &stats = threadStats[thread.second];
+      stats.fBasketBytes = GetFormatReader(d.fFormat).GetThreadMemory(thread.first);
+      totalByteData.fBasketBytes = std::max(totalByteData.fBasketBytes, stats.fBasketBytes);
+   }
+
+   if (w.fSampled)
+      projection = ProjectFromSample(taskStats, sw.RealTime(), projection.fTotalEntries, projection.fTotalClusters);
+
+   Result result{};
+   result.fRealTime = sw.RealTime();
+   result.fCpuTime = sw.CpuTime();
+   result.fMTSetupRealTime = layout.fSetupRealTime + w.fSetupRealTime;
+   result.fMTSetupCpuTime = layout.fSetupCpuTime + w.fSetupCpuTime;
+   result.fUncompressedBytesRead = totalByteData.fUncompressedBytesRead;
+   result.fCompressedBytesRead = totalByteData.fCompressedBytesRead;
+   result.fThreadPoolSize = actualThreads;
+   result.fPhaseTimes = totalByteData.fPhaseTimes;
+   result.fFileOpens = totalByteData.fFileOpens;
+   result.fFileReopens = totalByteData.fFileReopens;
+   result.fNTasks = totalByteData.fNTasks;
+   result.fTaskSetupRealTime = totalByteData.fTaskSetupRealTime;
+   result.fTaskSetupCpuTime = totalByteData.fTaskSetupCpuTime;
+   result.fBranchStats = std::move(totalByteData.fBranchStats);
+   result.fCacheStats = totalByteData.fCacheStats;
+   result.fTaskStats = std::move(taskStats);
+   result.fThreadStats = std::move(threadStats);
+   result.fProjection = projection;
+   result.fTimeSeries = std::move(timeSeries);
+   result.fNumaStats = std::move(numaStats);
+   result.fMemory = MakeMemoryStats(totalByteData);
+   result.fPerfCounters = totalByteData.fPerfCounters;
+   return result;
+}
+} // anonymous namespace
+
+Result ReadSpeed::EvalThroughputMT(const Data &d, unsigned nThreads, const Options &opts)
+{
+   auto pool = MakeThreadPool(nThreads);
+   const auto layout = GetDatasetLayout(d, pool.get(), opts.fIndexFile);
+   return EvalThroughputMTImpl(d, layout, MakeWorkload(layout, ROOT::GetThreadPoolSize(), opts), *pool, opts);
+}
+
+Result ReadSpeed::EvalThroughputMT(const Data &d, const DatasetLayout &layout, unsigned nThreads, const Options &opts)
+{
+   auto pool = MakeThreadPool(nThreads);
+   return EvalThroughputMTImpl(d, layout, MakeWorkload(layout, ROOT::GetThreadPoolSize(), opts), *pool, opts);
+}
+
+Result ReadSpeed::EvalThroughputMT(const Data &d, const DatasetLayout &layout,
+                                   const std::vector<std::vector<EntryRange>> &tasks, ROOT::TThreadExecutor &pool,
+                                   const Options &opts)
+{
+   if (tasks.size() != d.fFileNames.size())
+      throw std::runtime_error("The list of tasks must have one element per file");
+   // consecutive lists of tasks are batches of the same run: they keep reusing the files opened by earlier batches
+   Workload w;
+   w.fTasks = tasks;
+   return EvalThroughputMTImpl(d, layout, w, pool, opts, /*newRun=*/false);
+}
+
+namespace {
+void TreeFormatReader::Validate(const Data &d, const Options &opts) const
+{
+   // these modes read baskets from the file of the main tree, or outside of ReadTree
+   if (!d.fFriends.empty() && (opts.fRawIO || opts.fSplitPhases || opts.fUnzipOnly || !opts.fTryCompression.empty() ||
+                               opts.fPipelineDepth > 0))
+      throw std::runtime_error("Friend trees cannot be used together with raw I/O, split phases, decompression-only "
+                               "or pipelined runs, or recompression");
+   // on every cache hit, an asynchronously prefetching TTreeCache refills itself, dropping the baskets of the batch
+   if (opts.fSplitPhases && opts.fAsyncPrefetch)
+      throw std::runtime_error("Asynchronous prefetching cannot be used together with split phases");
+}
+
+// The RNTuple reader only reads entry by entry, field by field or whole entries at a time: the options that tune or
+// bypass TTree's reading machinery do not apply.
+void RNTupleFormatReader::Validate(const Data &d, const Options &opts) const
+{
+   if (!HasRNTupleSupport())
+      throw std::runtime_error("This build of root-readspeed cannot read RNTuples: it requires ROOT v6.32 or later, "
+                               "built with RNTuple support");
+   if (!d.fFriends.empty())
+      throw std::runtime_error("Friend trees cannot be used when reading RNTuples");
+   auto check = [](bool isSet, const std::string &what) {
+      if (isSet)
+         throw std::runtime_error(what + " cannot be used when reading RNTuples");
+   };
+   check(opts.fSplitPhases, "Splitting reads in phases");
+   check(opts.fBulkRead, "Bulk reads");
+   check(opts.fRawIO, "Raw I/O reads");
+   check(opts.fUnzipOnly, "Decompression-only runs");
+   check(!opts.fTryCompression.empty(), "Recompression");
+   check(opts.fCacheSize >= 0 || opts.fCacheLearnEntries > 0 || opts.fCacheAddBranches || opts.fAsyncPrefetch,
+         "Tuning TTreeCache");
+   check(opts.fPipelineDepth > 0, "The pipelined read mode");
+}
+
+} // anonymous namespace
+
+void ReadSpeed::ValidateOptions(const Data &d, const Options &opts)
+{
+   GetFormatReader(d.fFormat).Validate(d, opts);
+}
+
+void ReadSpeed::ValidateData(const Data &d, const Options &opts)
+{
+   if (d.fTreeNames.empty())
+      throw std::runtime_error("Please provide at least one tree name");
+   if (d.fFileNames.empty())
+      throw std::runtime_error("Please provide at least one file name");
+   if (d.fBranchNames.empty())
       throw std::runtime_error("Please provide at least one branch name");
    if (d.fTreeNames.size() != 1 && d.fTreeNames.size() != d.fFileNames.size())
       throw std::runtime_error("Please provide either one tree name or as many as the file names");
+   for (const auto &fr : d.fFriends)
+      if (!fr.fFileNames.empty() && fr.fFileNames.size() != d.fFileNames.size())
+         throw std::runtime_error("Please provide either no file name or as many as the file names for friend tree '" +
+                                  fr.fTreeName + '\'');
+   ValidateOptions(d, opts);
+}
+
+namespace {
+// Ask the operating system to evict the files from its page cache, so that the next read has to go to storage.
+// Only local files can be dropped: remote files, or files on platforms without posix_fadvise, are left alone.
+void DropFileCaches(const std::vector<std::string> &fileNames)
+{
+#ifdef POSIX_FADV_DONTNEED
+   for (const auto &fName : fileNames) {
+      std::string path = fName;
+      if (path.compare(0, 7, "file://") == 0)
+         path = path.substr(7);
+      else if (path.find("://") != std::string::npos)
+         continue;
+      const int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+         std::cerr << "Could not drop file '" << fName << "' from the page cache.\n";
+      if (fd >= 0)
+         close(fd);
+   }
+#else
+   (void)fileNames;
+   std::cerr << "Dropping files from the page cache is not supported on this platform.\n";
+#endif
+}
+
+// A compressed basket loaded in memory by LoadBaskets.
+struct LoadedBasket {
+   /// Offset of the basket in LoadedFile::fData.
+   std::size_t fOffset;
+   Int_t fBytes;
+   /// Index of the top-level selected branch the basket belongs to, in LoadedFile::fBranches.
+   std::size_t fBranchIdx;
+};
+
+struct LoadedFile {
+   std::vector<char> fData;
+   std::vector<LoadedBasket> fBaskets;
+   /// Name and compression settings of each selected branch.
+   std::vector<std::pair<std::string, int>> fBranches;
+};
+
+// Load the compressed baskets (as they are stored on disk, TKey header included) of the selected branches of all
+// files in memory, up to memoryLimit bytes in total. limitReached is set if some baskets did not fit.
+// The limit is spread over all branches of all files, one basket of each at a time, so that every branch is
+// represented in the sample even if the limit is much smaller than the data.
+std::vector<LoadedFile> LoadBaskets(const Data &d, ULong64_t memoryLimit, bool &limitReached)
+{
+   std::unique_ptr<BranchMatcher> matcher;
+   if (d.fUseRegex)
+      matcher = std::make_unique<BranchMatcher>(d.fBranchNames);
+
+   // the baskets of one selected branch of one file, sub-branches included, in file order
+   struct BranchBaskets {
+      std::size_t fFileIdx;
+      /// Index of the branch in LoadedFile::fBranches.
+      std::size_t fBranchIdx;
+      std::vector<BasketLocation> fBaskets;
+      /// Number of baskets, from the first, that fit in the sample.
+      std::size_t fNSelected = 0;
+   };
+   std::vector<BranchBaskets> branchBaskets;
+   std::vector<LoadedFile> files(d.fFileNames.size());
+   for (auto fileIdx = 0u; fileIdx < d.fFileNames.size(); ++fileIdx) {
+      std::unique_ptr<TFile> f(OpenForReading(d.fFileNames[fileIdx]));
+      std::unique_ptr<TTree> t(GetTree(*f, GetTreeName(d, fileIdx)));
+      const auto branchNames = d.fUseRegex ? matcher->GetMatchingBranchNames(*t) : d.fBranchNames;
+      const auto branches = GetBranches(*t, branchNames);
+
+      for (auto branchIdx = 0u; branchIdx < branches.size(); ++branchIdx) {
+         auto *b = branches[branchIdx];
+         std::vector<TBranch *> allBranches;
+         CollectBranchesRecursively(b, allBranches);
+         BranchBaskets baskets{fileIdx, files[fileIdx].fBranches.size(), {}};
+         for (auto *subBranch : allBranches) {
+            const auto subBranchBaskets = GetBasketsInRange(*subBranch, {0ll, t->GetEntries()});
+            baskets.fBaskets.insert(baskets.fBaskets.end(), subBranchBaskets.begin(), subBranchBaskets.end());
+         }
+         std::sort(baskets.fBaskets.begin(), baskets.fBaskets.end(),
+                   [](const BasketLocation &x, const BasketLocation &y) { return x.fSeek < y.fSeek; });
+         branchBaskets.emplace_back(std::move(baskets));
+         files[fileIdx].fBranches.emplace_back(branchNames[branchIdx], b->GetCompressionSettings());
+      }
+   }
+
+   // round-robin over branches: baskets that do not fit are skipped, smaller baskets of other branches might
+   ULong64_t loadedBytes = 0;
+   for (bool added = true; added;) {
+      added = false;
+      for (auto &bb : branchBaskets) {
+         if (bb.fNSelected == bb.fBaskets.size() || loadedBytes + bb.fBaskets[bb.fNSelected].fBytes > memoryLimit)
+            continue;
+         loadedBytes += bb.fBaskets[bb.fNSelected].fBytes;
+         ++bb.fNSelected;
+         added = true;
+      }
+   }
+
+   limitReached = false;
+   std::vector<std::string> sampledBranches;
+   for (const auto &bb : branchBaskets) {
+      limitReached |= bb.fNSelected < bb.fBaskets.size();
+      auto &file = files[bb.fFileIdx];
+      const auto &bName = file.fBranches[bb.fBranchIdx].first;
+      if (bb.fNSelected > 0 &&
+          std::find(sampledBranches.begin(), sampledBranches.end(), bName) == sampledBranches.end())
+         sampledBranches.push_back(bName);
+      for (auto i = 0u; i < bb.fNSelected; ++i) {
+         file.fBaskets.push_back({file.fData.size(), bb.fBaskets[i].fBytes, bb.fBranchIdx});
+         file.fData.resize(file.fData.size() + bb.fBaskets[i].fBytes);
+      }
+   }
+
+   // the sampled baskets are laid out in fData branch by branch, in the same order as branchBaskets
+   for (auto fileIdx = 0u; fileIdx < files.size(); ++fileIdx) {
+      std::vector<Long64_t> seeks;
+      std::vector<Int_t> sizes;
+      for (const auto &bb : branchBaskets) {
+         if (bb.fFileIdx != fileIdx)
+            continue;
+         for (auto i = 0u; i < bb.fNSelected; ++i) {
+            seeks.push_back(bb.fBaskets[i].fSeek);
+            sizes.push_back(bb.fBaskets[i].fBytes);
+         }
+      }
+      if (seeks.empty())
+         continue;
+      std::unique_ptr<TFile> f(OpenForReading(d.fFileNames[fileIdx]));
+      if (f->ReadBuffers(files[fileIdx].fData.data(), seeks.data(), sizes.data(), seeks.size()))
+         throw std::runtime_error("Could not read baskets from file '" + d.fFileNames[fileIdx] + '\'');
+   }
+
+   if (limitReached) {
+      std::cout << "Memory limit reached: only using " << loadedBytes << " bytes of compressed baskets, spread over "
+                << sampledBranches.size() << " branches:";
+      for (const auto &bName : sampledBranches)
+         std::cout << ' ' << bName;
+      std::cout << '\n';
+   }
+   return files;
+}
+
+// Time the decompression of the baskets in files, spread over the pool if there is one.
+// Per-branch statistics are filled, with decompression times in BranchStats::fRealTime.
+Result TimeUnzip(std::vector<LoadedFile> &files, ROOT::TThreadExecutor *pool)
+{
+   // each task decompresses a contiguous chunk of the baskets of one file
+   struct Chunk {
+      std::size_t fFileIdx;
+      std::size_t fBegin;
+      std::size_t fEnd;
+   };
+   const auto nWorkers = pool != nullptr ? ROOT::GetThreadPoolSize() : 1u;
+   const auto nFiles = static_cast<unsigned int>(files.size());
+   const auto chunksPerFile =
+      std::max(1u, (nWorkers * ROOT::TTreeProcessorMT::GetTasksPerWorkerHint() + nFiles - 1) / nFiles);
+   std::vector<Chunk> chunks;
+   for (auto fileIdx = 0u; fileIdx < files.size(); ++fileIdx) {
+      const auto nBaskets = files[fileIdx].fBaskets.size();
+      const auto chunkSize = std::max<std::size_t>(1u, (nBaskets + chunksPerFile - 1) / chunksPerFile);
+      for (std::size_t begin = 0u; begin < nBaskets; begin += chunkSize)
+         chunks.push_back({fileIdx, begin, std::min(begin + chunkSize, nBaskets)});
+   }
+
+   auto unzipChunk = [&files](const Chunk &c) {
+      using Clock = std::chrono::steady_clock;
+      auto &file = files[c.fFileIdx];
+      std::vector<Clock::duration> branchTimes(file.fBranches.size(), Clock::duration::zero());
+      std::vector<ULong64_t> branchBytes(file.fBranches.size(), 0ull);
+      thread_local std::vector<unsigned char> unzipped;
+      for (auto i = c.fBegin; i < c.fEnd; ++i) {
+         const auto &basket = file.fBaskets[i];
+         const auto start = Clock::now();
+         branchBytes[basket.fBranchIdx] += UnzipBasket(file.fData.data() + basket.fOffset, basket.fBytes, unzipped);
+         branchTimes[basket.fBranchIdx] += Clock::now() - start;
+      }
+      ByteData byteData;
+      for (auto b = 0u; b < file.fBranches.size(); ++b) {
+         if (branchBytes[b] == 0)
+            continue;
+         auto &stats = byteData.fBranchStats[file.fBranches[b].first];
+         stats.fRealTime += std::chrono::duration<double>(branchTimes[b]).count();
+         stats.fUncompressedBytesRead += branchBytes[b];
+         stats.fCompressionSettings = file.fBranches[b].second;
+         byteData.fUncompressedBytesRead += branchBytes[b];
+      }
+      for (auto i = c.fBegin; i < c.fEnd; ++i) {
+         auto &stats = byteData.fBranchStats[file.fBranches[file.fBaskets[i].fBranchIdx].first];
+         stats.fCompressedBytes += file.fBaskets[i].fBytes;
+         ++stats.fNBaskets;
+         byteData.fCompressedBytesRead += file.fBaskets[i].fBytes;
+      }
+      return byteData;
+   };
+   auto sumBytes = [](const std::vector<ByteData> &bytesData) {
+      ByteData sum;
+      for (const auto &b : bytesData)
+         sum += b;
+      return sum;
+   };
+
+   TStopwatch sw;
+   sw.Start();
+   ByteData total;
+   if (pool != nullptr) {
+      total = pool->MapReduce([&](std::size_t chunkIdx) { return unzipChunk(chunks[chunkIdx]); },
+                              ROOT::TSeqUL{chunks.size()}, sumBytes);
+   } else {
+      for (const auto &c : chunks)
+         total += unzipChunk(c);
+   }
+   sw.Stop();
+
+   Result result{};
+   result.fRealTime = sw.RealTime();
+   result.fCpuTime = sw.CpuTime();
+   result.fUncompressedBytesRead = total.fUncompressedBytesRead;
+   result.fCompressedBytesRead = total.fCompressedBytesRead;
+   result.fThreadPoolSize = pool != nullptr ? ROOT::GetThreadPoolSize() : 0u;
+   result.fPhaseTimes.fUnzipRealTime = sw.RealTime();
+   result.fPhaseTimes.fUnzipCpuTime = sw.CpuTime();
+   result.fFileOpens = files.size();
+   result.fNTasks = chunks.size();
+   result.fBranchStats = std::move(total.fBranchStats);
+   return result;
+}
+
+// Load the compressed baskets of the selected branches of all files in memory, up to opts.fMemoryLimit bytes in total,
+// then time their decompression alone, spread over the pool if there is one. No deserialization takes place.
+Result EvalUnzipOnly(const Data &d, ROOT::TThreadExecutor *pool, const Options &opts)
+{
+   TStopwatch loadSw;
+   loadSw.Start();
+   bool limitReached = false;
+   auto files = LoadBaskets(d, opts.fMemoryLimit, limitReached);
+   loadSw.Stop();
+
+   auto result = TimeUnzip(files, pool);
+   result.fPhaseTimes.fIORealTime = loadSw.RealTime();
+   result.fPhaseTimes.fIOCpuTime = loadSw.CpuTime();
+   return result;
+}
+
+// Return a copy of file with each basket recompressed with the given settings (algorithm * 100 + level) the way
+// TBasket compresses baskets: the key header is kept, the payload is compressed in blocks of at most kMaxZipBlock
+// bytes, and it is stored uncompressed if compression does not make it smaller. compressTime is incremented by the
+// time spent compressing. file is not modified: it is only non-const because UnzipBasket takes a non-const buffer.
+LoadedFile Recompress(LoadedFile &file, int settings, std::chrono::steady_clock::duration &compressTime)
+{
+   constexpr int kMaxZipBlock = 0xffffff; // as kMAXZIPBUF in TBasket
+   const auto algorithm = static_cast<ROOT::RCompressionSetting::EAlgorithm::EValues>(settings / 100);
+   const int level = settings % 100;
+
+   LoadedFile out;
+   out.fBranches = file.fBranches;
+   for (auto &b : out.fBranches)
+      b.second = settings;
+
+   std::vector<unsigned char> unzipped;
+   std::vector<char> zipped;
+   for (const auto &basket : file.fBaskets) {
+      char *raw = file.fData.data() + basket.fOffset;
+      const Int_t objLen = UnzipBasket(raw, basket.fBytes, unzipped);
+      Short_t keyLen = 0;
+      char *cursor = raw + 14; // see UnzipBasket for the layout of the TKey header
+      frombuf(cursor, &keyLen);
+      char *payload = objLen <= basket.fBytes - keyLen ? raw + keyLen : reinterpret_cast<char *>(unzipped.data());
+
+      zipped.resize(objLen);
+      Int_t nZipped = 0;
+      const auto start = std::chrono::steady_clock::now();
+      for (Int_t nDone = 0; nDone < objLen;) {
+         int srcSize = std::min(kMaxZipBlock, objLen - nDone);
+         int tgtSize = objLen - nZipped;
+         int nOut = 0;
+         R__zipMultipleAlgorithm(level, &srcSize, payload + nDone, &tgtSize, zipped.data() + nZipped, &nOut,
+                                 algorithm);
+         if (nOut == 0 || nZipped + nOut >= objLen) {
+            nZipped = -1; // does not compress: store as is
+            break;
+         }
+         nDone += srcSize;
+         nZipped += nOut;
+      }
+      compressTime += std::chrono::steady_clock::now() - start;
+
+      const char *newPayload = nZipped < 0 ? payload : zipped.data();
+      const Int_t newPayloadSize = nZipped < 0 ? objLen : nZipped;
+      out.fBaskets.push_back({out.fData.size(), keyLen + newPayloadSize, basket.fBranchIdx});
+      out.fData.insert(out.fData.end(), raw, raw + keyLen);
+      out.fData.insert(out.fData.end(), newPayload, newPayload + newPayloadSize);
+   }
+   return out;
+}
+} // anonymous namespace
+
+namespace {
+// Call runTrial opts.fWarmup times, then opts.fRepeat times (dropping the files from the page cache before each, if
+// requested), and return the trial with median real time, with the statistics of all trials if there are several.
+template <typename F>
+Result RunTrials(const std::vector<std::string> &fileNames, const Options &opts, F &&runTrial)
+{
+   if (opts.fPerfCounters)
+      CheckPerfCounters();
+
+   for (auto i = 0u; i < opts.fWarmup; ++i)
+      runTrial();
+
+   std::vector<Result> trials;
+   for (auto i = 0u; i < std::max(opts.fRepeat, 1u); ++i) {
+      if (opts.fDropCache)
+         DropFileCaches(fileNames);
+      ResetPeakRSS();
+      trials.emplace_back(runTrial());
+      trials.back().fMemory.fPeakRSS = GetPeakRSS();
+   }
+   if (trials.size() == 1)
+      return std::move(trials.front());
+
+   std::vector<TrialStats> trialStats;
+   for (const auto &t : trials)
+      trialStats.push_back({t.fRealTime, t.fCpuTime, t.fUncompressedBytesRead, t.fCompressedBytesRead});
+   // the trial with median real time (the lower of the two for an even number of trials)
+   std::vector<std::size_t> order(trials.size());
+   std::iota(order.begin(), order.end(), 0u);
+   std::sort(order.begin(), order.end(),
+             [&trials](std::size_t a, std::size_t b) { return trials[a].fRealTime < trials[b].fRealTime; });
+   auto result = std::move(trials[order[(order.size() - 1) / 2]]);
+   result.fTrials = std::move(trialStats);
+   return result;
+}
+} // anonymous namespace
+
+Result ReadSpeed::EvalThroughput(const Data &d, unsigned nThreads, const Options &opts)
+{
+   ValidateData(d, opts);
+
+   if (opts.fUnzipOnly) {
+      std::unique_ptr<ROOT::TThreadExecutor> pool;
+      if (nThreads > 0)
+         pool = MakeThreadPool(nThreads);
+      return RunTrials(d.fFileNames, opts, [&] { return EvalUnzipOnly(d, pool.get(), opts); });
+   }
+   if (nThreads == 0)
+      return RunTrials(d.fFileNames, opts, [&] { return EvalThroughputST(d, opts); });
+
+   // the setup of multi-thread runs is shared by all trials
+   auto pool = MakeThreadPool(nThreads);
+   const auto plan = MakeReadPlan(d, ROOT::GetThreadPoolSize(), opts, pool.get());
+   return RunTrials(d.fFileNames, opts, [&] {
+      return EvalThroughputMTImpl(d, plan.fLayout, Workload{plan.fTasks, plan.fSampled, plan.fSelection}, *pool, opts);
+   });
+}
+
+std::vector<std::vector<EntryRange>> ReadSpeed::PartitionTasks(const ReadPlan &plan, unsigned int nThreads)
+{
+   return PartitionClusters(plan.fSelectedClusters, plan.fSampled, nThreads, plan.fPartition, plan.fLayout);
+}
+
+ReadPlan ReadSpeed::MakeReadPlan(const Data &d, unsigned int nThreads, const Options &opts, ROOT::TThreadExecutor *pool)
+{
+   ValidateData(d, opts);
+
+   ReadPlan plan;
+   plan.fData = d;
+   plan.fLayout = GetDatasetLayout(d, pool, opts.fIndexFile);
+
+   TStopwatch sw;
+   sw.Start();
+   plan.fSampled = opts.fSampleClusters > 0.;
+   plan.fSelectedClusters =
+      SelectsEntries(opts) ? SelectClusters(plan.fLayout.fClusters, opts, plan.fSelection) : plan.fLayout.fClusters;
+   plan.fPartition = opts.fPartition;
+   plan.fNThreads = nThreads;
+   plan.fTasks = PartitionTasks(plan, nThreads);
+   sw.Stop();
+   // selection and partitioning are part of the setup of the dataset
+   plan.fLayout.fSetupRealTime += sw.RealTime();
+   plan.fLayout.fSetupCpuTime += sw.CpuTime();
+   return plan;
+}
+
+Result ReadSpeed::EvalThroughput(const ReadPlan &plan, unsigned nThreads, const Options &opts)
+{
+   const auto &d = plan.fData;
+   ValidateData(d, opts);
+   if (plan.fTasks.size() != d.fFileNames.size() || plan.fLayout.fBranchNames.size() != d.fFileNames.size())
+      throw std::runtime_error("The read plan must have tasks and branches for each file");
+
+   std::unique_ptr<ROOT::TThreadExecutor> pool;
+   if (nThreads > 0)
+      pool = MakeThreadPool(nThreads);
+   if (opts.fUnzipOnly)
+      return RunTrials(d.fFileNames, opts, [&] { return EvalUnzipOnly(d, pool.get(), opts); });
+
+   const auto actualThreads = nThreads > 0 ? ROOT::GetThreadPoolSize() : 0u;
+   Workload w{plan.fTasks, plan.fSampled, plan.fSelection};
+   if (actualThreads != plan.fNThreads) {
+      TStopwatch sw;
+      sw.Start();
+      w.fTasks = PartitionTasks(plan, actualThreads);
+      sw.Stop();
+      w.fSetupRealTime = sw.RealTime();
+      w.fSetupCpuTime = sw.CpuTime();
+   }
+
+   return RunTrials(d.fFileNames, opts, [&] {
+      if (pool == nullptr)
+         return EvalThroughputSTImpl(d, w, &plan.fLayout.fBranchNames, opts);
+      return EvalThroughputMTImpl(d, plan.fLayout, w, *pool, opts);
+   });
+}
+
+std::vector<Result>
+ReadSpeed::EvalThroughputScaling(const Data &d, const std::vector<unsigned int> &nThreads, const Options &opts)
+{
+   ValidateData(d, opts);
+
+   std::vector<Result> results;
+   results.reserve(nThreads.size() + 1);
+
+   // each step is run like EvalThroughput runs it: warm-up and repeated trials, page cache drops, counter checks and
+   // peak RSS measurement included
+   if (opts.fUnzipOnly) {
+      results.emplace_back(RunTrials(d.fFileNames, opts, [&] { return EvalUnzipOnly(d, nullptr, opts); }));
+      for (const auto n : nThreads) {
+         const auto pool = MakeThreadPool(n);
+         results.emplace_back(RunTrials(d.fFileNames, opts, [&] { return EvalUnzipOnly(d, pool.get(), opts); }));
+      }
+      return results;
+   }
+   // Unless every step starts from cold files (fDropCache) or warms them up itself (fWarmup), the baseline would be
+   // the only run to read cold files: an untimed pass first brings it to the same state as the runs that follow it.
+   if (!opts.fDropCache && opts.fWarmup == 0)
+      EvalThroughputST(d, opts);
+   results.emplace_back(RunTrials(d.fFileNames, opts, [&] { return EvalThroughputST(d, opts); }));
+   if (nThreads.empty())
+      return results;
+
+   DatasetLayout layout;
+   {
+      // retrieve the dataset layout once, with as many threads as the largest run then uses
+      auto pool = MakeThreadPool(*std::max_element(nThreads.begin(), nThreads.end()));
+      layout = GetDatasetLayout(d, pool.get(), opts.fIndexFile);
+   }
+   for (const auto n : nThreads) {
+      auto pool = MakeThreadPool(n);
+      const auto w = MakeWorkload(layout, ROOT::GetThreadPoolSize(), opts);
+      results.emplace_back(
+         RunTrials(d.fFileNames, opts, [&] { return EvalThroughputMTImpl(d, layout, w, *pool, opts); }));
+   }
+
+   return results;
+}
+
+std::vector<RecompressionResult>
+ReadSpeed::EvalRecompression(const Data &d, const std::vector<unsigned int> &nThreads, const Options &opts)
+{
+   ValidateData(d, opts);
+   GetFormatReader(d.fFormat).ValidateRecompression(d);
+
+   bool limitReached = false;
+   std::vector<std::vector<LoadedFile>> versions;
+   versions.emplace_back(LoadBaskets(d, opts.fMemoryLimit, limitReached));
+
+   std::vector<RecompressionResult> results(1);
+   for (const auto settings : opts.fTryCompression) {
+      std::chrono::steady_clock::duration compressTime = std::chrono::steady_clock::duration::zero();
+      std::vector<LoadedFile> recompressed;
+      for (auto &file : versions.front())
+         recompressed.emplace_back(Recompress(file, settings, compressTime));
+      versions.emplace_back(std::move(recompressed));
+      RecompressionResult r;
+      r.fCompressionSettings = settings;
+      r.fCompressRealTime = std::chrono::duration<double>(compressTime).count();
+      results.emplace_back(std::move(r));
+   }
 
-   return nThreads > 0 ? EvalThroughputMT(d, nThreads) : EvalThroughputST(d);
+   // thread counts in the outer loop, so that a single thread pool exists at any time
+   for (const auto n : nThreads) {
+      auto pool = n > 0 ? MakeThreadPool(n) : nullptr;
+      for (auto i = 0u; i < versions.size(); ++i)
+         results[i].fDecompression.emplace_back(TimeUnzip(versions[i], pool.get()));
+   }
+
+   for (auto i = 0u; i < versions.size(); ++i) {
+      for (const auto &file : versions[i]) {
+         for (const auto &basket : file.fBaskets)
+            results[i].fCompressedBytes += basket.fBytes;
+      }
+      if (!results[i].fDecompression.empty())
+         results[i].fUncompressedBytes = results[i].fDecompression.front().fUncompressedBytesRead;
+   }
+   return results;
 }
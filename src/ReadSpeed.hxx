@@ -5,12 +5,37 @@
 #define ROOTREADSPEED
 
 #include <TFile.h>
+#include <TTree.h>
 
+#include <algorithm> // std::max
+#include <map>
+#include <mutex>
+#include <regex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+namespace ROOT {
+class TThreadExecutor;
+}
+
 namespace ReadSpeed {
 
+enum class EFormat {
+   kTTree,
+   /// See ReadSpeedRNTuple.hxx. Tree names are then RNTuple names and branch names are names of top-level fields.
+   kRNTuple
+};
+
+// A tree read in lockstep with the main trees of a dataset: entry i of the friend is read together with entry i of the
+// main tree, as TTree::AddFriend does.
+struct FriendTrees {
+   /// Name of the friend tree, optionally preceded by an alias as in "alias=treename" (see TTree::AddFriend).
+   std::string fTreeName;
+   /// The file of the friend tree for each file of the dataset, or empty if the friend tree is in the same files.
+   std::vector<std::string> fFileNames;
+};
+
 struct Data {
    /// Either a single tree name common for all files, or one tree name per file.
    std::vector<std::string> fTreeNames;
@@ -20,6 +45,385 @@ struct Data {
    std::vector<std::string> fBranchNames;
    /// If the branch names should use regex matching.
    bool fUseRegex = false;
+   /// Format of the datasets in the files.
+   EFormat fFormat = EFormat::kTTree;
+   /// Friend trees of the trees in fTreeNames. Their branches can be selected like those of the main trees, also as
+   /// "friendname.branchname".
+   std::vector<FriendTrees> fFriends = {};
+};
+
+enum class EScheduler {
+   /// One task per file, each spawning one task per entry range of the file, as TTreeProcessorMT does.
+   kNestedMapReduce,
+   /// Per-worker queues of entry ranges with work stealing, preferring ranges of the file the worker already has open.
+   kWorkStealing
+};
+
+enum class EPartition {
+   /// Tasks of roughly equal compressed size of the selected branches across the whole dataset.
+   kBytes,
+   /// The same number of tasks for each file, with the same number of clusters each, as TTreeProcessorMT does.
+   kClusters
+};
+
+enum class EPin {
+   /// Threads run wherever the operating system schedules them.
+   kNone,
+   /// Each worker thread is pinned to one CPU.
+   kCores,
+   /// Worker threads are split among NUMA nodes and pinned to the CPUs of their node. Each node reads its own subset
+   /// of the files, and its workers only take tasks of that subset.
+   kNuma
+};
+
+enum class EReadOrder {
+   /// For each entry, read all branches.
+   kEntryMajor,
+   /// For each branch, read all entries of the range.
+   kBranchMajor
+};
+
+struct EntryRange {
+   Long64_t fStart = -1;
+   Long64_t fEnd = -1;
+};
+
+inline bool operator==(const EntryRange &a, const EntryRange &b)
+{
+   return a.fStart == b.fStart && a.fEnd == b.fEnd;
+}
+
+inline bool operator!=(const EntryRange &a, const EntryRange &b)
+{
+   return !(a == b);
+}
+
+// The friend tree of the main tree of a single file, see FriendTrees.
+struct FriendTree {
+   std::string fTreeName;
+   /// Empty if the friend tree is in the same file as the main tree.
+   std::string fFileName;
+};
+
+inline bool operator==(const FriendTree &a, const FriendTree &b)
+{
+   return a.fTreeName == b.fTreeName && a.fFileName == b.fFileName;
+}
+
+struct Options {
+   /// If reading should be split into separately timed raw I/O, decompression and deserialization phases. The
+   /// TTreeCache of each tree then only holds the compressed baskets being read, TTreeCache options do not apply and
+   /// fAsyncPrefetch cannot be set.
+   bool fSplitPhases = false;
+   /// Path of an index file caching the dataset layout between runs. Empty means no index file is used.
+   std::string fIndexFile;
+   /// How the reading tasks of a multi-thread run are scheduled on the thread pool.
+   EScheduler fScheduler = EScheduler::kNestedMapReduce;
+   /// How the clusters of a multi-thread run are grouped into reading tasks.
+   EPartition fPartition = EPartition::kBytes;
+   /// How the worker threads of a multi-thread run are pinned to CPUs. Pinned runs always use per-worker task queues,
+   /// as EScheduler::kWorkStealing does. Only supported on Linux.
+   EPin fPin = EPin::kNone;
+   /// Maximum number of files each thread keeps open, closing the least recently used one when more are needed.
+   unsigned int fOpenFilesPerThread = 1;
+   /// If branches that support it should be read a whole basket at a time with ROOT's bulk I/O interface.
+   /// Other branches are still read entry by entry. Ignored if fSplitPhases is set.
+   bool fBulkRead = false;
+   /// If only the compressed baskets of the selected branches should be read from the files, with no decompression or
+   /// deserialization, to measure the throughput of the storage alone. Takes precedence over all other read modes.
+   bool fRawIO = false;
+   /// If the compressed baskets of the selected branches should be loaded in memory first (outside of the timed region)
+   /// and only their decompression timed. Takes precedence over all other read modes.
+   bool fUnzipOnly = false;
+   /// Maximum number of bytes of compressed baskets loaded in memory when fUnzipOnly is set, or by EvalRecompression.
+   /// Baskets beyond the limit are not used: the limit is spread over all selected branches of all files.
+   ULong64_t fMemoryLimit = 2ull * 1024 * 1024 * 1024;
+   /// Compression settings (algorithm * 100 + level, as in ROOT::CompressionSettings) to try in EvalRecompression.
+   std::vector<int> fTryCompression;
+   /// Order in which entries and branches are read. Ignored if fSplitPhases or fBulkRead are set.
+   EReadOrder fReadOrder = EReadOrder::kEntryMajor;
+   /// If statistics should be collected for each branch, also when reading in entry-major order. Ignored if
+   /// fSplitPhases or fBulkRead are set.
+   bool fPerBranch = false;
+   /// Size of the TTreeCache of each tree, in bytes. 0 disables the cache, -1 keeps ROOT's default.
+   Long64_t fCacheSize = -1;
+   /// Number of entries the TTreeCache uses to learn which branches are read. 0 keeps ROOT's default.
+   int fCacheLearnEntries = 0;
+   /// If the selected branches should be added to the TTreeCache explicitly, skipping the learning phase, and the
+   /// cache's entry range restricted to the range read by each task.
+   bool fCacheAddBranches = false;
+   /// If the TTreeCache should prefetch the next cluster asynchronously (TFile.AsyncPrefetching).
+   bool fAsyncPrefetch = false;
+   /// Number of measured trials of EvalThroughput. The result of the trial with median real time is returned.
+   unsigned int fRepeat = 1;
+   /// Number of trials of EvalThroughput to run, and discard, before the measured ones.
+   unsigned int fWarmup = 0;
+   /// If local files should be evicted from the operating system's page cache before each measured trial.
+   bool fDropCache = false;
+   /// Range of entries to read from each file, {-1, -1} to read all entries. Ignored if fUnzipOnly is set.
+   EntryRange fEntries;
+   /// Maximum number of entries to read from each file, counting from the start of fEntries. -1 means no limit.
+   Long64_t fMaxEntriesPerFile = -1;
+   /// Fraction (if smaller than 1) or number (otherwise) of clusters to read, picked at random in each file in
+   /// proportion to its number of clusters. The result then includes a projection for the whole selection of entries.
+   /// 0 reads all clusters.
+   double fSampleClusters = 0.;
+   /// Seed of the random number generator used to pick the clusters to read when fSampleClusters is set.
+   unsigned int fSampleSeed = 1;
+   /// Interval between samples of the progress of the run (see Result::fTimeSeries), in seconds. 0 disables sampling.
+   /// Ignored if fUnzipOnly is set.
+   double fSampleInterval = 0.;
+   /// If positive, multi-thread runs are pipelined: fIOThreads dedicated threads fetch the compressed baskets of the
+   /// tasks ahead, and at most this many fetched tasks wait in memory to be decompressed by the thread pool's workers.
+   /// Pipelined runs time fetching and decompression only, without deserialization, and ignore the read mode,
+   /// scheduling and TTreeCache options.
+   unsigned int fPipelineDepth = 0;
+   /// Number of I/O threads of a pipelined run, see fPipelineDepth.
+   unsigned int fIOThreads = 1;
+   /// Count CPU cycles, instructions, last-level cache misses and branch misses of each reading thread while it reads
+   /// entries (see Result::fPerfCounters), with Linux's perf_event_open. Runs throw if the counters cannot be opened.
+   /// Ignored if fUnzipOnly is set and for pipelined runs.
+   bool fPerfCounters = false;
+};
+
+struct BranchStats {
+   /// Value of fCompressionSettings when different files compress the branch differently.
+   static constexpr int kMixedCompression = -2;
+
+   /// Real time spent in TBranch::GetEntry for the branch (loading the field, for RNTuples), in seconds.
+   double fRealTime = 0.;
+   /// Number of uncompressed bytes read from the branch.
+   ULong64_t fUncompressedBytesRead = 0;
+   /// Size on disk of the baskets of the branch (and its sub-branches) that were read. For RNTuples, the size of the
+   /// pages of the field read from storage.
+   ULong64_t fCompressedBytes = 0;
+   /// Number of baskets of the branch (and its sub-branches) that were read. Not counted for RNTuples.
+   ULong64_t fNBaskets = 0;
+   /// Compression settings of the branch (algorithm * 100 + level), -1 if unknown (always, for RNTuples).
+   int fCompressionSettings = -1;
+
+   BranchStats &operator+=(const BranchStats &o)
+   {
+      fRealTime += o.fRealTime;
+      fUncompressedBytesRead += o.fUncompressedBytesRead;
+      fCompressedBytes += o.fCompressedBytes;
+      fNBaskets += o.fNBaskets;
+      if (fCompressionSettings == -1)
+         fCompressionSettings = o.fCompressionSettings;
+      else if (o.fCompressionSettings != -1 && o.fCompressionSettings != fCompressionSettings)
+         fCompressionSettings = kMixedCompression;
+      return *this;
+   }
+};
+
+struct CacheStats {
+   /// Number of read calls issued to the files.
+   ULong64_t fReadCalls = 0;
+   /// Number of basket reads served by the TTreeCache, counted over the reads of each task.
+   ULong64_t fCacheHits = 0;
+   /// Number of basket reads that were not in the TTreeCache and required a separate read.
+   ULong64_t fCacheMisses = 0;
+
+   CacheStats &operator+=(const CacheStats &o)
+   {
+      fReadCalls += o.fReadCalls;
+      fCacheHits += o.fCacheHits;
+      fCacheMisses += o.fCacheMisses;
+      return *this;
+   }
+};
+
+// Hardware performance counters of the calling thread, user space only.
+struct PerfCounters {
+   ULong64_t fCycles = 0;
+   ULong64_t fInstructions = 0;
+   /// Last-level cache misses.
+   ULong64_t fLLCMisses = 0;
+   ULong64_t fBranchMisses = 0;
+
+   PerfCounters &operator+=(const PerfCounters &o)
+   {
+      fCycles += o.fCycles;
+      fInstructions += o.fInstructions;
+      fLLCMisses += o.fLLCMisses;
+      fBranchMisses += o.fBranchMisses;
+      return *this;
+   }
+};
+
+struct PhaseTimes {
+   /// Real time spent reading compressed baskets from storage, in seconds.
+   double fIORealTime = 0.;
+   /// CPU time spent reading compressed baskets from storage, in seconds.
+   double fIOCpuTime = 0.;
+   /// Real time spent decompressing baskets, in seconds.
+   double fUnzipRealTime = 0.;
+   /// CPU time spent decompressing baskets, in seconds.
+   double fUnzipCpuTime = 0.;
+   /// Real time spent deserializing entries from decompressed baskets, in seconds.
+   double fDeserializeRealTime = 0.;
+   /// CPU time spent deserializing entries from decompressed baskets, in seconds.
+   double fDeserializeCpuTime = 0.;
+   /// Hardware counters of each phase, only filled if Options::fPerfCounters is set.
+   PerfCounters fIOCounters;
+   PerfCounters fUnzipCounters;
+   PerfCounters fDeserializeCounters;
+
+   PhaseTimes &operator+=(const PhaseTimes &o)
+   {
+      fIORealTime += o.fIORealTime;
+      fIOCpuTime += o.fIOCpuTime;
+      fUnzipRealTime += o.fUnzipRealTime;
+      fUnzipCpuTime += o.fUnzipCpuTime;
+      fDeserializeRealTime += o.fDeserializeRealTime;
+      fDeserializeCpuTime += o.fDeserializeCpuTime;
+      fIOCounters += o.fIOCounters;
+      fUnzipCounters += o.fUnzipCounters;
+      fDeserializeCounters += o.fDeserializeCounters;
+      return *this;
+   }
+};
+
+struct TaskStats {
+   /// Index of the file read by the task, in Data::fFileNames.
+   unsigned int fFileIdx;
+   /// Range of entries read by the task.
+   EntryRange fRange;
+   /// Index of the worker thread that ran the task, see Result::fThreadStats.
+   unsigned int fThreadIdx;
+   /// Real time spent running the task, in seconds.
+   double fRealTime;
+   /// CPU time spent running the task by its worker thread, in seconds.
+   double fCpuTime;
+   /// Real time spent by the task before reading entries (opening the file, retrieving tree and branches), in seconds.
+   double fSetupRealTime;
+   /// Number of uncompressed bytes read by the task.
+   ULong64_t fUncompressedBytesRead;
+   /// Number of compressed bytes read by the task.
+   ULong64_t fCompressedBytesRead;
+};
+
+struct ThreadStats {
+   /// Number of tasks run by this worker thread.
+   unsigned int fNTasks = 0;
+   /// Real time this worker thread spent running tasks, in seconds.
+   double fBusyRealTime = 0.;
+   /// Memory held by the basket buffers of the branches read and by the TTreeCache for the last task of this worker
+   /// thread, sampled at the end of the run, in bytes.
+   ULong64_t fBasketBytes = 0;
+};
+
+struct TrialStats {
+   /// Real time of the trial, in seconds.
+   double fRealTime = 0.;
+   /// CPU time of the trial, in seconds.
+   double fCpuTime = 0.;
+   ULong64_t fUncompressedBytesRead = 0;
+   ULong64_t fCompressedBytesRead = 0;
+};
+
+// Estimate, from a run that read a random sample of clusters, of the run that reads all selected entries.
+struct Projection {
+   /// Number of entries selected for reading (i.e. after applying Options::fEntries and fMaxEntriesPerFile).
+   ULong64_t fTotalEntries = 0;
+   /// Number of entries actually read, in the sampled clusters.
+   ULong64_t fSampledEntries = 0;
+   /// Number of clusters selected for reading.
+   std::size_t fTotalClusters = 0;
+   /// Number of clusters actually read.
+   std::size_t fSampledClusters = 0;
+   /// Projected real time to read all selected entries, in seconds.
+   double fRealTime = 0.;
+   /// Bounds of the 95% confidence interval of fRealTime, in seconds (equal to fRealTime for less than two clusters).
+   double fRealTimeLow = 0.;
+   double fRealTimeHigh = 0.;
+   /// Projected number of uncompressed bytes read from all selected entries.
+   ULong64_t fUncompressedBytesRead = 0;
+   /// Projected number of compressed bytes read from all selected entries.
+   ULong64_t fCompressedBytesRead = 0;
+};
+
+struct BatchStats {
+   /// Time at which the coordinator sent the batch to the node or, if it was queued behind the previous batch of the
+   /// node, received the results of that batch, in seconds since the start of the run.
+   double fStartTime = 0.;
+   /// Time at which the coordinator received the results of the batch, in seconds since the start of the run.
+   double fEndTime = 0.;
+   /// Real time spent by the node reading the batch, in seconds.
+   double fRealTime = 0.;
+   /// Number of reading tasks in the batch.
+   ULong64_t fNTasks = 0;
+   ULong64_t fUncompressedBytesRead = 0;
+   ULong64_t fCompressedBytesRead = 0;
+};
+
+struct NodeStats {
+   /// Host name reported by the worker.
+   std::string fHostName;
+   /// Size of the worker's thread pool.
+   unsigned int fThreadPoolSize = 0;
+   /// Batches of tasks run by the worker, in the order in which they were sent to it.
+   std::vector<BatchStats> fBatches;
+};
+
+struct NumaNodeStats {
+   /// Id of the NUMA node, as numbered by the operating system.
+   int fNode = -1;
+   /// Number of worker threads pinned to the node.
+   unsigned int fNThreads = 0;
+   /// Number of files assigned to the node.
+   unsigned int fNFiles = 0;
+   /// Number of reading tasks run by the node's workers.
+   ULong64_t fNTasks = 0;
+   /// Time from the start of the run to the moment the last worker of the node finished, in seconds.
+   double fRealTime = 0.;
+   ULong64_t fUncompressedBytesRead = 0;
+   ULong64_t fCompressedBytesRead = 0;
+};
+
+struct PipelineStats {
+   /// Maximum number of fetched tasks waiting to be decompressed, 0 if the run was not pipelined.
+   unsigned int fDepth = 0;
+   unsigned int fNIOThreads = 0;
+   /// Number of threads of the pool that decompressed tasks, at most its size: the pool does not guarantee that all of
+   /// its threads join the run.
+   unsigned int fNWorkers = 0;
+   /// Time the I/O threads spent waiting for room in the queue, summed over I/O threads, in seconds: decompression
+   /// could not keep up with I/O.
+   double fIOWaitTime = 0.;
+   /// Time the workers spent waiting for fetched tasks, summed over workers, in seconds: I/O could not keep up with
+   /// decompression.
+   double fWorkerWaitTime = 0.;
+   /// Average number of fetched tasks waiting in the queue over the run.
+   double fMeanQueued = 0.;
+   /// Maximum number of fetched tasks that waited in the queue at the same time.
+   std::size_t fMaxQueued = 0;
+};
+
+struct MemoryStats {
+   /// Peak resident set size of the process during the run, in bytes, -1 if not available. On Linux the peak is reset
+   /// before each run, elsewhere it covers the whole life of the process.
+   Long64_t fPeakRSS = -1;
+   /// Largest memory held by basket buffers and TTreeCache of a reading thread, in bytes: the footprint of one reading
+   /// thread. Sampled after each task in single-thread runs, for each worker thread at the end of multi-thread runs.
+   ULong64_t fPeakBasketBytes = 0;
+   /// Number of allocations made with operator new while reading entries, summed over all tasks. -1 if allocations
+   /// were not counted: the executable does not link ReadSpeedAllocations.cxx, or the read mode does not read
+   /// through ReadTree (Options::fUnzipOnly, pipelined runs).
+   Long64_t fNAllocations = -1;
+   /// Number of bytes allocated with operator new while reading entries, summed over all tasks.
+   ULong64_t fAllocatedBytes = 0;
+};
+
+struct ProgressSample {
+   /// Time since the beginning of the run, in seconds.
+   double fTime = 0.;
+   /// Number of uncompressed bytes read since the beginning of the run.
+   ULong64_t fUncompressedBytesRead = 0;
+   /// Number of compressed bytes read since the beginning of the run.
+   ULong64_t fCompressedBytesRead = 0;
+   /// Number of reading tasks running when the sample was taken.
+   unsigned int fActiveTasks = 0;
 };
 
 struct Result {
@@ -37,27 +441,197 @@ struct Result {
    ULong64_t fCompressedBytesRead;
    /// Size of ROOT's thread pool for the run (0 indicates a single-thread run with no thread pool present).
    unsigned int fThreadPoolSize;
+   /// Time spent in each reading phase, summed over all tasks (only filled if Options::fSplitPhases is set, or its raw
+   /// I/O part if Options::fRawIO is set).
+   PhaseTimes fPhaseTimes;
+   /// Number of times a file was opened for reading (the setup of multi-thread runs is not included).
+   ULong64_t fFileOpens = 0;
+   /// Number of times a file had to be opened again by a thread that had already opened it before.
+   ULong64_t fFileReopens = 0;
+   /// Number of reading tasks (i.e. calls to ReadTree).
+   ULong64_t fNTasks = 0;
+   /// Real time spent by tasks before reading entries (opening files, retrieving trees and branches), in seconds.
+   double fTaskSetupRealTime = 0.;
+   /// CPU time spent by tasks before reading entries (opening files, retrieving trees and branches), in seconds.
+   double fTaskSetupCpuTime = 0.;
+   /// Statistics for each branch read, by branch name, summed over all tasks (only filled if Options::fPerBranch is set
+   /// or when reading in branch-major order).
+   std::map<std::string, BranchStats> fBranchStats;
+   /// Read calls and TTreeCache hits and misses, summed over all tasks.
+   CacheStats fCacheStats;
+   /// Statistics for each reading task of a multi-thread run, in the order in which tasks were scheduled.
+   std::vector<TaskStats> fTaskStats;
+   /// Statistics for each worker thread of a multi-thread run, indexed by TaskStats::fThreadIdx.
+   std::vector<ThreadStats> fThreadStats;
+   /// Statistics of each measured trial, in the order in which they ran. Only filled if Options::fRepeat > 1: all
+   /// other fields then refer to the trial with median real time.
+   std::vector<TrialStats> fTrials;
+   /// Projection to all selected entries, only filled if Options::fSampleClusters is set (fTotalClusters is 0
+   /// otherwise).
+   Projection fProjection;
+   /// Progress of the run, sampled every Options::fSampleInterval seconds from its beginning to its end (both
+   /// included). Empty if Options::fSampleInterval is 0.
+   std::vector<ProgressSample> fTimeSeries;
+   /// Statistics for each worker node of a distributed run (see RunCoordinator), in the order in which they connected.
+   std::vector<NodeStats> fNodeStats;
+   /// Statistics for each NUMA node of a multi-thread run pinned with EPin::kNuma.
+   std::vector<NumaNodeStats> fNumaStats;
+   /// Statistics of the queue between fetching and decompression, only filled for pipelined runs.
+   PipelineStats fPipeline;
+   /// Memory footprint of the run and allocations made while reading.
+   MemoryStats fMemory;
+   /// Hardware counters of the reading threads while they read entries, summed over all tasks (only filled if
+   /// Options::fPerfCounters is set).
+   PerfCounters fPerfCounters;
    // TODO returning zipped bytes read too might be interesting, e.g. to estimate network I/O speed
 };
 
-struct EntryRange {
-   Long64_t fStart = -1;
-   Long64_t fEnd = -1;
+struct FileMetadata {
+   /// Name of the tree that was read from the file.
+   std::string fTreeName;
+   /// Size of the file in bytes as reported by the filesystem, -1 if it could not be retrieved.
+   Long64_t fFileSize = -1;
+   /// Modification time of the file as reported by the filesystem, -1 if it could not be retrieved.
+   Long_t fModTime = -1;
+   /// UUID of the TFile.
+   std::string fUUID;
+   /// Number of entries in the tree.
+   Long64_t fEntries = 0;
+   /// Compressed size of the branches to read, including their sub-branches.
+   ULong64_t fZipBytes = 0;
+   /// Uncompressed size of the branches to read, including their sub-branches.
+   ULong64_t fTotBytes = 0;
+};
+
+// Everything a multi-thread run needs to know about a file before reading it.
+struct FileLayout {
+   /// Entry ranges of the clusters of the tree.
+   std::vector<EntryRange> fClusters;
+   /// Names of the branches to read (the result of regex matching, if requested).
+   std::vector<std::string> fBranchNames;
+   FileMetadata fMetadata;
+   /// Compressed size of the branches to read in each cluster, including their sub-branches. Baskets are counted in
+   /// the cluster their first entry belongs to.
+   std::vector<ULong64_t> fClusterBytes;
+};
+
+// Per-file information needed to schedule a multi-thread run. It only depends on the Data, not on the number of
+// threads, so it can be computed once and reused for several runs.
+struct DatasetLayout {
+   /// For each file, the entry ranges of its clusters.
+   std::vector<std::vector<EntryRange>> fClusters;
+   /// For each file, the names of the branches to read (the result of regex matching, if requested).
+   std::vector<std::vector<std::string>> fBranchNames;
+   /// For each file, its metadata.
+   std::vector<FileMetadata> fMetadata;
+   /// For each file, the compressed size of the branches to read in each cluster (see FileLayout::fClusterBytes).
+   std::vector<std::vector<ULong64_t>> fClusterBytes;
+   /// Number of files whose layout was loaded from an index file rather than retrieved by opening the file.
+   std::size_t fNFilesFromIndex = 0;
+   /// Real time spent computing this layout, in seconds.
+   double fSetupRealTime = 0.;
+   /// CPU time spent computing this layout, in seconds.
+   double fSetupCpuTime = 0.;
 };
 
 struct ByteData {
-   ULong64_t fUncompressedBytesRead;
-   ULong64_t fCompressedBytesRead;
+   ULong64_t fUncompressedBytesRead = 0;
+   ULong64_t fCompressedBytesRead = 0;
+   PhaseTimes fPhaseTimes;
+   /// Number of times a file had to be opened.
+   ULong64_t fFileOpens = 0;
+   /// Number of times a file had to be opened again by a thread that had already opened it before.
+   ULong64_t fFileReopens = 0;
+   /// Number of reading tasks (i.e. calls to ReadTree).
+   ULong64_t fNTasks = 0;
+   /// Real time spent by tasks before reading entries (opening files, retrieving trees and branches), in seconds.
+   double fTaskSetupRealTime = 0.;
+   /// CPU time spent by tasks before reading entries (opening files, retrieving trees and branches), in seconds.
+   double fTaskSetupCpuTime = 0.;
+   /// Statistics for each branch read, by branch name (only filled if Options::fPerBranch is set or when reading in
+   /// branch-major order).
+   std::map<std::string, BranchStats> fBranchStats;
+   CacheStats fCacheStats;
+   /// Memory held by basket buffers and TTreeCache at the end of a task, the largest over tasks for sums of tasks.
+   /// Sampled by the runs outside of their timed region: ReadTree and ReadRNTuple leave it at 0.
+   ULong64_t fBasketBytes = 0;
+   /// Number of allocations made with operator new while reading entries (see MemoryStats::fNAllocations).
+   ULong64_t fNAllocations = 0;
+   /// Number of bytes allocated with operator new while reading entries.
+   ULong64_t fAllocatedBytes = 0;
+   /// Hardware counters of the thread while reading entries (only filled if Options::fPerfCounters is set).
+   PerfCounters fPerfCounters;
+
+   ByteData &operator+=(const ByteData &o)
+   {
+      fUncompressedBytesRead += o.fUncompressedBytesRead;
+      fCompressedBytesRead += o.fCompressedBytesRead;
+      fPhaseTimes += o.fPhaseTimes;
+      fFileOpens += o.fFileOpens;
+      fFileReopens += o.fFileReopens;
+      fNTasks += o.fNTasks;
+      fTaskSetupRealTime += o.fTaskSetupRealTime;
+      fTaskSetupCpuTime += o.fTaskSetupCpuTime;
+      for (const auto &b : o.fBranchStats)
+         fBranchStats[b.first] += b.second;
+      fCacheStats += o.fCacheStats;
+      fBasketBytes = std::max(fBasketBytes, o.fBasketBytes);
+      fNAllocations += o.fNAllocations;
+      fAllocatedBytes += o.fAllocatedBytes;
+      fPerfCounters += o.fPerfCounters;
+      return *this;
+   }
+};
+
+// Select the top-level branches of trees whose names match any of a list of regexes.
+// Regexes are compiled once at construction, and the result of matching is cached per tree schema (the list of
+// top-level branch names), so that trees with the same schema are only matched once. Thread-safe.
+class BranchMatcher {
+   struct SchemaHash {
+      std::size_t operator()(const std::vector<std::string> &branchNames) const;
+   };
+
+   std::vector<std::string> fRegexStrings;
+   std::vector<std::regex> fRegexes;
+   std::mutex fMutex;
+   std::unordered_map<std::vector<std::string>, std::vector<std::string>, SchemaHash> fCache;
+
+public:
+   explicit BranchMatcher(const std::vector<std::string> &regexes);
+
+   // The branches of friends are matched too, see Data::fFriends.
+   std::vector<std::string> GetMatchingBranchNames(const std::string &fileName, const std::string &treeName,
+                                                   const std::vector<FriendTree> &friends = {});
+   std::vector<std::string> GetMatchingBranchNames(TTree &t);
+   // Match the given top-level branch (or field) names.
+   std::vector<std::string> MatchBranchNames(std::vector<std::string> topLevelNames);
 };
 
 std::vector<std::string> GetMatchingBranchNames(const std::string &fileName, const std::string &treeName,
                                                 const std::vector<std::string> &regexes);
+std::vector<std::string> GetMatchingBranchNames(TTree &t, const std::vector<std::string> &regexes);
 
 // Read branches listed in branchNames in tree treeName in file fileName, return number of uncompressed bytes read.
+// If opts.fSplitPhases is set, the compressed baskets are first read into memory, then decompressed, then deserialized,
+// and the time spent in each phase is returned together with the number of bytes read.
+// The branches of friends are read in lockstep with those of the tree; the bytes read from their files are included.
 ByteData ReadTree(const std::string &treeName, const std::string &fileName, const std::vector<std::string> &branchNames,
-                  EntryRange range = {-1, -1});
+                  EntryRange range = {-1, -1}, const Options &opts = {}, const std::vector<FriendTree> &friends = {});
+
+// Like ReadTree, for the top-level fields fieldNames of RNTuple ntupleName in file fileName, entry by entry.
+// Uncompressed and compressed bytes are those of the pages the reader decompressed and read during the task.
+// With opts.fPerBranch or in branch-major order each field is read by a reader of its own, to time it and count its
+// bytes separately. Progress is reported at the end of the task. The other read modes are not supported, and
+// TTreeCache options are ignored.
+ByteData ReadRNTuple(const std::string &ntupleName, const std::string &fileName,
+                     const std::vector<std::string> &fieldNames, EntryRange range = {-1, -1},
+                     const Options &opts = {});
+
+Result EvalThroughputST(const Data &d, const Options &opts = {});
 
-Result EvalThroughputST(const Data &d);
+// Parse a list of CPUs in the format of Linux's sysfs, e.g. "0-3,8,10-11", into the list of CPU ids.
+// Throws if the list is malformed.
+std::vector<int> ParseCpuList(const std::string &cpuList);
 
 // Return a vector of EntryRanges per file, i.e. a vector of vectors of EntryRanges with outer size equal to
 // d.fFileNames.
@@ -69,9 +643,149 @@ std::vector<std::vector<EntryRange>> GetClusters(const Data &d);
 std::vector<std::vector<EntryRange>>
 MergeClusters(std::vector<std::vector<EntryRange>> &&clusters, unsigned int maxTasksPerFile);
 
-Result EvalThroughputMT(const Data &d, unsigned nThreads);
+// Merge contiguous clusters of each file into about nTasks tasks in total, of roughly equal cost across the whole
+// dataset: costs has the cost (e.g. the size in bytes) of each cluster in clusters. A file gets at least one task if it
+// has clusters, and each cluster goes to the task that gets closer to the average cost per task with it than without.
+std::vector<std::vector<EntryRange>> MergeClustersByCost(const std::vector<std::vector<EntryRange>> &clusters,
+                                                         const std::vector<std::vector<double>> &costs,
+                                                         unsigned int nTasks);
+
+// Restrict the clusters of each file to the entries selected by range (all entries if {-1, -1}) and to at most
+// maxEntriesPerFile entries per file (no limit if -1). Clusters that end up empty are removed, the ones at the edges of
+// the selection are shortened.
+std::vector<std::vector<EntryRange>>
+ClipClusters(const std::vector<std::vector<EntryRange>> &clusters, EntryRange range, Long64_t maxEntriesPerFile);
+
+// Pick a random sample of clusters, stratified by file: sample is the fraction (if smaller than 1) or the number
+// (otherwise) of clusters to pick in total, and each file contributes in proportion to its number of clusters.
+// At least one cluster is picked. The selected clusters of each file are returned in their original order.
+std::vector<std::vector<EntryRange>>
+SampleClusters(const std::vector<std::vector<EntryRange>> &clusters, double sample, unsigned int seed);
+
+// Project the real time of reading totalClusters clusters with totalEntries entries from the tasks of a run that read
+// a random sample of them (one cluster per task) in realTime seconds, with a ratio estimator of the time per entry.
+// Only the fRange, fRealTime and byte counts of the tasks are used.
+Projection ProjectFromSample(const std::vector<TaskStats> &sample, double realTime, ULong64_t totalEntries,
+                             std::size_t totalClusters);
+
+// Return the p-th percentile (0 <= p <= 100) of values with the nearest-rank method, or 0 if values is empty.
+double Percentile(std::vector<double> values, double p);
+
+struct RecompressionResult {
+   /// Compression settings (algorithm * 100 + level) the sample was recompressed with, -1 for the baskets as stored.
+   int fCompressionSettings = -1;
+   /// Uncompressed size of the sample.
+   ULong64_t fUncompressedBytes = 0;
+   /// Compressed size of the sample, key headers included.
+   ULong64_t fCompressedBytes = 0;
+   /// Real time spent compressing the sample on a single thread, in seconds (0 for the baskets as stored).
+   double fCompressRealTime = 0.;
+   /// Decompression of the sample with each number of threads passed to EvalRecompression, in the same order.
+   std::vector<Result> fDecompression;
+};
+
+struct SummaryStats {
+   double fMean = 0.;
+   /// Sample standard deviation, 0 for less than two values.
+   double fStdDev = 0.;
+   double fMin = 0.;
+   double fMedian = 0.;
+};
+
+// Return mean, standard deviation, minimum and median of values, or all zeros if values is empty.
+SummaryStats Summarize(const std::vector<double> &values);
+
+// Return the bytes allocated while reading per MB of uncompressed data read, to tell allocation overhead apart from
+// actual I/O, or -1 if allocations were not counted or nothing was read.
+double AllocatedBytesPerMB(const Result &r);
+
+// Return the instructions retired per CPU cycle, or 0 if no cycles were counted.
+double InstructionsPerCycle(const PerfCounters &c);
+
+// Open every file once to retrieve both its cluster boundaries and the list of branches to read.
+// If a thread pool is passed, files are processed concurrently on it.
+// If indexFile is not empty, files whose size and modification time match those recorded in the index are not opened,
+// their layout is taken from the index instead, unless the index predates cluster sizes (FileLayout::fClusterBytes).
+// The index is then updated with the layout of all other files.
+DatasetLayout GetDatasetLayout(const Data &d, ROOT::TThreadExecutor *pool = nullptr, const std::string &indexFile = "");
+
+Result EvalThroughputMT(const Data &d, unsigned nThreads, const Options &opts = {});
+
+// Like EvalThroughputMT(d, nThreads, opts), but reusing a layout that was computed beforehand.
+// The time spent computing the layout is reported as part of the MT setup time.
+Result EvalThroughputMT(const Data &d, const DatasetLayout &layout, unsigned nThreads, const Options &opts = {});
+
+// Read the given entry ranges of each file (tasks has one element per file of d, each range is read by one task) on an
+// existing thread pool. Ranges are read as they are: they are not merged, and the entry selection and sampling options
+// are ignored. Only the branch names of layout are used. Files opened by previous calls are not closed, so that
+// consecutive batches of tasks of the same run do not re-open them.
+Result EvalThroughputMT(const Data &d, const DatasetLayout &layout, const std::vector<std::vector<EntryRange>> &tasks,
+                        ROOT::TThreadExecutor &pool, const Options &opts = {});
+
+Result EvalThroughput(const Data &d, unsigned nThreads, const Options &opts = {});
+
+// Throw if opts cannot be used to read d, e.g. options that do not apply to its format or to friend trees. Only the
+// format and the friend trees of d are checked: its tree, file and branch names are checked when it is read.
+void ValidateOptions(const Data &d, const Options &opts);
+
+// Throw if d lacks tree, file or branch names, or their numbers do not match, or opts cannot be used to read it (see
+// ValidateOptions). All runs start with this check.
+void ValidateData(const Data &d, const Options &opts = {});
+
+// Everything a run needs to know about a dataset before reading it: validated input, branches resolved and clusters
+// selected and partitioned into reading tasks. A plan is built once with MakeReadPlan, which opens every file (unless
+// an index file is used), and can then be executed many times, with different numbers of threads or read options,
+// without opening files again before reading. See SaveReadPlan and LoadReadPlan in ReadSpeedIndex.hxx to store it.
+struct ReadPlan {
+   Data fData;
+   /// Branches to read, metadata and clusters of each file.
+   DatasetLayout fLayout;
+   /// For each file, the clusters selected for reading by the entry selection and sampling options of MakeReadPlan.
+   std::vector<std::vector<EntryRange>> fSelectedClusters;
+   /// If fSelectedClusters is a random sample of clusters (see Options::fSampleClusters). Each sampled cluster is then
+   /// read by a separate task, and the result of a run includes a projection to the whole selection.
+   bool fSampled = false;
+   /// Number of entries and clusters the sample was taken from, in fTotalEntries and fTotalClusters. Only if fSampled.
+   Projection fSelection;
+   /// How fTasks was partitioned, and how tasks are partitioned again for other numbers of threads.
+   EPartition fPartition = EPartition::kBytes;
+   /// Number of threads fTasks was partitioned for, 0 for a single-thread run.
+   unsigned int fNThreads = 0;
+   /// For each file, the entry range read by each task.
+   std::vector<std::vector<EntryRange>> fTasks;
+};
+
+// Split the selected clusters of plan into reading tasks for nThreads threads (0 for a single-thread run, which reads
+// each file with a single task) as plan.fPartition says. Sampled clusters are read by one task each.
+std::vector<std::vector<EntryRange>> PartitionTasks(const ReadPlan &plan, unsigned int nThreads);
+
+// Validate d, retrieve its layout (on pool, if passed, and using Options::fIndexFile), apply the entry selection and
+// sampling options in opts and partition the selected clusters into tasks for nThreads threads with
+// Options::fPartition.
+ReadPlan MakeReadPlan(const Data &d, unsigned int nThreads, const Options &opts = {},
+                      ROOT::TThreadExecutor *pool = nullptr);
+
+// Execute plan with nThreads threads (0 for a single-thread run), with the read, trial and sampling options in opts:
+// options that change what is read and how it is partitioned (fIndexFile, fEntries, fMaxEntriesPerFile,
+// fSampleClusters, fSampleSeed, fPartition) only matter when the plan is made. If nThreads is not the number of
+// threads the plan was partitioned for, its clusters are partitioned again for nThreads, which does not require
+// opening files.
+Result EvalThroughput(const ReadPlan &plan, unsigned nThreads, const Options &opts = {});
+
+// Measure how throughput scales with the number of threads: the first result is a single-thread run, followed by one
+// multi-thread run per element of nThreads (none if it is empty). The dataset layout is computed once and shared by
+// all multi-thread runs. Each run is measured as by EvalThroughput, e.g. with Options::fRepeat trials. Unless
+// Options::fDropCache or Options::fWarmup are set, the files are read once, untimed, before the single-thread run, so
+// that it does not read colder files than the runs after it.
+std::vector<Result> EvalThroughputScaling(const Data &d, const std::vector<unsigned int> &nThreads,
+                                          const Options &opts = {});
 
-Result EvalThroughput(const Data &d, unsigned nThreads);
+// Load a sample of the compressed baskets of the selected branches (at most Options::fMemoryLimit bytes) in memory,
+// recompress it with each of the settings in Options::fTryCompression, and time the decompression of each version,
+// the baskets as stored included, with each number of threads in nThreads (0 meaning a single-thread run).
+// Nothing is written to disk. The first element of the result refers to the baskets as stored.
+std::vector<RecompressionResult>
+EvalRecompression(const Data &d, const std::vector<unsigned int> &nThreads, const Options &opts);
 
 } // namespace ReadSpeed
 
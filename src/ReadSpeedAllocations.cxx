@@ -0,0 +1,46 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* Replacements of the global allocation functions, to count allocations while reading. The array and nothrow
+   versions forward to these. Only linked into executables, see ReadSpeedAllocations.hxx. */
+
+#include "ReadSpeedAllocations.hxx"
+
+#include <cstdlib> // std::malloc, std::free
+#include <new>
+
+using ReadSpeed::Internal::gAllocationCounts;
+
+namespace {
+// Tell the library that allocations are counted, before main starts.
+const bool kRegistered = (ReadSpeed::Internal::gCountAllocations = true);
+} // anonymous namespace
+
+void *operator new(std::size_t size)
+{
+   auto &counts = gAllocationCounts;
+   if (counts.fActive) {
+      ++counts.fNAllocations;
+      counts.fAllocatedBytes += size;
+   }
+   if (size == 0)
+      size = 1;
+   while (true) {
+      if (void *p = std::malloc(size))
+         return p;
+      auto handler = std::get_new_handler();
+      if (handler == nullptr)
+         throw std::bad_alloc();
+      handler();
+   }
+}
+
+void operator delete(void *p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+   std::free(p);
+}
@@ -0,0 +1,33 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* This header contains the allocation counts shared by the library and the replacement of the global operator new in
+   ReadSpeedAllocations.cxx. That file is only compiled into executables built with ROOTREADSPEED_COUNT_ALLOCATIONS,
+   never into the library, so that applications linking the library keep their own allocator. */
+
+#ifndef ROOTREADSPEEDALLOCATIONS
+#define ROOTREADSPEEDALLOCATIONS
+
+#include <RtypesCore.h> // ULong64_t
+
+namespace ReadSpeed {
+namespace Internal {
+
+// Allocations made with operator new by the calling thread while counting is active on it.
+// Trivial and constant-initialized, so that operator new can use it at any time, even while threads start.
+struct AllocationCounts {
+   bool fActive;
+   ULong64_t fNAllocations;
+   ULong64_t fAllocatedBytes;
+};
+
+// The counts of the calling thread, defined in the library.
+extern thread_local AllocationCounts gAllocationCounts;
+
+// Set when the replacement of operator new is linked into the executable: allocations are only reported if so.
+extern bool gCountAllocations;
+
+} // namespace Internal
+} // namespace ReadSpeed
+
+#endif // ROOTREADSPEEDALLOCATIONS
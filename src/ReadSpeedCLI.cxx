@@ -2,14 +2,72 @@
    See the LICENSE file in the top directory for more information. */
 
 #include "ReadSpeedCLI.hxx"
+#include "ReadSpeedDataset.hxx"
 
 #include <ROOT/TTreeProcessorMT.hxx> // for TTreeProcessorMT::SetTasksPerWorkerHint
 
+#include <algorithm>
 #include <iostream>
+#include <cctype>
 #include <cstring>
+#include <numeric>
+#include <stdexcept>
 
 using namespace ReadSpeed;
 
+namespace {
+std::string CompressionSettingsToString(int settings)
+{
+   if (settings == BranchStats::kMixedCompression)
+      return "mixed";
+   if (settings < 0)
+      return "unknown";
+   // see ROOT::RCompressionSetting::EAlgorithm
+   static const char *algorithms[] = {"default", "zlib", "lzma", "old", "lz4", "zstd"};
+   const auto algorithm = settings / 100;
+   const std::string name = algorithm < 6 ? algorithms[algorithm] : "algorithm " + std::to_string(algorithm);
+   return name + ':' + std::to_string(settings % 100);
+}
+
+// Parse "algorithm:level" (e.g. "zstd:5") into compression settings. Return -1 if the string is not valid.
+int ParseCompressionSettings(const std::string &s)
+{
+   const auto colon = s.find(':');
+   if (colon == std::string::npos)
+      return -1;
+   const auto name = s.substr(0, colon);
+   const auto levelStr = s.substr(colon + 1);
+   if (levelStr.size() != 1 || levelStr[0] < '1' || levelStr[0] > '9')
+      return -1;
+   // see ROOT::RCompressionSetting::EAlgorithm
+   const std::vector<std::pair<std::string, int>> algorithms{{"zlib", 1}, {"lzma", 2}, {"lz4", 4}, {"zstd", 5}};
+   for (const auto &a : algorithms)
+      if (a.first == name)
+         return a.second * 100 + (levelStr[0] - '0');
+   return -1;
+}
+
+// Parse a duration such as "100ms", "2s" or "0.5" (seconds) into seconds. Return -1 if the string is not valid.
+double ParseDuration(const std::string &s)
+{
+   std::size_t end = 0;
+   double value = 0.;
+   try {
+      value = std::stod(s, &end);
+   } catch (const std::exception &) {
+      return -1.;
+   }
+   const auto unit = s.substr(end);
+   if (value < 0.)
+      return -1.;
+   if (unit.empty() || unit == "s")
+      return value;
+   if (unit == "ms")
+      return value / 1000.;
+   return -1.;
+}
+} // namespace
+
 void ReadSpeed::PrintThroughput(const Result &r)
 {
    std::cout << "Thread pool size:\t\t" << r.fThreadPoolSize << '\n';
@@ -22,6 +80,20 @@ void ReadSpeed::PrintThroughput(const Result &r)
    std::cout << "Real time:\t\t\t" << r.fRealTime << " s\n";
    std::cout << "CPU time:\t\t\t" << r.fCpuTime << " s\n";
 
+   std::cout << "Files opened:\t\t\t" << r.fFileOpens << " (" << r.fFileReopens << " re-opened)\n";
+   if (r.fNTasks > 0) {
+      std::cout << "Task setup time:\t\t" << r.fTaskSetupRealTime << " s real, " << r.fTaskSetupCpuTime
+                << " s CPU in total, " << r.fTaskSetupRealTime / r.fNTasks << " s real per task (" << r.fNTasks
+                << " tasks)\n";
+   }
+   const auto &c = r.fCacheStats;
+   std::cout << "Read calls:\t\t\t" << c.fReadCalls;
+   if (c.fReadCalls > 0)
+      std::cout << " (" << r.fCompressedBytesRead / c.fReadCalls << " bytes per call on average)";
+   std::cout << '\n';
+   // nothing is counted when reads bypass the TTreeCache
+   if (c.fCacheHits + c.fCacheMisses > 0)
+      std::cout << "TTreeCache hits/misses:\t\t" << c.fCacheHits << '/' << c.fCacheMisses << " baskets\n";
    std::cout << "Uncompressed data read:\t\t" << r.fUncompressedBytesRead << " bytes\n";
    std::cout << "Compressed data read:\t\t" << r.fCompressedBytesRead << " bytes\n";
 
@@ -33,6 +105,221 @@ void ReadSpeed::PrintThroughput(const Result &r)
    std::cout << "Compressed throughput:\t\t" << r.fCompressedBytesRead / r.fRealTime / 1024 / 1024 << " MB/s\n";
    std::cout << "\t\t\t\t" << r.fCompressedBytesRead / r.fRealTime / 1024 / 1024 / effectiveThreads
              << " MB/s/thread for " << effectiveThreads << " threads\n";
+
+   const auto &mem = r.fMemory;
+   if (mem.fPeakRSS >= 0)
+      std::cout << "Peak resident memory:\t\t" << mem.fPeakRSS / 1024. / 1024. << " MB\n";
+   if (mem.fPeakBasketBytes > 0)
+      std::cout << "Peak basket memory:\t\t" << mem.fPeakBasketBytes / 1024. / 1024. << " MB per thread\n";
+   if (mem.fNAllocations >= 0) {
+      std::cout << "Allocations while reading:\t" << mem.fNAllocations << " (" << mem.fAllocatedBytes << " bytes";
+      if (r.fUncompressedBytesRead > 0)
+         std::cout << ", " << AllocatedBytesPerMB(r) << " bytes per MB read";
+      std::cout << ")\n";
+   }
+
+   const auto &pc = r.fPerfCounters;
+   const auto mbRead = r.fUncompressedBytesRead / 1024. / 1024.;
+   if (pc.fCycles > 0) {
+      std::cout << "Instructions per cycle:\t\t" << InstructionsPerCycle(pc) << " (" << pc.fInstructions
+                << " instructions, " << pc.fCycles << " cycles)\n";
+      if (mbRead > 0.) {
+         std::cout << "LLC misses:\t\t\t" << pc.fLLCMisses / mbRead << " per MB read\n";
+         std::cout << "Branch misses:\t\t\t" << pc.fBranchMisses / mbRead << " per MB read\n";
+      }
+   }
+
+   const auto &proj = r.fProjection;
+   if (proj.fTotalClusters > 0 && proj.fRealTime > 0.) {
+      std::cout << "Sampled " << proj.fSampledClusters << " of " << proj.fTotalClusters << " clusters ("
+                << proj.fSampledEntries << " of " << proj.fTotalEntries << " entries), projection for all of them:\n";
+      std::cout << "  Real time:\t\t\t" << proj.fRealTime << " s (95% CI " << proj.fRealTimeLow << " - "
+                << proj.fRealTimeHigh << " s)\n";
+      const auto toMBps = [&proj](double realTime) {
+         return realTime > 0. ? proj.fUncompressedBytesRead / realTime / 1024 / 1024 : 0.;
+      };
+      std::cout << "  Uncompressed throughput:\t" << toMBps(proj.fRealTime) << " MB/s (95% CI "
+                << toMBps(proj.fRealTimeHigh) << " - " << toMBps(proj.fRealTimeLow) << " MB/s)\n";
+      std::cout << "  Uncompressed data:\t\t" << proj.fUncompressedBytesRead << " bytes\n";
+   }
+
+   if (r.fTrials.size() > 1) {
+      std::vector<double> realTimes;
+      std::vector<double> throughputs;
+      for (const auto &t : r.fTrials) {
+         realTimes.push_back(t.fRealTime);
+         throughputs.push_back(t.fUncompressedBytesRead / t.fRealTime / 1024 / 1024);
+      }
+      auto printSummary = [](const char *name, const SummaryStats &s, const char *unit) {
+         std::cout << name << "mean " << s.fMean << unit << ", stddev " << s.fStdDev << unit << ", min " << s.fMin
+                   << unit << ", median " << s.fMedian << unit << '\n';
+      };
+      std::cout << "Statistics over " << r.fTrials.size() << " trials (the numbers above are from the median one):\n";
+      printSummary("  Real time:\t\t\t", Summarize(realTimes), " s");
+      printSummary("  Uncompressed throughput:\t", Summarize(throughputs), " MB/s");
+   }
+
+   if (r.fTimeSeries.size() > 1) {
+      std::vector<double> throughputs;
+      for (auto i = 1u; i < r.fTimeSeries.size(); ++i) {
+         const auto &prev = r.fTimeSeries[i - 1];
+         const auto &cur = r.fTimeSeries[i];
+         if (cur.fTime > prev.fTime)
+            throughputs.push_back((cur.fUncompressedBytesRead - prev.fUncompressedBytesRead) /
+                                  (cur.fTime - prev.fTime) / 1024 / 1024);
+      }
+      const auto s = Summarize(throughputs);
+      std::cout << "Uncompressed throughput over time (" << throughputs.size() << " intervals):\tmin " << s.fMin
+                << " MB/s, median " << s.fMedian << " MB/s, max " << Percentile(throughputs, 100)
+                << " MB/s (full series in the JSON output)\n";
+   }
+
+   const auto &pipe = r.fPipeline;
+   if (pipe.fDepth > 0) {
+      std::cout << "Pipeline with " << pipe.fNIOThreads << " I/O threads, " << pipe.fNWorkers
+                << " decompressing workers and depth " << pipe.fDepth << " (decompression only, no deserialization):\n";
+      std::cout << "  Fetched tasks queued:\t\t" << pipe.fMeanQueued << " on average, " << pipe.fMaxQueued
+                << " at most\n";
+      std::cout << "  I/O threads waiting:\t\t" << pipe.fIOWaitTime << " s in total (queue full)\n";
+      std::cout << "  Workers waiting:\t\t" << pipe.fWorkerWaitTime << " s in total (queue empty)\n";
+      if (pipe.fWorkerWaitTime > pipe.fIOWaitTime)
+         std::cout << "  Workers mostly wait for data: fetching is the bottleneck, try more --io-threads.\n";
+      else
+         std::cout << "  Fetched data mostly waits for workers: decompression is the bottleneck, try more --threads.\n";
+   }
+
+   const auto &p = r.fPhaseTimes;
+   const auto phasesRealTime = p.fIORealTime + p.fUnzipRealTime + p.fDeserializeRealTime;
+   if (phasesRealTime > 0.) {
+      // In a multi-thread run these are sums over all tasks, so we also report each phase's share of the total
+      auto printPhase = [phasesRealTime, mbRead](const char *name, double realTime, double cpuTime,
+                                                 const PerfCounters &counters) {
+         std::cout << name << realTime << " s real, " << cpuTime << " s CPU (" << 100. * realTime / phasesRealTime
+                   << "% of real time)";
+         if (counters.fCycles > 0 && mbRead > 0.)
+            std::cout << ", IPC " << InstructionsPerCycle(counters) << ", " << counters.fLLCMisses / mbRead
+                      << " LLC misses per MB";
+         std::cout << '\n';
+      };
+      std::cout << "Time per phase (summed over all tasks):\n";
+      printPhase("  Raw I/O:\t\t\t", p.fIORealTime, p.fIOCpuTime, p.fIOCounters);
+      printPhase("  Decompression:\t\t", p.fUnzipRealTime, p.fUnzipCpuTime, p.fUnzipCounters);
+      printPhase("  Deserialization:\t\t", p.fDeserializeRealTime, p.fDeserializeCpuTime, p.fDeserializeCounters);
+   }
+
+   if (!r.fTaskStats.empty()) {
+      std::vector<double> latencies;
+      latencies.reserve(r.fTaskStats.size());
+      for (const auto &t : r.fTaskStats)
+         latencies.push_back(t.fRealTime);
+      std::cout << "Task latency (" << latencies.size() << " tasks):\tp50 " << Percentile(latencies, 50) << " s, p90 "
+                << Percentile(latencies, 90) << " s, p99 " << Percentile(latencies, 99) << " s, max "
+                << Percentile(latencies, 100) << " s\n";
+
+      std::cout << "Per-thread busy time:\n";
+      for (auto threadIdx = 0u; threadIdx < r.fThreadStats.size(); ++threadIdx) {
+         const auto &t = r.fThreadStats[threadIdx];
+         const auto idleFraction = std::max(0., 1. - t.fBusyRealTime / r.fRealTime);
+         std::cout << "  thread " << threadIdx << ":\t\t" << t.fBusyRealTime << " s busy, " << 100. * idleFraction
+                   << "% idle (" << t.fNTasks << " tasks)\n";
+      }
+   }
+
+   if (!r.fNodeStats.empty()) {
+      std::cout << "Per-node breakdown:\n";
+      std::cout << "  Node\tHost\tThreads\tBatches\tBusy time [s]\tIdle [%]\tUncompressed [bytes]\tThroughput [MB/s]\n";
+      for (auto nodeIdx = 0u; nodeIdx < r.fNodeStats.size(); ++nodeIdx) {
+         const auto &n = r.fNodeStats[nodeIdx];
+         double busyTime = 0.;
+         ULong64_t bytesRead = 0;
+         for (const auto &b : n.fBatches) {
+            busyTime += b.fRealTime;
+            bytesRead += b.fUncompressedBytesRead;
+         }
+         const auto idleFraction = std::max(0., 1. - busyTime / r.fRealTime);
+         std::cout << "  " << nodeIdx << '\t' << n.fHostName << '\t' << n.fThreadPoolSize << '\t' << n.fBatches.size()
+                   << '\t' << busyTime << '\t' << 100. * idleFraction << '\t' << bytesRead << '\t'
+                   << bytesRead / r.fRealTime / 1024 / 1024 << '\n';
+      }
+   }
+
+   if (!r.fNumaStats.empty()) {
+      std::cout << "Per-NUMA-node breakdown:\n";
+      std::cout << "  Node\tThreads\tFiles\tTasks\tReal time [s]\tUncompressed [bytes]\tThroughput [MB/s]\t"
+                   "Throughput per thread [MB/s]\n";
+      for (const auto &n : r.fNumaStats) {
+         const auto throughput = n.fRealTime > 0. ? n.fUncompressedBytesRead / n.fRealTime / 1024 / 1024 : 0.;
+         std::cout << "  " << n.fNode << '\t' << n.fNThreads << '\t' << n.fNFiles << '\t' << n.fNTasks << '\t'
+                   << n.fRealTime << '\t' << n.fUncompressedBytesRead << '\t' << throughput << '\t'
+                   << (n.fNThreads > 0 ? throughput / n.fNThreads : 0.) << '\n';
+      }
+   }
+
+   if (!r.fBranchStats.empty()) {
+      // most expensive branches first
+      std::vector<std::pair<std::string, BranchStats>> branches(r.fBranchStats.begin(), r.fBranchStats.end());
+      std::sort(branches.begin(), branches.end(),
+                [](const std::pair<std::string, BranchStats> &a, const std::pair<std::string, BranchStats> &b) {
+                   return a.second.fRealTime > b.second.fRealTime;
+                });
+      const auto totalBranchTime = std::accumulate(
+         branches.begin(), branches.end(), 0.,
+         [](double sum, const std::pair<std::string, BranchStats> &b) { return sum + b.second.fRealTime; });
+      std::cout << "Per-branch breakdown (summed over all tasks, most expensive first):\n";
+      std::cout << "  Branch\tTime [s]\tTime [%]\tUncompressed [bytes]\tCompressed [bytes]\tRatio\tCompression\t"
+                   "Baskets\tThroughput [MB/s]\n";
+      for (const auto &b : branches) {
+         const auto &s = b.second;
+         const auto ratio = s.fCompressedBytes > 0 ? double(s.fUncompressedBytesRead) / s.fCompressedBytes : 0.;
+         const auto throughput = s.fRealTime > 0. ? s.fUncompressedBytesRead / s.fRealTime / 1024 / 1024 : 0.;
+         std::cout << "  " << b.first << '\t' << s.fRealTime << '\t'
+                   << (totalBranchTime > 0. ? 100. * s.fRealTime / totalBranchTime : 0.) << '\t'
+                   << s.fUncompressedBytesRead << '\t' << s.fCompressedBytes << '\t' << ratio << '\t'
+                   << CompressionSettingsToString(s.fCompressionSettings) << '\t' << s.fNBaskets << '\t' << throughput
+                   << '\n';
+      }
+   }
+}
+
+void ReadSpeed::PrintScaling(const std::vector<Result> &results)
+{
+   if (results.empty())
+      return;
+
+   const auto stRealTime = results[0].fRealTime;
+   std::cout << "Threads\tReal time [s]\tThroughput [MB/s]\tSpeedup\tEfficiency\n";
+   for (const auto &r : results) {
+      const auto effectiveThreads = std::max(r.fThreadPoolSize, 1u);
+      const auto speedup = stRealTime / r.fRealTime;
+      std::cout << (r.fThreadPoolSize == 0 ? std::string("ST") : std::to_string(r.fThreadPoolSize)) << '\t'
+                << r.fRealTime << "\t\t" << r.fUncompressedBytesRead / r.fRealTime / 1024 / 1024 << "\t\t\t" << speedup
+                << '\t' << speedup / effectiveThreads << '\n';
+   }
+}
+
+void ReadSpeed::PrintRecompression(const std::vector<RecompressionResult> &results)
+{
+   if (results.empty())
+      return;
+
+   std::cout << "Compression\tSize [bytes]\tRatio\tCompression [MB/s, 1 thread]";
+   for (const auto &d : results.front().fDecompression)
+      std::cout << "\tDecompression [MB/s, "
+                << (d.fThreadPoolSize == 0 ? std::string("ST") : std::to_string(d.fThreadPoolSize) + " threads") << ']';
+   std::cout << '\n';
+   for (const auto &r : results) {
+      const auto ratio = r.fCompressedBytes > 0 ? double(r.fUncompressedBytes) / r.fCompressedBytes : 0.;
+      const auto name =
+         r.fCompressionSettings < 0 ? std::string("as stored") : CompressionSettingsToString(r.fCompressionSettings);
+      std::cout << name << '\t' << r.fCompressedBytes << '\t' << ratio << '\t';
+      if (r.fCompressRealTime > 0.)
+         std::cout << r.fUncompressedBytes / r.fCompressRealTime / 1024 / 1024;
+      else
+         std::cout << '-';
+      for (const auto &d : r.fDecompression)
+         std::cout << '\t' << d.fUncompressedBytesRead / d.fRealTime / 1024 / 1024;
+      std::cout << '\n';
+   }
 }
 
 Args ReadSpeed::ParseArgs(const std::vector<std::string> &args)
@@ -40,19 +327,76 @@ Args ReadSpeed::ParseArgs(const std::vector<std::string> &args)
    // Print help message and exit if "--help"
    if (args.size() < 2 || (args.size() == 2 && (args[1] == "--help" || args[1] == "-h"))) {
       std::cout << "Usage:\n"
-                << "  root-readspeed --trees tname1 [tname2 ...]\n"
-                << "                 --files fname1 [fname2 ...]\n"
-                << "                 (--all-branches | --branches bname1 [bname2 ...] | --branches-regex bregex1 "
-                   "[bregex2 ...])\n"
-                << "                 [--threads nthreads]\n"
+                << "  root-readspeed (--trees tname1 [tname2 ...] --files fname1 [fname2 ...] |\n"
+                << "                  --dataset datasetfile)\n"
+                << "                 [--all-branches | --branches bname1 [bname2 ...] | --branches-regex bregex1 "
+                   "[bregex2 ...]]\n"
+                << "                 [--format (ttree|rntuple)]\n"
+                << "                 [--threads nthreads | --threads-sweep n1,n2,...] [--phases]\n"
+                << "                 [--index indexfile] [--scheduler (mapreduce|steal)]\n"
+                << "                 [--partition (bytes|clusters)] [--pin (cores|numa)]\n"
+                << "                 [--open-files-per-thread nfiles] [--bulk]\n"
+                << "                 [--read-order (entry-major|branch-major)]\n"
+                << "                 [--cache-size bytes] [--cache-learn-entries nentries] [--cache-add-branches]\n"
+                << "                 [--async-prefetch] [--per-branch] [--output (text|json|csv)]\n"
+                << "                 [--repeat ntrials] [--warmup ntrials] [--drop-cache] [--raw-io]\n"
+                << "                 [--unzip-only | --try-compression alg1:level1,alg2:level2,...]\n"
+                << "                 [--memory-limit megabytes]\n"
+                << "                 [--entries start:end] [--max-entries-per-file nentries]\n"
+                << "                 [--sample-clusters (fraction|nclusters)] [--sample-seed seed]\n"
+                << "                 [--sample-interval interval[ms|s]]\n"
+                << "                 [--pipeline depth [--io-threads nthreads]] [--perf-counters]\n"
+                << "                 [--coordinator port --workers nworkers | --worker host:port]\n"
                 << "  root-readspeed (--help|-h)\n";
       return {};
    }
 
    Data d;
    unsigned int nThreads = 0;
+   std::vector<unsigned int> threadsSweep;
+   Options opts;
+   EOutputFormat outputFormat = EOutputFormat::kText;
+   int coordinatorPort = 0;
+   unsigned int nWorkers = 0;
+   std::string coordinatorHost;
+   int workerPort = 0;
+   std::string datasetFile;
+   bool formatGiven = false;
 
-   enum class EArgState { kNone, kTrees, kFiles, kBranches, kThreads, kTasksPerWorkerHint } argState = EArgState::kNone;
+   enum class EArgState {
+      kNone,
+      kTrees,
+      kFiles,
+      kDataset,
+      kBranches,
+      kFormat,
+      kThreads,
+      kThreadsSweep,
+      kTasksPerWorkerHint,
+      kIndex,
+      kScheduler,
+      kPartition,
+      kPin,
+      kOpenFilesPerThread,
+      kReadOrder,
+      kCacheSize,
+      kCacheLearnEntries,
+      kOutput,
+      kRepeat,
+      kWarmup,
+      kMemoryLimit,
+      kTryCompression,
+      kEntries,
+      kMaxEntriesPerFile,
+      kSampleClusters,
+      kSampleSeed,
+      kSampleInterval,
+      kPipeline,
+      kIOThreads,
+      kCoordinator,
+      kWorkers,
+      kWorker
+   } argState = EArgState::kNone;
    enum class EBranchState { kNone, kRegular, kRegex, kAll } branchState = EBranchState::kNone;
    const auto branchOptionsErrMsg =
       "Options --all-branches, --branches, and --branches-regex are mutually exclusive. You can use only one.\n";
@@ -64,6 +408,8 @@ Args ReadSpeed::ParseArgs(const std::vector<std::string> &args)
          argState = EArgState::kTrees;
       } else if (arg == "--files") {
          argState = EArgState::kFiles;
+      } else if (arg == "--dataset") {
+         argState = EArgState::kDataset;
       } else if (arg == "--all-branches") {
          argState = EArgState::kNone;
          if (branchState != EBranchState::kNone && branchState != EBranchState::kAll) {
@@ -88,10 +434,87 @@ Args ReadSpeed::ParseArgs(const std::vector<std::string> &args)
          }
          branchState = EBranchState::kRegex;
          d.fUseRegex = true;
+      } else if (arg == "--format") {
+         argState = EArgState::kFormat;
       } else if (arg == "--threads") {
          argState = EArgState::kThreads;
+      } else if (arg == "--threads-sweep") {
+         argState = EArgState::kThreadsSweep;
       } else if (arg == "--tasks-per-worker") {
          argState = EArgState::kTasksPerWorkerHint;
+      } else if (arg == "--index") {
+         argState = EArgState::kIndex;
+      } else if (arg == "--scheduler") {
+         argState = EArgState::kScheduler;
+      } else if (arg == "--partition") {
+         argState = EArgState::kPartition;
+      } else if (arg == "--pin") {
+         argState = EArgState::kPin;
+      } else if (arg == "--open-files-per-thread") {
+         argState = EArgState::kOpenFilesPerThread;
+      } else if (arg == "--read-order") {
+         argState = EArgState::kReadOrder;
+      } else if (arg == "--cache-size") {
+         argState = EArgState::kCacheSize;
+      } else if (arg == "--cache-learn-entries") {
+         argState = EArgState::kCacheLearnEntries;
+      } else if (arg == "--cache-add-branches") {
+         argState = EArgState::kNone;
+         opts.fCacheAddBranches = true;
+      } else if (arg == "--async-prefetch") {
+         argState = EArgState::kNone;
+         opts.fAsyncPrefetch = true;
+      } else if (arg == "--repeat") {
+         argState = EArgState::kRepeat;
+      } else if (arg == "--warmup") {
+         argState = EArgState::kWarmup;
+      } else if (arg == "--drop-cache") {
+         argState = EArgState::kNone;
+         opts.fDropCache = true;
+      } else if (arg == "--output") {
+         argState = EArgState::kOutput;
+      } else if (arg == "--per-branch") {
+         argState = EArgState::kNone;
+         opts.fPerBranch = true;
+      } else if (arg == "--unzip-only") {
+         argState = EArgState::kNone;
+         opts.fUnzipOnly = true;
+      } else if (arg == "--try-compression") {
+         argState = EArgState::kTryCompression;
+      } else if (arg == "--memory-limit") {
+         argState = EArgState::kMemoryLimit;
+      } else if (arg == "--entries") {
+         argState = EArgState::kEntries;
+      } else if (arg == "--max-entries-per-file") {
+         argState = EArgState::kMaxEntriesPerFile;
+      } else if (arg == "--sample-clusters") {
+         argState = EArgState::kSampleClusters;
+      } else if (arg == "--sample-seed") {
+         argState = EArgState::kSampleSeed;
+      } else if (arg == "--sample-interval") {
+         argState = EArgState::kSampleInterval;
+      } else if (arg == "--pipeline") {
+         argState = EArgState::kPipeline;
+      } else if (arg == "--io-threads") {
+         argState = EArgState::kIOThreads;
+      } else if (arg == "--perf-counters") {
+         argState = EArgState::kNone;
+         opts.fPerfCounters = true;
+      } else if (arg == "--coordinator") {
+         argState = EArgState::kCoordinator;
+      } else if (arg == "--workers") {
+         argState = EArgState::kWorkers;
+      } else if (arg == "--worker") {
+         argState = EArgState::kWorker;
+      } else if (arg == "--raw-io") {
+         argState = EArgState::kNone;
+         opts.fRawIO = true;
+      } else if (arg == "--bulk") {
+         argState = EArgState::kNone;
+         opts.fBulkRead = true;
+      } else if (arg == "--phases") {
+         argState = EArgState::kNone;
+         opts.fSplitPhases = true;
       } else if (arg[0] == '-') {
          std::cerr << "Unrecognized option '" << arg << "'\n";
          return {};
@@ -104,16 +527,364 @@ Args ReadSpeed::ParseArgs(const std::vector<std::string> &args)
             nThreads = std::stoi(arg);
             argState = EArgState::kNone;
             break;
+         case EArgState::kThreadsSweep: {
+            // every entry between commas counts, so that empty ones (e.g. a trailing comma) are rejected too
+            std::size_t start = 0;
+            while (start <= arg.size()) {
+               const auto end = std::min(arg.find(',', start), arg.size());
+               const auto entry = arg.substr(start, end - start);
+               const bool isNumber =
+                  !entry.empty() && entry.size() < 10 &&
+                  std::all_of(entry.begin(), entry.end(), [](unsigned char c) { return std::isdigit(c); });
+               if (!isNumber || std::stoul(entry) == 0) {
+                  std::cerr << "Invalid entry '" << entry
+                            << "' passed to --threads-sweep, it must be a comma-separated list of numbers of threads, "
+                               "each at least 1.\n";
+                  return {};
+               }
+               threadsSweep.push_back(std::stoul(entry));
+               start = end + 1;
+            }
+            argState = EArgState::kNone;
+            break;
+         }
          case EArgState::kTasksPerWorkerHint:
             ROOT::TTreeProcessorMT::SetTasksPerWorkerHint(std::stoi(arg));
             argState = EArgState::kNone;
             break;
+         case EArgState::kDataset:
+            datasetFile = arg;
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kIndex:
+            opts.fIndexFile = arg;
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kScheduler:
+            if (arg == "mapreduce") {
+               opts.fScheduler = EScheduler::kNestedMapReduce;
+            } else if (arg == "steal") {
+               opts.fScheduler = EScheduler::kWorkStealing;
+            } else {
+               std::cerr << "Unrecognized scheduler '" << arg << "', valid values are 'mapreduce' and 'steal'\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kPartition:
+            if (arg == "bytes") {
+               opts.fPartition = EPartition::kBytes;
+            } else if (arg == "clusters") {
+               opts.fPartition = EPartition::kClusters;
+            } else {
+               std::cerr << "Unrecognized partitioning '" << arg << "', valid values are 'bytes' and 'clusters'\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kPin:
+            if (arg == "cores") {
+               opts.fPin = EPin::kCores;
+            } else if (arg == "numa") {
+               opts.fPin = EPin::kNuma;
+            } else {
+               std::cerr << "Unrecognized pinning '" << arg << "', valid values are 'cores' and 'numa'\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kOpenFilesPerThread:
+            opts.fOpenFilesPerThread = std::stoi(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kCacheSize:
+            opts.fCacheSize = std::stoll(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kCacheLearnEntries:
+            opts.fCacheLearnEntries = std::stoi(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kTryCompression: {
+            std::size_t start = 0;
+            while (start < arg.size()) {
+               const auto end = std::min(arg.find(',', start), arg.size());
+               const auto setting = arg.substr(start, end - start);
+               const auto settings = ParseCompressionSettings(setting);
+               if (settings < 0) {
+                  std::cerr << "Unrecognized compression setting '" << setting
+                            << "', valid values are 'zlib', 'lzma', 'lz4' or 'zstd' followed by ':' and a level "
+                               "between 1 and 9\n";
+                  return {};
+               }
+               opts.fTryCompression.push_back(settings);
+               start = end + 1;
+            }
+            argState = EArgState::kNone;
+            break;
+         }
+         case EArgState::kMemoryLimit:
+            opts.fMemoryLimit = std::stoull(arg) * 1024 * 1024;
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kEntries: {
+            const auto colon = arg.find(':');
+            if (colon == std::string::npos) {
+               std::cerr << "Unrecognized entry range '" << arg << "', the format is 'start:end'\n";
+               return {};
+            }
+            // either bound can be omitted, e.g. "1000:" reads from entry 1000 to the end of each file
+            const auto start = arg.substr(0, colon);
+            const auto end = arg.substr(colon + 1);
+            opts.fEntries = {start.empty() ? 0 : std::stoll(start), end.empty() ? -1 : std::stoll(end)};
+            argState = EArgState::kNone;
+            break;
+         }
+         case EArgState::kMaxEntriesPerFile:
+            opts.fMaxEntriesPerFile = std::stoll(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kSampleClusters:
+            opts.fSampleClusters = std::stod(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kSampleSeed:
+            opts.fSampleSeed = std::stoul(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kSampleInterval:
+            opts.fSampleInterval = ParseDuration(arg);
+            if (opts.fSampleInterval <= 0.) {
+               std::cerr << "Invalid sampling interval '" << arg
+                         << "', it must be a positive number of seconds, optionally followed by 's' or 'ms'\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kPipeline:
+            opts.fPipelineDepth = std::stoul(arg);
+            if (opts.fPipelineDepth == 0) {
+               std::cerr << "The depth passed to --pipeline must be at least 1.\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kIOThreads:
+            opts.fIOThreads = std::stoul(arg);
+            if (opts.fIOThreads == 0) {
+               std::cerr << "The number passed to --io-threads must be at least 1.\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kCoordinator:
+            coordinatorPort = std::stoi(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kWorkers:
+            nWorkers = std::stoi(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kWorker: {
+            const auto colon = arg.rfind(':');
+            if (colon == std::string::npos || colon == 0 || colon + 1 == arg.size()) {
+               std::cerr << "Unrecognized coordinator address '" << arg << "', the format is 'host:port'\n";
+               return {};
+            }
+            coordinatorHost = arg.substr(0, colon);
+            workerPort = std::stoi(arg.substr(colon + 1));
+            argState = EArgState::kNone;
+            break;
+         }
+         case EArgState::kRepeat:
+            opts.fRepeat = std::stoi(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kWarmup:
+            opts.fWarmup = std::stoi(arg);
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kOutput:
+            if (arg == "text") {
+               outputFormat = EOutputFormat::kText;
+            } else if (arg == "json") {
+               outputFormat = EOutputFormat::kJSON;
+            } else if (arg == "csv") {
+               outputFormat = EOutputFormat::kCSV;
+            } else {
+               std::cerr << "Unrecognized output format '" << arg << "', valid values are 'text', 'json' and 'csv'\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kFormat:
+            if (arg == "ttree") {
+               d.fFormat = EFormat::kTTree;
+            } else if (arg == "rntuple") {
+               d.fFormat = EFormat::kRNTuple;
+            } else {
+               std::cerr << "Unrecognized format '" << arg << "', valid values are 'ttree' and 'rntuple'\n";
+               return {};
+            }
+            formatGiven = true;
+            argState = EArgState::kNone;
+            break;
+         case EArgState::kReadOrder:
+            if (arg == "entry-major") {
+               opts.fReadOrder = EReadOrder::kEntryMajor;
+            } else if (arg == "branch-major") {
+               opts.fReadOrder = EReadOrder::kBranchMajor;
+            } else {
+               std::cerr << "Unrecognized read order '" << arg
+                         << "', valid values are 'entry-major' and 'branch-major'\n";
+               return {};
+            }
+            argState = EArgState::kNone;
+            break;
          default: std::cerr << "Unrecognized option '" << arg << "'\n"; return {};
          }
       }
    }
 
-   return Args{std::move(d), nThreads, branchState == EBranchState::kAll, /*fShouldRun=*/true};
+   if (!datasetFile.empty()) {
+      if (!d.fTreeNames.empty() || !d.fFileNames.empty()) {
+         std::cerr << "Option --dataset cannot be used together with --trees or --files.\n";
+         return {};
+      }
+      Data dataset;
+      try {
+         dataset = LoadDatasetFile(datasetFile);
+      } catch (const std::runtime_error &e) {
+         std::cerr << e.what() << '\n';
+         return {};
+      }
+      // branches and format given on the command line take precedence over those in the dataset file
+      if (branchState != EBranchState::kNone) {
+         dataset.fBranchNames = std::move(d.fBranchNames);
+         dataset.fUseRegex = d.fUseRegex;
+      } else if (dataset.fUseRegex && dataset.fBranchNames == std::vector<std::string>{".*"}) {
+         branchState = EBranchState::kAll;
+      }
+      if (formatGiven)
+         dataset.fFormat = d.fFormat;
+      d = std::move(dataset);
+   }
+
+   if (opts.fBulkRead && opts.fSplitPhases) {
+      std::cerr << "Options --bulk and --phases are mutually exclusive. You can use only one.\n";
+      return {};
+   }
+
+   if (!opts.fTryCompression.empty() &&
+       (opts.fUnzipOnly || opts.fRawIO || opts.fBulkRead || opts.fSplitPhases || opts.fPerBranch ||
+        opts.fReadOrder == EReadOrder::kBranchMajor || opts.fRepeat > 1 || opts.fWarmup > 0 ||
+        outputFormat != EOutputFormat::kText)) {
+      std::cerr << "Option --try-compression cannot be used together with other read modes, --per-branch, "
+                   "--read-order, --repeat, --warmup or --output.\n";
+      return {};
+   }
+
+   const bool selectsEntries = opts.fEntries.fStart >= 0 || opts.fEntries.fEnd >= 0 || opts.fMaxEntriesPerFile >= 0 ||
+                               opts.fSampleClusters > 0.;
+   if (selectsEntries && (opts.fUnzipOnly || !opts.fTryCompression.empty())) {
+      std::cerr << "Options --entries, --max-entries-per-file and --sample-clusters cannot be used together with "
+                   "--unzip-only or --try-compression.\n";
+      return {};
+   }
+
+   if (opts.fSampleInterval > 0. && (opts.fUnzipOnly || !opts.fTryCompression.empty())) {
+      std::cerr << "Option --sample-interval cannot be used together with --unzip-only or --try-compression.\n";
+      return {};
+   }
+
+   if (opts.fEntries.fEnd >= 0 && opts.fEntries.fEnd <= opts.fEntries.fStart) {
+      std::cerr << "The range passed to --entries must contain at least one entry.\n";
+      return {};
+   }
+
+   if (opts.fUnzipOnly && (opts.fRawIO || opts.fBulkRead || opts.fSplitPhases || opts.fPerBranch ||
+                           opts.fReadOrder == EReadOrder::kBranchMajor)) {
+      std::cerr << "Option --unzip-only cannot be used together with --raw-io, --bulk, --phases, --per-branch or "
+                   "--read-order.\n";
+      return {};
+   }
+
+   if (opts.fRawIO &&
+       (opts.fBulkRead || opts.fSplitPhases || opts.fPerBranch || opts.fReadOrder == EReadOrder::kBranchMajor)) {
+      std::cerr << "Option --raw-io cannot be used together with --bulk, --phases, --per-branch or --read-order.\n";
+      return {};
+   }
+
+   if (opts.fReadOrder == EReadOrder::kBranchMajor && (opts.fBulkRead || opts.fSplitPhases)) {
+      std::cerr << "Option --read-order branch-major cannot be used together with --bulk or --phases.\n";
+      return {};
+   }
+
+   if (opts.fPerBranch && (opts.fBulkRead || opts.fSplitPhases)) {
+      std::cerr << "Option --per-branch cannot be used together with --bulk or --phases.\n";
+      return {};
+   }
+
+   if (opts.fCacheSize == 0 && (opts.fCacheAddBranches || opts.fAsyncPrefetch || opts.fCacheLearnEntries > 0)) {
+      std::cerr << "Options --cache-add-branches, --cache-learn-entries and --async-prefetch require a TTreeCache, "
+                   "but --cache-size 0 disables it.\n";
+      return {};
+   }
+
+   if ((coordinatorPort > 0) != (nWorkers > 0)) {
+      std::cerr << "Options --coordinator and --workers must be used together.\n";
+      return {};
+   }
+
+   const bool distributed = coordinatorPort > 0 || !coordinatorHost.empty();
+   if (coordinatorPort > 0 && !coordinatorHost.empty()) {
+      std::cerr << "Options --coordinator and --worker are mutually exclusive. You can use only one.\n";
+      return {};
+   }
+
+   if (distributed && (!threadsSweep.empty() || opts.fRepeat > 1 || opts.fWarmup > 0 || opts.fUnzipOnly ||
+                       !opts.fTryCompression.empty() || opts.fSampleClusters > 0. || opts.fSampleInterval > 0.)) {
+      std::cerr << "Options --coordinator and --worker cannot be used together with --threads-sweep, --repeat, "
+                   "--warmup, --unzip-only, --try-compression, --sample-clusters or --sample-interval.\n";
+      return {};
+   }
+
+   if (nThreads > 0 && !threadsSweep.empty()) {
+      std::cerr << "Options --threads and --threads-sweep are mutually exclusive. You can use only one.\n";
+      return {};
+   }
+
+   if (opts.fPerfCounters && (opts.fUnzipOnly || !opts.fTryCompression.empty() || opts.fPipelineDepth > 0)) {
+      std::cerr << "Option --perf-counters cannot be used together with --unzip-only, --try-compression or "
+                   "--pipeline.\n";
+      return {};
+   }
+
+   if (opts.fIOThreads != 1 && opts.fPipelineDepth == 0) {
+      std::cerr << "Option --io-threads requires --pipeline.\n";
+      return {};
+   }
+
+   if (opts.fPipelineDepth > 0 &&
+       (nThreads == 0 || opts.fRawIO || opts.fBulkRead || opts.fSplitPhases || opts.fPerBranch ||
+        opts.fReadOrder == EReadOrder::kBranchMajor || opts.fUnzipOnly || !opts.fTryCompression.empty() ||
+        opts.fSampleClusters > 0. || opts.fPin != EPin::kNone)) {
+      std::cerr << "Option --pipeline requires --threads, and cannot be used together with other read modes, "
+                   "--per-branch, --read-order, --sample-clusters or --pin.\n";
+      return {};
+   }
+
+   // the checks that depend on the format and the friend trees are shared with the library
+   try {
+      ValidateOptions(d, opts);
+   } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << '\n';
+      return {};
+   }
+
+   return Args{std::move(d), nThreads, std::move(threadsSweep), branchState == EBranchState::kAll,
+               /*fShouldRun=*/true, opts, outputFormat, coordinatorPort, nWorkers, std::move(coordinatorHost),
+               workerPort};
 }
 
 Args ReadSpeed::ParseArgs(int argc, char **argv)
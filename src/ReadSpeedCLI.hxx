@@ -5,18 +5,37 @@
    for CLI related actions, such as argument parsing and output printing. */
 
 #include "ReadSpeed.hxx"
+#include "ReadSpeedOutput.hxx"
 
+#include <string>
 #include <vector>
 
 namespace ReadSpeed {
 
 void PrintThroughput(const Result &r);
 
+// Print a table of throughput, speedup and parallel efficiency for the results of EvalThroughputScaling.
+void PrintScaling(const std::vector<Result> &results);
+
+// Print compressed size, compression ratio and throughput, and decompression throughput for each thread count of the
+// results of EvalRecompression.
+void PrintRecompression(const std::vector<RecompressionResult> &results);
+
 struct Args {
    Data fData;
    unsigned int fNThreads = 0;
+   /// If not empty, run a thread-count scaling sweep with these numbers of threads instead of a single run.
+   std::vector<unsigned int> fThreadsSweep;
    bool fAllBranches = false;
    bool fShouldRun = false;
+   Options fOptions;
+   EOutputFormat fOutputFormat = EOutputFormat::kText;
+   /// If not 0, run as the coordinator of a distributed run with fNWorkers workers, listening on this port.
+   int fCoordinatorPort = 0;
+   unsigned int fNWorkers = 0;
+   /// If not empty, run as a worker of the distributed run coordinated at this host, on port fWorkerPort.
+   std::string fCoordinatorHost;
+   int fWorkerPort = 0;
 };
 
 Args ParseArgs(const std::vector<std::string> &args);
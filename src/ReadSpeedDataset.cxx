@@ -0,0 +1,133 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+#include "ReadSpeedDataset.hxx"
+
+#include <glob.h> // for glob
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace ReadSpeed;
+
+std::vector<std::string> ReadSpeed::ExpandFilePattern(const std::string &pattern)
+{
+   if (pattern.find("://") != std::string::npos || pattern.find_first_of("*?[") == std::string::npos)
+      return {pattern};
+
+   glob_t matches;
+   const int ret = glob(pattern.c_str(), 0, nullptr, &matches);
+   std::vector<std::string> fileNames;
+   if (ret == 0)
+      fileNames.assign(matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+   globfree(&matches);
+
+   if (ret == GLOB_NOMATCH || (ret == 0 && fileNames.empty()))
+      throw std::runtime_error("Pattern '" + pattern + "' does not match any file");
+   if (ret != 0)
+      throw std::runtime_error("Could not expand pattern '" + pattern + '\'');
+   return fileNames;
+}
+
+Data ReadSpeed::LoadDatasetFile(const std::string &path)
+{
+   std::ifstream in(path);
+   if (!in)
+      throw std::runtime_error("Could not open dataset file '" + path + '\'');
+
+   Data d;
+   std::vector<std::string> treeNames;
+   std::vector<std::string> fileNames;
+   std::string branchKey;
+   std::string line;
+   for (int lineNumber = 1; std::getline(in, line); ++lineNumber) {
+      std::istringstream tokens(line);
+      std::string key;
+      if (!(tokens >> key) || key[0] == '#')
+         continue;
+      std::vector<std::string> values;
+      for (std::string value; tokens >> value;)
+         values.emplace_back(std::move(value));
+      const auto malformed = [&](const std::string &reason) {
+         return std::runtime_error("Malformed line " + std::to_string(lineNumber) + " in dataset file '" + path +
+                                   "': " + reason);
+      };
+      const auto expand = [&](std::vector<std::string>::const_iterator first, std::vector<std::string> &into) {
+         for (auto it = first; it != values.end(); ++it) {
+            try {
+               const auto matches = ExpandFilePattern(*it);
+               into.insert(into.end(), matches.begin(), matches.end());
+            } catch (const std::runtime_error &e) {
+               throw malformed(e.what());
+            }
+         }
+      };
+
+      if (key == "trees") {
+         if (values.empty())
+            throw malformed("no tree names");
+         treeNames.insert(treeNames.end(), values.begin(), values.end());
+      } else if (key == "files") {
+         if (values.empty())
+            throw malformed("no file names");
+         expand(values.begin(), fileNames);
+      } else if (key == "friend") {
+         if (values.empty())
+            throw malformed("no friend tree name");
+         d.fFriends.push_back({values.front(), {}});
+         expand(values.begin() + 1, d.fFriends.back().fFileNames);
+      } else if (key == "branches" || key == "branches-regex" || key == "all-branches") {
+         if (!branchKey.empty() && branchKey != key)
+            throw malformed("only one of branches, branches-regex and all-branches can be used");
+         branchKey = key;
+         if (key == "all-branches") {
+            if (!values.empty())
+               throw malformed("all-branches takes no values");
+            d.fBranchNames = {".*"};
+         } else {
+            if (values.empty())
+               throw malformed("no branch names");
+            d.fBranchNames.insert(d.fBranchNames.end(), values.begin(), values.end());
+         }
+         d.fUseRegex = key != "branches";
+      } else if (key == "format") {
+         if (values.size() != 1 || (values[0] != "ttree" && values[0] != "rntuple"))
+            throw malformed("the format must be either 'ttree' or 'rntuple'");
+         d.fFormat = values[0] == "rntuple" ? EFormat::kRNTuple : EFormat::kTTree;
+      } else {
+         throw malformed("unknown key '" + key + '\'');
+      }
+   }
+
+   if (treeNames.empty())
+      throw std::runtime_error("Dataset file '" + path + "' does not list any tree");
+   if (fileNames.empty())
+      throw std::runtime_error("Dataset file '" + path + "' does not list any file");
+   for (const auto &fr : d.fFriends)
+      if (!fr.fFileNames.empty() && fr.fFileNames.size() != fileNames.size())
+         throw std::runtime_error("Friend tree '" + fr.fTreeName + "' in dataset file '" + path + "' has " +
+                                  std::to_string(fr.fFileNames.size()) + " files, but the dataset has " +
+                                  std::to_string(fileNames.size()));
+
+   if (treeNames.size() == 1) {
+      d.fTreeNames = std::move(treeNames);
+      d.fFileNames = std::move(fileNames);
+      return d;
+   }
+
+   // one entry per file and tree, with the trees of a file next to each other so that threads can reuse the file
+   for (auto &fr : d.fFriends) {
+      std::vector<std::string> friendFileNames;
+      for (const auto &friendFileName : fr.fFileNames)
+         friendFileNames.insert(friendFileNames.end(), treeNames.size(), friendFileName);
+      fr.fFileNames = std::move(friendFileNames);
+   }
+   for (const auto &fileName : fileNames) {
+      for (const auto &treeName : treeNames) {
+         d.fFileNames.emplace_back(fileName);
+         d.fTreeNames.emplace_back(treeName);
+      }
+   }
+   return d;
+}
@@ -0,0 +1,36 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* This header contains helper functions to describe a dataset in a text file rather than on the command line, which
+   allows datasets with many trees per file, friend trees and file lists too long for a command line. */
+
+#ifndef ROOTREADSPEEDDATASET
+#define ROOTREADSPEEDDATASET
+
+#include "ReadSpeed.hxx"
+
+#include <string>
+#include <vector>
+
+namespace ReadSpeed {
+
+// Expand a glob pattern (see glob(7)) into the sorted list of matching files. Patterns without wildcards and URLs
+// (e.g. "root://host//path/file.root") are returned as they are. Throws if a pattern matches no file.
+std::vector<std::string> ExpandFilePattern(const std::string &pattern);
+
+// Load the dataset described by a dataset file. Every line is a key followed by whitespace-separated values; empty
+// lines and lines starting with '#' are ignored:
+//
+//    trees tname1 [tname2 ...]          trees to read from every file
+//    files pattern1 [pattern2 ...]      files, or glob patterns of files: can be repeated
+//    friend fname [pattern1 ...]        a friend tree, in one file per main file or, without files, in the same files
+//    branches bname1 [bname2 ...]       or branches-regex bregex1 [bregex2 ...], or all-branches
+//    format (ttree|rntuple)
+//
+// If several trees are listed, each file appears once per tree in the returned Data, with the file's friends.
+// No file is opened: layouts are retrieved when the dataset is read, as for datasets given on the command line.
+Data LoadDatasetFile(const std::string &path);
+
+} // namespace ReadSpeed
+
+#endif // ROOTREADSPEEDDATASET
@@ -0,0 +1,342 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+#include "ReadSpeedDistributed.hxx"
+#include "ReadSpeedOutput.hxx" // for HashFileList
+
+#include <ROOT/TThreadExecutor.hxx>
+#include <ROOT/TTreeProcessorMT.hxx> // for TTreeProcessorMT::GetTasksPerWorkerHint
+#include <TMessage.h>
+#include <TMonitor.h>
+#include <TServerSocket.h>
+#include <TSocket.h>
+#include <TStopwatch.h>
+#include <TSystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath> // std::ceil
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread> // std::this_thread::sleep_for
+
+using namespace ReadSpeed;
+
+namespace {
+// Types of the messages exchanged by coordinator and workers, away from the ones ROOT uses internally.
+enum EMessage : UInt_t {
+   /// Worker to coordinator, on connection: host name, thread pool size and hash of the list of files.
+   kHello = kMESS_ANY + 3000,
+   /// Coordinator to worker: number of tasks, then file index, first and last entry of each task.
+   kBatch,
+   /// Worker to coordinator: real and CPU time, number of tasks, bytes read, file opens and task setup times of the
+   /// last batch, followed by the statistics written by WriteBatchStats.
+   kBatchDone,
+   /// Coordinator to worker: there are no tasks left.
+   kDone
+};
+
+// How long workers keep trying to connect to a coordinator that is not listening yet.
+constexpr std::chrono::seconds kConnectTimeout{60};
+
+void Send(TSocket &s, const TMessage &m, const std::string &peer)
+{
+   if (s.Send(m) <= 0)
+      throw std::runtime_error("Could not send a message to " + peer);
+}
+
+std::unique_ptr<TMessage> Receive(TSocket &s, const std::string &peer)
+{
+   TMessage *m = nullptr;
+   if (s.Recv(m) <= 0 || m == nullptr) {
+      delete m;
+      throw std::runtime_error("Lost connection to " + peer);
+   }
+   return std::unique_ptr<TMessage>(m);
+}
+
+std::unique_ptr<TMessage> Receive(TSocket &s, const std::string &peer, EMessage expected)
+{
+   auto m = Receive(s, peer);
+   if (m->What() != expected)
+      throw std::runtime_error("Unexpected message of type " + std::to_string(m->What()) + " from " + peer);
+   return m;
+}
+
+struct Task {
+   unsigned int fFileIdx;
+   EntryRange fRange;
+};
+
+// Distributed runs read batches of tasks and only collect the statistics that can be summed over batches and workers.
+void ValidateDistributedOptions(const Data &d, const Options &opts)
+{
+   ValidateData(d, opts);
+   if (opts.fRepeat > 1 || opts.fWarmup > 0 || opts.fUnzipOnly || !opts.fTryCompression.empty() ||
+       opts.fSampleClusters > 0. || opts.fSampleInterval > 0.)
+      throw std::runtime_error("Distributed runs cannot be used together with repeated or warm-up trials, "
+                               "decompression-only runs, recompression, cluster sampling or time series sampling");
+}
+
+// Write the statistics of the batch read in r that AddBatchStats sums on the coordinator.
+void WriteBatchStats(TMessage &m, const Result &r)
+{
+   const auto &p = r.fPhaseTimes;
+   m << p.fIORealTime << p.fIOCpuTime << p.fUnzipRealTime << p.fUnzipCpuTime << p.fDeserializeRealTime
+     << p.fDeserializeCpuTime;
+   for (const auto *c : {&p.fIOCounters, &p.fUnzipCounters, &p.fDeserializeCounters, &r.fPerfCounters})
+      m << c->fCycles << c->fInstructions << c->fLLCMisses << c->fBranchMisses;
+   m << r.fCacheStats.fReadCalls << r.fCacheStats.fCacheHits << r.fCacheStats.fCacheMisses;
+   m << r.fMemory.fPeakRSS << r.fMemory.fPeakBasketBytes << r.fMemory.fNAllocations << r.fMemory.fAllocatedBytes;
+   m << static_cast<UInt_t>(r.fBranchStats.size());
+   for (const auto &branch : r.fBranchStats) {
+      const auto &stats = branch.second;
+      m.WriteStdString(&branch.first);
+      m << stats.fRealTime << stats.fUncompressedBytesRead << stats.fCompressedBytes << stats.fNBaskets
+        << stats.fCompressionSettings;
+   }
+}
+
+// Read the statistics written by WriteBatchStats and add them to result. Peak memory is the largest of all batches.
+void AddBatchStats(TMessage &m, Result &result)
+{
+   PhaseTimes p;
+   m >> p.fIORealTime >> p.fIOCpuTime >> p.fUnzipRealTime >> p.fUnzipCpuTime >> p.fDeserializeRealTime >>
+      p.fDeserializeCpuTime;
+   PerfCounters perfCounters;
+   for (auto *c : {&p.fIOCounters, &p.fUnzipCounters, &p.fDeserializeCounters, &perfCounters})
+      m >> c->fCycles >> c->fInstructions >> c->fLLCMisses >> c->fBranchMisses;
+   result.fPhaseTimes += p;
+   result.fPerfCounters += perfCounters;
+
+   CacheStats cacheStats;
+   m >> cacheStats.fReadCalls >> cacheStats.fCacheHits >> cacheStats.fCacheMisses;
+   result.fCacheStats += cacheStats;
+
+   MemoryStats memory;
+   m >> memory.fPeakRSS >> memory.fPeakBasketBytes >> memory.fNAllocations >> memory.fAllocatedBytes;
+   result.fMemory.fPeakRSS = std::max(result.fMemory.fPeakRSS, memory.fPeakRSS);
+   result.fMemory.fPeakBasketBytes = std::max(result.fMemory.fPeakBasketBytes, memory.fPeakBasketBytes);
+   if (memory.fNAllocations >= 0) {
+      result.fMemory.fNAllocations = std::max<Long64_t>(result.fMemory.fNAllocations, 0) + memory.fNAllocations;
+      result.fMemory.fAllocatedBytes += memory.fAllocatedBytes;
+   }
+
+   UInt_t nBranches = 0;
+   m >> nBranches;
+   for (auto i = 0u; i < nBranches; ++i) {
+      std::string name;
+      BranchStats stats;
+      m.ReadStdString(&name);
+      m >> stats.fRealTime >> stats.fUncompressedBytesRead >> stats.fCompressedBytes >> stats.fNBaskets >>
+         stats.fCompressionSettings;
+      result.fBranchStats[name] += stats;
+   }
+}
+} // anonymous namespace
+
+Result ReadSpeed::RunCoordinator(const Data &d, int port, unsigned int nWorkers, const Options &opts)
+{
+   if (nWorkers == 0)
+      throw std::runtime_error("A distributed run needs at least one worker");
+   ValidateDistributedOptions(d, opts);
+
+   TStopwatch setupSw;
+   setupSw.Start();
+   auto clusters = ClipClusters(GetClusters(d), opts.fEntries, opts.fMaxEntriesPerFile);
+   setupSw.Stop();
+
+   TServerSocket server(port, /*reuse=*/true);
+   if (!server.IsValid())
+      throw std::runtime_error("Could not listen on port " + std::to_string(port));
+   std::cout << "Waiting for " << nWorkers << " workers on port " << port << '\n';
+
+   const auto fileListHash = HashFileList(d.fFileNames);
+   std::vector<std::unique_ptr<TSocket>> sockets;
+   std::vector<NodeStats> nodes(nWorkers);
+   unsigned int totalThreads = 0;
+   for (auto workerIdx = 0u; workerIdx < nWorkers; ++workerIdx) {
+      auto *s = server.Accept();
+      if (s == nullptr || s == reinterpret_cast<TSocket *>(-1))
+         throw std::runtime_error("Could not accept the connection of a worker");
+      sockets.emplace_back(s);
+
+      auto hello = Receive(*s, "a connecting worker", kHello);
+      auto &node = nodes[workerIdx];
+      std::string workerHash;
+      hello->ReadStdString(&node.fHostName);
+      *hello >> node.fThreadPoolSize;
+      hello->ReadStdString(&workerHash);
+      if (workerHash != fileListHash)
+         throw std::runtime_error("Worker on host '" + node.fHostName + "' reads a different list of files");
+      totalThreads += node.fThreadPoolSize;
+      std::cout << "Worker " << workerIdx << " connected from " << node.fHostName << " with "
+                << node.fThreadPoolSize << " threads\n";
+   }
+
+   setupSw.Start(/*reset=*/false);
+   const unsigned int maxTasksPerFile = std::ceil(
+      float(ROOT::TTreeProcessorMT::GetTasksPerWorkerHint() * std::max(totalThreads, 1u)) / float(d.fFileNames.size()));
+   const auto rangesPerFile = MergeClusters(std::move(clusters), maxTasksPerFile);
+   std::vector<Task> tasks;
+   for (auto fileIdx = 0u; fileIdx < rangesPerFile.size(); ++fileIdx)
+      for (const auto &range : rangesPerFile[fileIdx])
+         tasks.push_back({fileIdx, range});
+   setupSw.Stop();
+   std::cout << "Total number of tasks: " << tasks.size() << '\n';
+
+   using Clock = std::chrono::steady_clock;
+   const auto start = Clock::now();
+   auto secondsSinceStart = [&start] { return std::chrono::duration<double>(Clock::now() - start).count(); };
+
+   // Each worker keeps the next batch queued behind the one it is reading, so that it never waits for the coordinator
+   // between batches: a new batch is sent whenever one completes.
+   constexpr unsigned int kBatchesPerWorker = 2;
+   std::vector<unsigned int> batchesInFlight(nWorkers, 0u);
+   std::vector<bool> doneSent(nWorkers, false);
+
+   // send the next batch of tasks to a worker, or tell it there are none left and return false
+   std::size_t nextTask = 0;
+   auto sendBatch = [&](unsigned int workerIdx) {
+      auto &node = nodes[workerIdx];
+      const std::string peer = "worker on host '" + node.fHostName + '\'';
+      const auto nTasks = std::min<std::size_t>(std::max(node.fThreadPoolSize, 1u), tasks.size() - nextTask);
+      if (nTasks == 0) {
+         Send(*sockets[workerIdx], TMessage(kDone), peer);
+         return false;
+      }
+      TMessage batch(kBatch);
+      batch << static_cast<UInt_t>(nTasks);
+      for (auto i = nextTask; i < nextTask + nTasks; ++i)
+         batch << static_cast<UInt_t>(tasks[i].fFileIdx) << tasks[i].fRange.fStart << tasks[i].fRange.fEnd;
+      nextTask += nTasks;
+      node.fBatches.emplace_back();
+      // a batch queued behind another one starts when that one completes
+      if (batchesInFlight[workerIdx] == 0)
+         node.fBatches.back().fStartTime = secondsSinceStart();
+      ++batchesInFlight[workerIdx];
+      Send(*sockets[workerIdx], batch, peer);
+      return true;
+   };
+
+   Result result{};
+   TMonitor monitor(/*mainloop=*/kFALSE);
+   // one batch for each worker first, so that all workers start reading as early as possible
+   for (auto round = 0u; round < kBatchesPerWorker; ++round)
+      for (auto workerIdx = 0u; workerIdx < nWorkers; ++workerIdx)
+         if (!doneSent[workerIdx] && !sendBatch(workerIdx))
+            doneSent[workerIdx] = true;
+   for (auto workerIdx = 0u; workerIdx < nWorkers; ++workerIdx)
+      if (batchesInFlight[workerIdx] > 0)
+         monitor.Add(sockets[workerIdx].get());
+
+   while (monitor.GetActive() > 0) {
+      auto *s = monitor.Select();
+      unsigned int workerIdx = 0;
+      while (sockets[workerIdx].get() != s)
+         ++workerIdx;
+
+      auto done = Receive(*s, "worker on host '" + nodes[workerIdx].fHostName + '\'', kBatchDone);
+      // workers complete their batches in the order they were sent
+      auto &batches = nodes[workerIdx].fBatches;
+      auto &batch = batches[batches.size() - batchesInFlight[workerIdx]];
+      batch.fEndTime = secondsSinceStart();
+      double cpuTime = 0.;
+      double taskSetupRealTime = 0.;
+      double taskSetupCpuTime = 0.;
+      ULong64_t fileOpens = 0;
+      ULong64_t fileReopens = 0;
+      *done >> batch.fRealTime >> cpuTime >> batch.fNTasks >> batch.fUncompressedBytesRead >>
+         batch.fCompressedBytesRead >> fileOpens >> fileReopens >> taskSetupRealTime >> taskSetupCpuTime;
+
+      result.fCpuTime += cpuTime;
+      result.fUncompressedBytesRead += batch.fUncompressedBytesRead;
+      result.fCompressedBytesRead += batch.fCompressedBytesRead;
+      result.fFileOpens += fileOpens;
+      result.fFileReopens += fileReopens;
+      result.fNTasks += batch.fNTasks;
+      result.fTaskSetupRealTime += taskSetupRealTime;
+      result.fTaskSetupCpuTime += taskSetupCpuTime;
+      AddBatchStats(*done, result);
+
+      --batchesInFlight[workerIdx];
+      if (batchesInFlight[workerIdx] > 0)
+         batches[batches.size() - batchesInFlight[workerIdx]].fStartTime = batch.fEndTime;
+      if (!doneSent[workerIdx] && !sendBatch(workerIdx))
+         doneSent[workerIdx] = true;
+      if (batchesInFlight[workerIdx] == 0)
+         monitor.Remove(s);
+   }
+
+   result.fRealTime = secondsSinceStart();
+   result.fMTSetupRealTime = setupSw.RealTime();
+   result.fMTSetupCpuTime = setupSw.CpuTime();
+   result.fThreadPoolSize = totalThreads;
+   result.fNodeStats = std::move(nodes);
+   return result;
+}
+
+void ReadSpeed::RunWorker(const Data &d, const std::string &host, int port, unsigned int nThreads,
+                          const Options &opts)
+{
+   ValidateDistributedOptions(d, opts);
+   ROOT::TThreadExecutor pool(nThreads);
+   const auto actualThreads = ROOT::GetThreadPoolSize();
+
+   // without regexes there is nothing to retrieve from the files before reading
+   DatasetLayout layout;
+   if (d.fUseRegex)
+      layout = GetDatasetLayout(d, &pool, opts.fIndexFile);
+   else
+      layout.fBranchNames.assign(d.fFileNames.size(), d.fBranchNames);
+
+   const std::string peer = "coordinator at " + host + ':' + std::to_string(port);
+   std::unique_ptr<TSocket> socket;
+   const auto deadline = std::chrono::steady_clock::now() + kConnectTimeout;
+   while (true) {
+      socket = std::make_unique<TSocket>(host.c_str(), port);
+      if (socket->IsValid())
+         break;
+      if (std::chrono::steady_clock::now() > deadline)
+         throw std::runtime_error("Could not connect to " + peer);
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+   }
+
+   TMessage hello(kHello);
+   const std::string hostName = gSystem->HostName();
+   const auto fileListHash = HashFileList(d.fFileNames);
+   hello.WriteStdString(&hostName);
+   hello << static_cast<UInt_t>(actualThreads);
+   hello.WriteStdString(&fileListHash);
+   Send(*socket, hello, peer);
+
+   // the coordinator keeps the next batch queued in the socket, so it is there as soon as the current one is done
+   while (true) {
+      auto m = Receive(*socket, peer);
+      if (m->What() == kDone)
+         break;
+      if (m->What() != kBatch)
+         throw std::runtime_error("Unexpected message of type " + std::to_string(m->What()) + " from " + peer);
+
+      UInt_t nTasks = 0;
+      *m >> nTasks;
+      std::vector<std::vector<EntryRange>> tasks(d.fFileNames.size());
+      for (auto i = 0u; i < nTasks; ++i) {
+         UInt_t fileIdx = 0;
+         EntryRange range;
+         *m >> fileIdx >> range.fStart >> range.fEnd;
+         if (fileIdx >= tasks.size())
+            throw std::runtime_error("The " + peer + " sent a task for file " + std::to_string(fileIdx) +
+                                     ", but there are only " + std::to_string(tasks.size()) + " files");
+         tasks[fileIdx].push_back(range);
+      }
+
+      const auto r = EvalThroughputMT(d, layout, tasks, pool, opts);
+      TMessage done(kBatchDone);
+      done << r.fRealTime << r.fCpuTime << r.fNTasks << r.fUncompressedBytesRead << r.fCompressedBytesRead
+           << r.fFileOpens << r.fFileReopens << r.fTaskSetupRealTime << r.fTaskSetupCpuTime;
+      WriteBatchStats(done, r);
+      Send(*socket, done, peer);
+   }
+}
@@ -0,0 +1,36 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* This header contains the coordinator and worker sides of distributed runs, in which several nodes read the same
+   dataset at the same time to measure the aggregate throughput a storage system can sustain.
+   The coordinator splits the dataset into tasks and hands them out in batches, over TCP, to workers that request
+   them; each worker reads its batches with the multi-thread read path and sends back their statistics. */
+
+#ifndef ROOTREADSPEEDDISTRIBUTED
+#define ROOTREADSPEEDDISTRIBUTED
+
+#include "ReadSpeed.hxx"
+
+#include <string>
+
+namespace ReadSpeed {
+
+// Wait for nWorkers workers to connect on port, then hand out the clusters of d (restricted by Options::fEntries and
+// fMaxEntriesPerFile, and merged following TTreeProcessorMT's logic for the total number of worker threads) in
+// batches of one task per worker thread, until all have been read. Each worker has its next batch queued behind the one
+// it reads, so that it does not wait for the coordinator between batches. Workers must read the same list of files.
+// The result sums the statistics of all workers: its real time goes from the first batch sent to the last batch
+// completed, fThreadPoolSize is the total number of worker threads and fNodeStats holds the timeline of each worker.
+// Peak memory is the largest of all workers; fTaskStats, fThreadStats and fTimeSeries are left empty.
+// Options that do not apply to batches of tasks, or whose statistics are not collected from the workers
+// (Options::fRepeat, fWarmup, fUnzipOnly, fTryCompression, fSampleClusters and fSampleInterval), are rejected here and
+// by RunWorker.
+Result RunCoordinator(const Data &d, int port, unsigned int nWorkers, const Options &opts = {});
+
+// Connect to the coordinator listening on host:port, retrying for up to a minute, and read the batches of tasks it
+// sends with a pool of nThreads threads (0 lets ROOT choose), until the coordinator reports there are no more.
+void RunWorker(const Data &d, const std::string &host, int port, unsigned int nThreads, const Options &opts = {});
+
+} // namespace ReadSpeed
+
+#endif // ROOTREADSPEEDDISTRIBUTED
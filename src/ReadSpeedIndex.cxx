@@ -0,0 +1,308 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+#include "ReadSpeedIndex.hxx"
+
+#include <algorithm>
+#include <cstdio> // std::rename
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <tuple> // std::tie
+#include <utility>
+
+using namespace ReadSpeed;
+
+namespace {
+// First line of every index file. The number is the version of the format.
+const std::string kIndexHeader = "root-readspeed-index 1";
+// First line of every read plan file. The number is the version of the format.
+const std::string kPlanHeader = "root-readspeed-plan 1";
+
+// Index files and read plans written before RNTuple support have no format line: they describe TTrees.
+const char *FormatName(EFormat format)
+{
+   return format == EFormat::kRNTuple ? "rntuple" : "ttree";
+}
+
+bool ParseFormat(const std::string &value, EFormat &format)
+{
+   if (value != "ttree" && value != "rntuple")
+      return false;
+   format = value == "rntuple" ? EFormat::kRNTuple : EFormat::kTTree;
+   return true;
+}
+
+// Every line is a key followed by a single space and the value, which can contain spaces.
+std::pair<std::string, std::string> SplitLine(const std::string &line)
+{
+   const auto space = line.find(' ');
+   return {line.substr(0, space), space == std::string::npos ? std::string() : line.substr(space + 1)};
+}
+
+// Parse a line of the description of a file written by WriteFileLayout into layout.
+// Return false if the key is not one of the file keys or the value is malformed.
+bool ReadFileLayoutLine(const std::string &key, const std::string &value, FileLayout &layout)
+{
+   auto &metadata = layout.fMetadata;
+   if (key == "tree") {
+      metadata.fTreeName = value;
+      return true;
+   }
+   if (key == "uuid") {
+      metadata.fUUID = value;
+      return true;
+   }
+   if (key == "branch") {
+      layout.fBranchNames.emplace_back(value);
+      return true;
+   }
+
+   std::istringstream values(value);
+   if (key == "size")
+      values >> metadata.fFileSize;
+   else if (key == "mtime")
+      values >> metadata.fModTime;
+   else if (key == "entries")
+      values >> metadata.fEntries;
+   else if (key == "zipbytes")
+      values >> metadata.fZipBytes;
+   else if (key == "totbytes")
+      values >> metadata.fTotBytes;
+   else if (key == "cluster") {
+      EntryRange range;
+      values >> range.fStart >> range.fEnd;
+      layout.fClusters.emplace_back(range);
+   } else if (key == "cluster-bytes") {
+      ULong64_t bytes = 0;
+      values >> bytes;
+      layout.fClusterBytes.emplace_back(bytes);
+   } else
+      return false;
+   return !values.fail();
+}
+
+// Write the "file" line of fileName followed by the metadata, clusters and branches in layout.
+void WriteFileLayout(std::ostream &out, const std::string &fileName, const FileLayout &layout)
+{
+   const auto &metadata = layout.fMetadata;
+   out << "file " << fileName << '\n';
+   out << "tree " << metadata.fTreeName << '\n';
+   out << "size " << metadata.fFileSize << '\n';
+   out << "mtime " << metadata.fModTime << '\n';
+   out << "uuid " << metadata.fUUID << '\n';
+   out << "entries " << metadata.fEntries << '\n';
+   out << "zipbytes " << metadata.fZipBytes << '\n';
+   out << "totbytes " << metadata.fTotBytes << '\n';
+   for (const auto &cluster : layout.fClusters)
+      out << "cluster " << cluster.fStart << ' ' << cluster.fEnd << '\n';
+   for (const auto bytes : layout.fClusterBytes)
+      out << "cluster-bytes " << bytes << '\n';
+   for (const auto &branchName : layout.fBranchNames)
+      out << "branch " << branchName << '\n';
+}
+
+// Write to a temporary file first and then move it to path, so that an interrupted write does not leave a corrupted
+// file behind. what describes the file in error messages.
+template <typename F>
+void WriteAtomically(const std::string &path, const std::string &what, F &&write)
+{
+   const auto tmpPath = path + ".tmp";
+   {
+      std::ofstream out(tmpPath);
+      if (!out)
+         throw std::runtime_error("Could not write " + what + " file '" + tmpPath + '\'');
+      write(out);
+      if (!out)
+         throw std::runtime_error("Could not write " + what + " file '" + tmpPath + '\'');
+   }
+
+   if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+      throw std::runtime_error("Could not move " + what + " file '" + tmpPath + "' to '" + path + '\'');
+}
+} // anonymous namespace
+
+Index ReadSpeed::LoadIndex(const std::string &path)
+{
+   Index index;
+   std::ifstream in(path);
+   if (!in)
+      return index; // no index yet
+
+   std::string line;
+   if (!std::getline(in, line) || line != kIndexHeader)
+      throw std::runtime_error("File '" + path + "' is not a root-readspeed index file");
+
+   // the tree name of each file comes after its "file" line
+   std::vector<std::pair<std::string, FileLayout>> files;
+   for (int lineNumber = 2; std::getline(in, line); ++lineNumber) {
+      std::string key, value;
+      std::tie(key, value) = SplitLine(line);
+
+      if (key == "selection") {
+         index.fBranchSelection.emplace_back(value);
+      } else if (key == "selection-regex") {
+         index.fUseRegex = value == "1";
+      } else if (key == "format" && files.empty()) {
+         if (!ParseFormat(value, index.fFormat))
+            throw std::runtime_error("Malformed line " + std::to_string(lineNumber) + " in index file '" + path +
+                                     '\'');
+      } else if (key == "friend" && files.empty()) {
+         index.fFriendTreeNames.emplace_back(value);
+      } else if (key == "file") {
+         files.emplace_back(value, FileLayout{});
+      } else if (files.empty() || !ReadFileLayoutLine(key, value, files.back().second)) {
+         throw std::runtime_error("Malformed line " + std::to_string(lineNumber) + " in index file '" + path + '\'');
+      }
+   }
+
+   for (auto &file : files) {
+      const auto &treeName = file.second.fMetadata.fTreeName;
+      index.fFiles[{file.first, treeName}] = std::move(file.second);
+   }
+   return index;
+}
+
+void ReadSpeed::SaveIndex(const Index &index, const std::string &path)
+{
+   WriteAtomically(path, "index", [&index](std::ostream &out) {
+      out << kIndexHeader << '\n';
+      out << "selection-regex " << index.fUseRegex << '\n';
+      out << "format " << FormatName(index.fFormat) << '\n';
+      for (const auto &friendTree : index.fFriendTreeNames)
+         out << "friend " << friendTree << '\n';
+      for (const auto &selection : index.fBranchSelection)
+         out << "selection " << selection << '\n';
+      for (const auto &file : index.fFiles)
+         WriteFileLayout(out, file.first.first, file.second);
+   });
+}
+
+ReadPlan ReadSpeed::LoadReadPlan(const std::string &path)
+{
+   std::ifstream in(path);
+   if (!in)
+      throw std::runtime_error("Could not open read plan file '" + path + '\'');
+
+   std::string line;
+   if (!std::getline(in, line) || line != kPlanHeader)
+      throw std::runtime_error("File '" + path + "' is not a root-readspeed read plan file");
+
+   ReadPlan plan;
+   auto &d = plan.fData;
+   std::vector<FileLayout> files;
+   std::vector<std::vector<EntryRange>> selected;
+   for (int lineNumber = 2; std::getline(in, line); ++lineNumber) {
+      std::string key, value;
+      std::tie(key, value) = SplitLine(line);
+      const auto malformed = [&] {
+         return std::runtime_error("Malformed line " + std::to_string(lineNumber) + " in read plan file '" + path +
+                                   '\'');
+      };
+
+      if (key == "data-tree") {
+         d.fTreeNames.emplace_back(value);
+      } else if (key == "selection") {
+         d.fBranchNames.emplace_back(value);
+      } else if (key == "selection-regex") {
+         d.fUseRegex = value == "1";
+      } else if (key == "data-format") {
+         if (!ParseFormat(value, d.fFormat))
+            throw malformed();
+      } else if (key == "data-friend") {
+         d.fFriends.push_back({value, {}});
+      } else if (key == "friend-file") {
+         // one line per friend in each file, empty for friends in the same file
+         if (d.fFileNames.empty())
+            throw malformed();
+         auto it = std::find_if(d.fFriends.begin(), d.fFriends.end(),
+                                [&](const FriendTrees &fr) { return fr.fFileNames.size() < d.fFileNames.size(); });
+         if (it == d.fFriends.end())
+            throw malformed();
+         it->fFileNames.emplace_back(value);
+      } else if (key == "partition") {
+         if (value != "bytes" && value != "clusters")
+            throw malformed();
+         plan.fPartition = value == "bytes" ? EPartition::kBytes : EPartition::kClusters;
+      } else if (key == "file") {
+         d.fFileNames.emplace_back(value);
+         files.emplace_back();
+         selected.emplace_back();
+         plan.fTasks.emplace_back();
+      } else {
+         std::istringstream values(value);
+         if (key == "sampled")
+            values >> plan.fSampled;
+         else if (key == "total-entries")
+            values >> plan.fSelection.fTotalEntries;
+         else if (key == "total-clusters")
+            values >> plan.fSelection.fTotalClusters;
+         else if (key == "threads")
+            values >> plan.fNThreads;
+         else if (files.empty())
+            throw malformed();
+         else if (key == "selected-cluster" || key == "task") {
+            EntryRange range;
+            values >> range.fStart >> range.fEnd;
+            (key == "task" ? plan.fTasks : selected).back().emplace_back(range);
+         } else if (!ReadFileLayoutLine(key, value, files.back()))
+            throw malformed();
+         if (values.fail())
+            throw malformed();
+      }
+   }
+
+   for (auto &file : files) {
+      plan.fLayout.fClusters.emplace_back(std::move(file.fClusters));
+      plan.fLayout.fBranchNames.emplace_back(std::move(file.fBranchNames));
+      plan.fLayout.fMetadata.emplace_back(std::move(file.fMetadata));
+      plan.fLayout.fClusterBytes.emplace_back(std::move(file.fClusterBytes));
+   }
+   plan.fSelectedClusters = std::move(selected);
+   for (auto &fr : d.fFriends) {
+      if (fr.fFileNames.size() != d.fFileNames.size())
+         throw std::runtime_error("The read plan file '" + path + "' does not have a file for each friend tree");
+      if (std::all_of(fr.fFileNames.begin(), fr.fFileNames.end(), [](const std::string &f) { return f.empty(); }))
+         fr.fFileNames.clear();
+   }
+   return plan;
+}
+
+void ReadSpeed::SaveReadPlan(const ReadPlan &plan, const std::string &path)
+{
+   const auto &d = plan.fData;
+   const auto &layout = plan.fLayout;
+   if (layout.fClusters.size() != d.fFileNames.size() || layout.fBranchNames.size() != d.fFileNames.size() ||
+       layout.fMetadata.size() != d.fFileNames.size() || layout.fClusterBytes.size() != d.fFileNames.size() ||
+       plan.fSelectedClusters.size() != d.fFileNames.size() || plan.fTasks.size() != d.fFileNames.size())
+      throw std::runtime_error("The read plan must have a layout, selected clusters and tasks for each file");
+
+   WriteAtomically(path, "read plan", [&](std::ostream &out) {
+      out << kPlanHeader << '\n';
+      for (const auto &treeName : d.fTreeNames)
+         out << "data-tree " << treeName << '\n';
+      out << "selection-regex " << d.fUseRegex << '\n';
+      out << "data-format " << FormatName(d.fFormat) << '\n';
+      for (const auto &fr : d.fFriends)
+         out << "data-friend " << fr.fTreeName << '\n';
+      for (const auto &selection : d.fBranchNames)
+         out << "selection " << selection << '\n';
+      out << "sampled " << plan.fSampled << '\n';
+      out << "total-entries " << plan.fSelection.fTotalEntries << '\n';
+      out << "total-clusters " << plan.fSelection.fTotalClusters << '\n';
+      out << "partition " << (plan.fPartition == EPartition::kBytes ? "bytes" : "clusters") << '\n';
+      out << "threads " << plan.fNThreads << '\n';
+
+      for (auto fileIdx = 0u; fileIdx < d.fFileNames.size(); ++fileIdx) {
+         const FileLayout fileLayout{layout.fClusters[fileIdx], layout.fBranchNames[fileIdx],
+                                     layout.fMetadata[fileIdx], layout.fClusterBytes[fileIdx]};
+         WriteFileLayout(out, d.fFileNames[fileIdx], fileLayout);
+         for (const auto &fr : d.fFriends)
+            out << "friend-file " << (fr.fFileNames.empty() ? std::string() : fr.fFileNames[fileIdx]) << '\n';
+         for (const auto &range : plan.fSelectedClusters[fileIdx])
+            out << "selected-cluster " << range.fStart << ' ' << range.fEnd << '\n';
+         for (const auto &range : plan.fTasks[fileIdx])
+            out << "task " << range.fStart << ' ' << range.fEnd << '\n';
+      }
+   });
+}
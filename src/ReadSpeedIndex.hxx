@@ -0,0 +1,47 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* This header contains helper functions to store dataset layouts in an index file, so that repeated runs over the
+   same dataset do not have to open every file during setup, and to store read plans. */
+
+#ifndef ROOTREADSPEEDINDEX
+#define ROOTREADSPEEDINDEX
+
+#include "ReadSpeed.hxx"
+
+#include <map>
+#include <string>
+#include <utility> // std::pair
+#include <vector>
+
+namespace ReadSpeed {
+
+struct Index {
+   /// Branch names or regexes the index was built for: stored branch names are only valid for the same selection.
+   std::vector<std::string> fBranchSelection;
+   /// If fBranchSelection contains regexes.
+   bool fUseRegex = false;
+   /// Format of the dataset the index was built for.
+   EFormat fFormat = EFormat::kTTree;
+   /// Names of the friend trees the index was built for, whose branches can be among the stored ones.
+   std::vector<std::string> fFriendTreeNames;
+   /// Layout of each indexed tree, by file name and tree name: a file can hold several trees of the dataset.
+   std::map<std::pair<std::string, std::string>, FileLayout> fFiles;
+};
+
+// Load an index from a text file written by SaveIndex. Return an empty index if the file does not exist.
+Index LoadIndex(const std::string &path);
+
+// Write an index to a text file, replacing it atomically if it already exists.
+void SaveIndex(const Index &index, const std::string &path);
+
+// Load a read plan from a text file written by SaveReadPlan. The layout of each file is in the same format as in
+// index files, followed by its selected clusters and tasks. The setup times of the layout are not stored.
+ReadPlan LoadReadPlan(const std::string &path);
+
+// Write a read plan to a text file, replacing it atomically if it already exists.
+void SaveReadPlan(const ReadPlan &plan, const std::string &path);
+
+} // namespace ReadSpeed
+
+#endif // ROOTREADSPEEDINDEX
@@ -0,0 +1,666 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+#include "ReadSpeedOutput.hxx"
+
+#include <ROOT/TTreeProcessorMT.hxx> // for TTreeProcessorMT::GetTasksPerWorkerHint
+#include <RVersion.h>                // for ROOT_RELEASE
+#include <TSystem.h>
+
+#include <algorithm>
+#include <cmath> // std::isfinite
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+
+using namespace ReadSpeed;
+
+namespace {
+// Version of the layout of the JSON and CSV output, to be increased when existing fields change meaning or are
+// removed. Adding fields does not require a new version.
+const int kOutputFormatVersion = 1;
+
+// A minimal streaming JSON writer: values written after Key are object members, the others are array elements.
+class JSONWriter {
+   std::ostream &fOs;
+   /// For each open object or array, whether no element has been written to it yet.
+   std::vector<bool> fIsEmpty;
+   bool fAfterKey = false;
+
+   void BeginValue()
+   {
+      if (fAfterKey) {
+         fAfterKey = false;
+         return;
+      }
+      if (!fIsEmpty.empty()) {
+         if (!fIsEmpty.back())
+            fOs << ',';
+         fIsEmpty.back() = false;
+      }
+   }
+
+   void WriteString(const std::string &s)
+   {
+      fOs << '"';
+      for (const char c : s) {
+         switch (c) {
+         case '"': fOs << "\\\""; break;
+         case '\\': fOs << "\\\\"; break;
+         case '\n': fOs << "\\n"; break;
+         case '\t': fOs << "\\t"; break;
+         default:
+            if (static_cast<unsigned char>(c) < 0x20)
+               fOs << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec
+                   << std::setfill(' ');
+            else
+               fOs << c;
+         }
+      }
+      fOs << '"';
+   }
+
+public:
+   explicit JSONWriter(std::ostream &os) : fOs(os) { fOs << std::setprecision(10); }
+
+   void BeginObject()
+   {
+      BeginValue();
+      fOs << '{';
+      fIsEmpty.push_back(true);
+   }
+   void EndObject()
+   {
+      fOs << '}';
+      fIsEmpty.pop_back();
+   }
+   void BeginArray()
+   {
+      BeginValue();
+      fOs << '[';
+      fIsEmpty.push_back(true);
+   }
+   void EndArray()
+   {
+      fOs << ']';
+      fIsEmpty.pop_back();
+   }
+
+   void Key(const std::string &key)
+   {
+      BeginValue();
+      WriteString(key);
+      fOs << ':';
+      fAfterKey = true;
+   }
+
+   void Value(const std::string &v)
+   {
+      BeginValue();
+      WriteString(v);
+   }
+   void Value(const char *v) { Value(std::string(v)); }
+   void Value(bool v)
+   {
+      BeginValue();
+      fOs << (v ? "true" : "false");
+   }
+   void Value(double v)
+   {
+      BeginValue();
+      // JSON has no representation for infinities and NaNs
+      if (std::isfinite(v))
+         fOs << v;
+      else
+         fOs << "null";
+   }
+   template <typename T, typename = std::enable_if_t<std::is_integral<T>::value>>
+   void Value(T v)
+   {
+      BeginValue();
+      fOs << v;
+   }
+
+   template <typename T>
+   void Field(const std::string &key, const T &v)
+   {
+      Key(key);
+      Value(v);
+   }
+
+   template <typename T>
+   void Field(const std::string &key, const std::vector<T> &v)
+   {
+      Key(key);
+      BeginArray();
+      for (const auto &e : v)
+         Value(e);
+      EndArray();
+   }
+};
+
+const char *SchedulerName(EScheduler s)
+{
+   return s == EScheduler::kWorkStealing ? "steal" : "mapreduce";
+}
+
+const char *PartitionName(EPartition p)
+{
+   return p == EPartition::kBytes ? "bytes" : "clusters";
+}
+
+const char *PinName(EPin p)
+{
+   switch (p) {
+   case EPin::kCores: return "cores";
+   case EPin::kNuma: return "numa";
+   default: return "none";
+   }
+}
+
+const char *ReadOrderName(EReadOrder o)
+{
+   return o == EReadOrder::kBranchMajor ? "branch-major" : "entry-major";
+}
+
+const char *DataFormatName(EFormat f)
+{
+   return f == EFormat::kRNTuple ? "rntuple" : "ttree";
+}
+
+std::string CurrentTimeUTC()
+{
+   const auto now = std::time(nullptr);
+   std::tm utc{};
+   gmtime_r(&now, &utc);
+   char buf[32];
+   std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &utc);
+   return buf;
+}
+
+double Throughput(ULong64_t bytes, double realTime)
+{
+   return realTime > 0. ? bytes / realTime / 1024 / 1024 : 0.;
+}
+
+void WriteConfig(JSONWriter &w, const Data &d, unsigned int nThreads, const Options &opts)
+{
+   w.Key("config");
+   w.BeginObject();
+   w.Field("threads", nThreads);
+   w.Field("tasks_per_worker_hint", ROOT::TTreeProcessorMT::GetTasksPerWorkerHint());
+   w.Field("trees", d.fTreeNames);
+   w.Field("files", d.fFileNames);
+   w.Field("file_list_hash", HashFileList(d.fFileNames));
+   w.Field("branches", d.fBranchNames);
+   w.Field("branches_regex", d.fUseRegex);
+   w.Field("data_format", DataFormatName(d.fFormat));
+   std::vector<std::string> friendTreeNames;
+   for (const auto &fr : d.fFriends)
+      friendTreeNames.push_back(fr.fTreeName);
+   w.Field("friend_trees", friendTreeNames);
+
+   w.Key("options");
+   w.BeginObject();
+   w.Field("split_phases", opts.fSplitPhases);
+   w.Field("index_file", opts.fIndexFile);
+   w.Field("scheduler", SchedulerName(opts.fScheduler));
+   w.Field("partition", PartitionName(opts.fPartition));
+   w.Field("pin", PinName(opts.fPin));
+   w.Field("open_files_per_thread", opts.fOpenFilesPerThread);
+   w.Field("bulk_read", opts.fBulkRead);
+   w.Field("raw_io", opts.fRawIO);
+   w.Field("unzip_only", opts.fUnzipOnly);
+   w.Field("memory_limit", opts.fMemoryLimit);
+   w.Field("read_order", ReadOrderName(opts.fReadOrder));
+   w.Field("per_branch", opts.fPerBranch);
+   w.Field("cache_size", opts.fCacheSize);
+   w.Field("cache_learn_entries", opts.fCacheLearnEntries);
+   w.Field("cache_add_branches", opts.fCacheAddBranches);
+   w.Field("async_prefetch", opts.fAsyncPrefetch);
+   w.Field("repeat", opts.fRepeat);
+   w.Field("warmup", opts.fWarmup);
+   w.Field("drop_cache", opts.fDropCache);
+   w.Field("entries_start", opts.fEntries.fStart);
+   w.Field("entries_end", opts.fEntries.fEnd);
+   w.Field("max_entries_per_file", opts.fMaxEntriesPerFile);
+   w.Field("sample_clusters", opts.fSampleClusters);
+   w.Field("sample_seed", opts.fSampleSeed);
+   w.Field("sample_interval", opts.fSampleInterval);
+   w.Field("pipeline_depth", opts.fPipelineDepth);
+   w.Field("io_threads", opts.fIOThreads);
+   w.Field("perf_counters", opts.fPerfCounters);
+   w.EndObject();
+
+   w.EndObject();
+}
+
+void WriteHost(JSONWriter &w, const HostInfo &h)
+{
+   w.Key("host");
+   w.BeginObject();
+   w.Field("hostname", h.fHostName);
+   w.Field("os", h.fOS);
+   w.Field("cpu_model", h.fCpuModel);
+   w.Field("cpus", h.fNCpus);
+   w.Field("cpu_speed_mhz", h.fCpuSpeed);
+   w.Field("phys_ram_mb", h.fPhysRam);
+   w.Field("root_version", ROOT_RELEASE);
+   w.EndObject();
+}
+
+// Return getValue of each trial of r. A result without trials is treated as a single trial.
+template <typename F>
+std::vector<double> TrialValues(const Result &r, F getValue)
+{
+   if (r.fTrials.empty())
+      return {getValue(TrialStats{r.fRealTime, r.fCpuTime, r.fUncompressedBytesRead, r.fCompressedBytesRead})};
+   std::vector<double> values;
+   for (const auto &t : r.fTrials)
+      values.push_back(getValue(t));
+   return values;
+}
+
+SummaryStats TrialRealTimeStats(const Result &r)
+{
+   return Summarize(TrialValues(r, [](const TrialStats &t) { return t.fRealTime; }));
+}
+
+void WriteSummary(JSONWriter &w, const std::string &key, const SummaryStats &s)
+{
+   w.Key(key);
+   w.BeginObject();
+   w.Field("mean", s.fMean);
+   w.Field("stddev", s.fStdDev);
+   w.Field("min", s.fMin);
+   w.Field("median", s.fMedian);
+   w.EndObject();
+}
+
+// Write the counts of c and, if bytes is not zero, the misses per MB of uncompressed data read.
+void WritePerfCounters(JSONWriter &w, const std::string &key, const PerfCounters &c, ULong64_t bytes)
+{
+   w.Key(key);
+   w.BeginObject();
+   w.Field("cycles", c.fCycles);
+   w.Field("instructions", c.fInstructions);
+   w.Field("llc_misses", c.fLLCMisses);
+   w.Field("branch_misses", c.fBranchMisses);
+   w.Field("ipc", InstructionsPerCycle(c));
+   const auto mb = bytes / 1024. / 1024.;
+   w.Field("llc_misses_per_mb", mb > 0. ? c.fLLCMisses / mb : 0.);
+   w.Field("branch_misses_per_mb", mb > 0. ? c.fBranchMisses / mb : 0.);
+   w.EndObject();
+}
+
+void WriteResult(JSONWriter &w, const Result &r)
+{
+   w.BeginObject();
+   w.Field("thread_pool_size", r.fThreadPoolSize);
+   w.Field("real_time", r.fRealTime);
+   w.Field("cpu_time", r.fCpuTime);
+   w.Field("mt_setup_real_time", r.fMTSetupRealTime);
+   w.Field("mt_setup_cpu_time", r.fMTSetupCpuTime);
+   w.Field("uncompressed_bytes", r.fUncompressedBytesRead);
+   w.Field("compressed_bytes", r.fCompressedBytesRead);
+   w.Field("uncompressed_throughput_mbps", Throughput(r.fUncompressedBytesRead, r.fRealTime));
+   w.Field("compressed_throughput_mbps", Throughput(r.fCompressedBytesRead, r.fRealTime));
+   w.Field("file_opens", r.fFileOpens);
+   w.Field("file_reopens", r.fFileReopens);
+   w.Field("tasks", r.fNTasks);
+   w.Field("task_setup_real_time", r.fTaskSetupRealTime);
+   w.Field("task_setup_cpu_time", r.fTaskSetupCpuTime);
+
+   const auto &p = r.fPhaseTimes;
+   w.Key("phases");
+   w.BeginObject();
+   w.Field("io_real_time", p.fIORealTime);
+   w.Field("io_cpu_time", p.fIOCpuTime);
+   w.Field("unzip_real_time", p.fUnzipRealTime);
+   w.Field("unzip_cpu_time", p.fUnzipCpuTime);
+   w.Field("deserialize_real_time", p.fDeserializeRealTime);
+   w.Field("deserialize_cpu_time", p.fDeserializeCpuTime);
+   WritePerfCounters(w, "io_counters", p.fIOCounters, r.fUncompressedBytesRead);
+   WritePerfCounters(w, "unzip_counters", p.fUnzipCounters, r.fUncompressedBytesRead);
+   WritePerfCounters(w, "deserialize_counters", p.fDeserializeCounters, r.fUncompressedBytesRead);
+   w.EndObject();
+
+   const auto &c = r.fCacheStats;
+   w.Key("cache");
+   w.BeginObject();
+   w.Field("read_calls", c.fReadCalls);
+   w.Field("hits", c.fCacheHits);
+   w.Field("misses", c.fCacheMisses);
+   w.EndObject();
+
+   w.Key("branch_stats");
+   w.BeginArray();
+   for (const auto &b : r.fBranchStats) {
+      const auto &s = b.second;
+      w.BeginObject();
+      w.Field("name", b.first);
+      w.Field("real_time", s.fRealTime);
+      w.Field("uncompressed_bytes", s.fUncompressedBytesRead);
+      w.Field("compressed_bytes", s.fCompressedBytes);
+      w.Field("baskets", s.fNBaskets);
+      w.Field("compression_settings", s.fCompressionSettings);
+      w.EndObject();
+   }
+   w.EndArray();
+
+   w.Key("task_stats");
+   w.BeginArray();
+   for (const auto &t : r.fTaskStats) {
+      w.BeginObject();
+      w.Field("file_index", t.fFileIdx);
+      w.Field("start", t.fRange.fStart);
+      w.Field("end", t.fRange.fEnd);
+      w.Field("thread", t.fThreadIdx);
+      w.Field("real_time", t.fRealTime);
+      w.Field("cpu_time", t.fCpuTime);
+      w.Field("setup_real_time", t.fSetupRealTime);
+      w.Field("uncompressed_bytes", t.fUncompressedBytesRead);
+      w.Field("compressed_bytes", t.fCompressedBytesRead);
+      w.EndObject();
+   }
+   w.EndArray();
+
+   w.Key("thread_stats");
+   w.BeginArray();
+   for (const auto &t : r.fThreadStats) {
+      w.BeginObject();
+      w.Field("tasks", t.fNTasks);
+      w.Field("busy_real_time", t.fBusyRealTime);
+      w.Field("basket_bytes", t.fBasketBytes);
+      w.EndObject();
+   }
+   w.EndArray();
+
+   const auto &proj = r.fProjection;
+   w.Key("projection");
+   w.BeginObject();
+   w.Field("total_entries", proj.fTotalEntries);
+   w.Field("sampled_entries", proj.fSampledEntries);
+   w.Field("total_clusters", proj.fTotalClusters);
+   w.Field("sampled_clusters", proj.fSampledClusters);
+   w.Field("real_time", proj.fRealTime);
+   w.Field("real_time_low", proj.fRealTimeLow);
+   w.Field("real_time_high", proj.fRealTimeHigh);
+   w.Field("uncompressed_bytes", proj.fUncompressedBytesRead);
+   w.Field("compressed_bytes", proj.fCompressedBytesRead);
+   w.EndObject();
+
+   w.Key("time_series");
+   w.BeginArray();
+   for (auto i = 0u; i < r.fTimeSeries.size(); ++i) {
+      const auto &sample = r.fTimeSeries[i];
+      w.BeginObject();
+      w.Field("time", sample.fTime);
+      w.Field("uncompressed_bytes", sample.fUncompressedBytesRead);
+      w.Field("compressed_bytes", sample.fCompressedBytesRead);
+      w.Field("active_tasks", sample.fActiveTasks);
+      // throughput over the interval since the previous sample, 0 for the first one
+      const auto prev = i > 0 ? r.fTimeSeries[i - 1] : sample;
+      const auto dt = sample.fTime - prev.fTime;
+      w.Field("uncompressed_throughput_mbps",
+              Throughput(sample.fUncompressedBytesRead - prev.fUncompressedBytesRead, dt));
+      w.Field("compressed_throughput_mbps", Throughput(sample.fCompressedBytesRead - prev.fCompressedBytesRead, dt));
+      w.EndObject();
+   }
+   w.EndArray();
+
+   w.Key("node_stats");
+   w.BeginArray();
+   for (const auto &n : r.fNodeStats) {
+      w.BeginObject();
+      w.Field("hostname", n.fHostName);
+      w.Field("threads", n.fThreadPoolSize);
+      w.Key("batches");
+      w.BeginArray();
+      for (const auto &b : n.fBatches) {
+         w.BeginObject();
+         w.Field("start_time", b.fStartTime);
+         w.Field("end_time", b.fEndTime);
+         w.Field("real_time", b.fRealTime);
+         w.Field("tasks", b.fNTasks);
+         w.Field("uncompressed_bytes", b.fUncompressedBytesRead);
+         w.Field("compressed_bytes", b.fCompressedBytesRead);
+         w.EndObject();
+      }
+      w.EndArray();
+      w.EndObject();
+   }
+   w.EndArray();
+
+   w.Key("numa_stats");
+   w.BeginArray();
+   for (const auto &n : r.fNumaStats) {
+      w.BeginObject();
+      w.Field("node", n.fNode);
+      w.Field("threads", n.fNThreads);
+      w.Field("files", n.fNFiles);
+      w.Field("tasks", n.fNTasks);
+      w.Field("real_time", n.fRealTime);
+      w.Field("uncompressed_bytes", n.fUncompressedBytesRead);
+      w.Field("compressed_bytes", n.fCompressedBytesRead);
+      w.EndObject();
+   }
+   w.EndArray();
+
+   w.Key("pipeline");
+   w.BeginObject();
+   w.Field("depth", r.fPipeline.fDepth);
+   w.Field("io_threads", r.fPipeline.fNIOThreads);
+   w.Field("workers", r.fPipeline.fNWorkers);
+   w.Field("io_wait_time", r.fPipeline.fIOWaitTime);
+   w.Field("worker_wait_time", r.fPipeline.fWorkerWaitTime);
+   w.Field("mean_queued", r.fPipeline.fMeanQueued);
+   w.Field("max_queued", r.fPipeline.fMaxQueued);
+   w.EndObject();
+
+   w.Key("memory");
+   w.BeginObject();
+   w.Field("peak_rss", r.fMemory.fPeakRSS);
+   w.Field("peak_basket_bytes", r.fMemory.fPeakBasketBytes);
+   w.Field("allocations", r.fMemory.fNAllocations);
+   w.Field("allocated_bytes", r.fMemory.fAllocatedBytes);
+   w.Field("allocated_bytes_per_mb", AllocatedBytesPerMB(r));
+   w.EndObject();
+
+   WritePerfCounters(w, "perf_counters", r.fPerfCounters, r.fUncompressedBytesRead);
+
+   w.Key("trials");
+   w.BeginArray();
+   for (const auto &t : r.fTrials) {
+      w.BeginObject();
+      w.Field("real_time", t.fRealTime);
+      w.Field("cpu_time", t.fCpuTime);
+      w.Field("uncompressed_bytes", t.fUncompressedBytesRead);
+      w.Field("compressed_bytes", t.fCompressedBytesRead);
+      w.EndObject();
+   }
+   w.EndArray();
+   if (!r.fTrials.empty()) {
+      const auto throughputs = TrialValues(
+         r, [](const TrialStats &t) { return Throughput(t.fUncompressedBytesRead, t.fRealTime); });
+      WriteSummary(w, "trials_real_time", TrialRealTimeStats(r));
+      WriteSummary(w, "trials_uncompressed_throughput_mbps", Summarize(throughputs));
+   }
+
+   w.EndObject();
+}
+
+template <typename T>
+std::string ToString(const T &v)
+{
+   std::ostringstream os;
+   os << std::boolalpha << std::setprecision(10) << v;
+   return os.str();
+}
+
+// Quote a CSV field if needed, as per RFC 4180.
+std::string CSVField(const std::string &s)
+{
+   if (s.find_first_of(",\"\n") == std::string::npos)
+      return s;
+   std::string quoted = "\"";
+   for (const char c : s) {
+      if (c == '"')
+         quoted += '"';
+      quoted += c;
+   }
+   return quoted + '"';
+}
+} // anonymous namespace
+
+HostInfo ReadSpeed::GetHostInfo()
+{
+   HostInfo info;
+   info.fHostName = gSystem->HostName();
+   SysInfo_t sysInfo;
+   if (gSystem->GetSysInfo(&sysInfo) == 0) {
+      info.fOS = sysInfo.fOS.Data();
+      info.fCpuModel = sysInfo.fModel.Data();
+      info.fNCpus = sysInfo.fCpus;
+      info.fCpuSpeed = sysInfo.fCpuSpeed;
+      info.fPhysRam = sysInfo.fPhysRam;
+   }
+   return info;
+}
+
+std::string ReadSpeed::HashFileList(const std::vector<std::string> &fileNames)
+{
+   // 64-bit FNV-1a, with a newline after each file name
+   std::uint64_t hash = 14695981039346656037ull;
+   auto add = [&hash](char c) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+   };
+   for (const auto &f : fileNames) {
+      for (const char c : f)
+         add(c);
+      add('\n');
+   }
+   std::ostringstream os;
+   os << std::hex << std::setw(16) << std::setfill('0') << hash;
+   return os.str();
+}
+
+void ReadSpeed::WriteJSON(std::ostream &os, const Data &d, unsigned int nThreads, const Options &opts,
+                          const std::vector<Result> &results)
+{
+   JSONWriter w(os);
+   w.BeginObject();
+   w.Field("format_version", kOutputFormatVersion);
+   w.Field("timestamp", CurrentTimeUTC());
+   WriteConfig(w, d, nThreads, opts);
+   WriteHost(w, GetHostInfo());
+   w.Key("results");
+   w.BeginArray();
+   for (const auto &r : results)
+      WriteResult(w, r);
+   w.EndArray();
+   w.EndObject();
+   os << '\n';
+}
+
+void ReadSpeed::WriteCSV(std::ostream &os, const Data &d, unsigned int nThreads, const Options &opts,
+                         const std::vector<Result> &results)
+{
+   const auto host = GetHostInfo();
+   // columns that are the same for all rows
+   const std::vector<std::pair<std::string, std::string>> configColumns{
+      {"format_version", ToString(kOutputFormatVersion)},
+      {"timestamp", CurrentTimeUTC()},
+      {"hostname", host.fHostName},
+      {"cpu_model", host.fCpuModel},
+      {"cpus", ToString(host.fNCpus)},
+      {"file_list_hash", HashFileList(d.fFileNames)},
+      {"files", ToString(d.fFileNames.size())},
+      {"data_format", DataFormatName(d.fFormat)},
+      {"friend_trees", ToString(d.fFriends.size())},
+      {"threads", ToString(nThreads)},
+      {"tasks_per_worker_hint", ToString(ROOT::TTreeProcessorMT::GetTasksPerWorkerHint())},
+      {"scheduler", SchedulerName(opts.fScheduler)},
+      {"partition", PartitionName(opts.fPartition)},
+      {"pin", PinName(opts.fPin)},
+      {"read_order", ReadOrderName(opts.fReadOrder)},
+      {"split_phases", ToString(opts.fSplitPhases)},
+      {"bulk_read", ToString(opts.fBulkRead)},
+      {"raw_io", ToString(opts.fRawIO)},
+      {"unzip_only", ToString(opts.fUnzipOnly)},
+      {"cache_size", ToString(opts.fCacheSize)},
+      {"entries_start", ToString(opts.fEntries.fStart)},
+      {"entries_end", ToString(opts.fEntries.fEnd)},
+      {"max_entries_per_file", ToString(opts.fMaxEntriesPerFile)},
+      {"sample_clusters", ToString(opts.fSampleClusters)},
+      {"sample_interval", ToString(opts.fSampleInterval)},
+      {"pipeline_depth", ToString(opts.fPipelineDepth)},
+      {"io_threads", ToString(opts.fIOThreads)},
+      {"perf_counters", ToString(opts.fPerfCounters)},
+   };
+   using ResultColumn = std::pair<std::string, std::function<std::string(const Result &)>>;
+   const std::vector<ResultColumn> resultColumns{
+      {"thread_pool_size", [](const Result &r) { return ToString(r.fThreadPoolSize); }},
+      {"real_time", [](const Result &r) { return ToString(r.fRealTime); }},
+      {"cpu_time", [](const Result &r) { return ToString(r.fCpuTime); }},
+      {"mt_setup_real_time", [](const Result &r) { return ToString(r.fMTSetupRealTime); }},
+      {"uncompressed_bytes", [](const Result &r) { return ToString(r.fUncompressedBytesRead); }},
+      {"compressed_bytes", [](const Result &r) { return ToString(r.fCompressedBytesRead); }},
+      {"uncompressed_throughput_mbps",
+       [](const Result &r) { return ToString(Throughput(r.fUncompressedBytesRead, r.fRealTime)); }},
+      {"compressed_throughput_mbps",
+       [](const Result &r) { return ToString(Throughput(r.fCompressedBytesRead, r.fRealTime)); }},
+      {"file_opens", [](const Result &r) { return ToString(r.fFileOpens); }},
+      {"file_reopens", [](const Result &r) { return ToString(r.fFileReopens); }},
+      {"tasks", [](const Result &r) { return ToString(r.fNTasks); }},
+      {"task_setup_real_time", [](const Result &r) { return ToString(r.fTaskSetupRealTime); }},
+      {"io_real_time", [](const Result &r) { return ToString(r.fPhaseTimes.fIORealTime); }},
+      {"unzip_real_time", [](const Result &r) { return ToString(r.fPhaseTimes.fUnzipRealTime); }},
+      {"deserialize_real_time", [](const Result &r) { return ToString(r.fPhaseTimes.fDeserializeRealTime); }},
+      {"read_calls", [](const Result &r) { return ToString(r.fCacheStats.fReadCalls); }},
+      {"cache_hits", [](const Result &r) { return ToString(r.fCacheStats.fCacheHits); }},
+      {"cache_misses", [](const Result &r) { return ToString(r.fCacheStats.fCacheMisses); }},
+      {"nodes", [](const Result &r) { return ToString(r.fNodeStats.size()); }},
+      {"trials", [](const Result &r) { return ToString(std::max<std::size_t>(r.fTrials.size(), 1)); }},
+      {"trials_real_time_mean", [](const Result &r) { return ToString(TrialRealTimeStats(r).fMean); }},
+      {"trials_real_time_stddev", [](const Result &r) { return ToString(TrialRealTimeStats(r).fStdDev); }},
+      {"trials_real_time_min", [](const Result &r) { return ToString(TrialRealTimeStats(r).fMin); }},
+      {"trials_real_time_median", [](const Result &r) { return ToString(TrialRealTimeStats(r).fMedian); }},
+      {"projected_real_time", [](const Result &r) { return ToString(r.fProjection.fRealTime); }},
+      {"projected_real_time_low", [](const Result &r) { return ToString(r.fProjection.fRealTimeLow); }},
+      {"projected_real_time_high", [](const Result &r) { return ToString(r.fProjection.fRealTimeHigh); }},
+      {"peak_rss", [](const Result &r) { return ToString(r.fMemory.fPeakRSS); }},
+      {"peak_basket_bytes", [](const Result &r) { return ToString(r.fMemory.fPeakBasketBytes); }},
+      {"allocations", [](const Result &r) { return ToString(r.fMemory.fNAllocations); }},
+      {"allocated_bytes_per_mb", [](const Result &r) { return ToString(AllocatedBytesPerMB(r)); }},
+      {"cycles", [](const Result &r) { return ToString(r.fPerfCounters.fCycles); }},
+      {"instructions", [](const Result &r) { return ToString(r.fPerfCounters.fInstructions); }},
+      {"llc_misses", [](const Result &r) { return ToString(r.fPerfCounters.fLLCMisses); }},
+      {"branch_misses", [](const Result &r) { return ToString(r.fPerfCounters.fBranchMisses); }},
+   };
+
+   std::string sep;
+   for (const auto &c : configColumns) {
+      os << sep << c.first;
+      sep = ",";
+   }
+   for (const auto &c : resultColumns)
+      os << ',' << c.first;
+   os << '\n';
+
+   for (const auto &r : results) {
+      sep.clear();
+      for (const auto &c : configColumns) {
+         os << sep << CSVField(c.second);
+         sep = ",";
+      }
+      for (const auto &c : resultColumns)
+         os << ',' << CSVField(c.second(r));
+      os << '\n';
+   }
+}
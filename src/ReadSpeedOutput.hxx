@@ -0,0 +1,55 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* This header contains helper functions to write results in machine-readable formats, together with the
+   configuration of the run and information about the host, so that results can be tracked automatically. */
+
+#ifndef ROOTREADSPEEDOUTPUT
+#define ROOTREADSPEEDOUTPUT
+
+#include "ReadSpeed.hxx"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ReadSpeed {
+
+enum class EOutputFormat {
+   /// Human-readable text, see PrintThroughput and PrintScaling.
+   kText,
+   /// A JSON object with configuration, host information and the full results, breakdowns included.
+   kJSON,
+   /// A CSV table with one row per result. Only scalar quantities are included, no per-branch or per-task breakdowns.
+   kCSV
+};
+
+struct HostInfo {
+   std::string fHostName;
+   std::string fOS;
+   std::string fCpuModel;
+   int fNCpus = -1;
+   /// CPU clock speed, in MHz.
+   int fCpuSpeed = -1;
+   /// Physical memory, in MB.
+   int fPhysRam = -1;
+};
+
+HostInfo GetHostInfo();
+
+// Return a hash of the list of file names, as a hexadecimal string, to identify the dataset read by a run.
+// The hash only depends on the file names and their order, so it is stable across runs and platforms.
+std::string HashFileList(const std::vector<std::string> &fileNames);
+
+// Write the configuration of a run (nThreads is the number of threads requested), host information and results as
+// a JSON object. results contains one element for single runs and one per thread count for thread scaling sweeps.
+void WriteJSON(std::ostream &os, const Data &d, unsigned int nThreads, const Options &opts,
+               const std::vector<Result> &results);
+
+// Write the configuration of a run, host information and results as CSV, with a header line and one row per result.
+void WriteCSV(std::ostream &os, const Data &d, unsigned int nThreads, const Options &opts,
+              const std::vector<Result> &results);
+
+} // namespace ReadSpeed
+
+#endif // ROOTREADSPEEDOUTPUT
@@ -0,0 +1,271 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+#include "ReadSpeedRNTuple.hxx"
+
+#ifdef ROOTREADSPEED_RNTUPLE
+#include <ROOT/RField.hxx>
+#include <ROOT/RNTupleDescriptor.hxx>
+#include <ROOT/RNTupleMetrics.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleReadOptions.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RPageStorage.hxx>
+#endif
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility> // std::pair
+
+using namespace ReadSpeed;
+
+#ifdef ROOTREADSPEED_RNTUPLE
+namespace RNT = ROOT::Experimental;
+
+namespace {
+std::unique_ptr<RNT::RNTupleReader> OpenReader(const std::string &ntupleName, const std::string &fileName)
+{
+   try {
+      return RNT::RNTupleReader::Open(ntupleName, fileName);
+   } catch (const std::exception &e) {
+      throw std::runtime_error("Could not open RNTuple '" + ntupleName + "' in file '" + fileName + "': " + e.what());
+   }
+}
+
+// The pages of a field are those of its own columns and of the columns of all its sub-fields.
+void CollectColumnIds(const RNT::RNTupleDescriptor &desc, RNT::DescriptorId_t fieldId,
+                      std::vector<RNT::DescriptorId_t> &columnIds)
+{
+   for (const auto &column : desc.GetColumnIterable(fieldId))
+      if (!column.IsAliasColumn())
+         columnIds.push_back(column.GetPhysicalId());
+   for (const auto &subField : desc.GetFieldIterable(fieldId))
+      CollectColumnIds(desc, subField.GetId(), columnIds);
+}
+} // anonymous namespace
+
+bool ReadSpeed::HasRNTupleSupport()
+{
+   return true;
+}
+
+RNTupleLayout ReadSpeed::GetRNTupleLayout(const std::string &ntupleName, const std::string &fileName)
+{
+   const auto reader = OpenReader(ntupleName, fileName);
+   const auto &desc = reader->GetDescriptor();
+
+   RNTupleLayout layout;
+   layout.fEntries = desc.GetNEntries();
+
+   // the descriptor does not list clusters in entry order
+   std::vector<std::pair<EntryRange, RNT::DescriptorId_t>> clusters;
+   for (const auto &c : desc.GetClusterIterable()) {
+      const auto first = static_cast<Long64_t>(c.GetFirstEntryIndex());
+      clusters.emplace_back(EntryRange{first, first + static_cast<Long64_t>(c.GetNEntries())}, c.GetId());
+   }
+   std::sort(clusters.begin(), clusters.end(),
+             [](const auto &a, const auto &b) { return a.first.fStart < b.first.fStart; });
+   for (const auto &c : clusters)
+      layout.fClusters.push_back(c.first);
+
+   for (const auto &field : desc.GetTopLevelFields()) {
+      const auto &name = field.GetFieldName();
+      layout.fFieldNames.push_back(name);
+      std::vector<RNT::DescriptorId_t> columnIds;
+      CollectColumnIds(desc, field.GetId(), columnIds);
+      auto &bytes = layout.fFieldClusterBytes[name];
+      bytes.assign(clusters.size(), 0);
+      for (auto clusterIdx = 0u; clusterIdx < clusters.size(); ++clusterIdx) {
+         const auto &cluster = desc.GetClusterDescriptor(clusters[clusterIdx].second);
+         for (const auto columnId : columnIds) {
+            if (!cluster.ContainsColumn(columnId))
+               continue;
+            for (const auto &page : cluster.GetPageRange(columnId).fPageInfos)
+               bytes[clusterIdx] += page.fLocator.fBytesOnStorage;
+         }
+      }
+   }
+
+   return layout;
+}
+
+namespace {
+// An RNTupleReader for some fields, with the metrics counters of the bytes it reads.
+struct FieldsReader {
+   std::unique_ptr<RNT::RNTupleReader> fReader;
+   const RNT::Detail::RNTuplePerfCounter *fUnzippedBytes = nullptr;
+   const RNT::Detail::RNTuplePerfCounter *fPayloadBytes = nullptr;
+};
+
+FieldsReader OpenFieldsReader(const std::string &ntupleName, const std::string &fileName,
+                              const std::vector<std::string> &fieldNames)
+{
+   // Without the cluster cache, pages are only read when the entries of a task need them: otherwise clusters
+   // prefetched in the background for the next entries, which the next task of this thread might not read, would be
+   // counted in the bytes of this task.
+   RNT::RNTupleReadOptions options;
+   options.SetClusterCache(RNT::RNTupleReadOptions::EClusterCache::kOff);
+   std::unique_ptr<RNT::Internal::RPageSource> source;
+   try {
+      source = RNT::Internal::RPageSource::Create(ntupleName, fileName, options);
+      source->Attach();
+   } catch (const std::exception &e) {
+      throw std::runtime_error("Could not open RNTuple '" + ntupleName + "' in file '" + fileName + "': " + e.what());
+   }
+
+   // the types of the fields are only known from the descriptor, which the page source read when it was attached
+   auto model = RNT::RNTupleModel::Create();
+   {
+      const auto descGuard = source->GetSharedDescriptorGuard();
+      const auto &desc = descGuard.GetRef();
+      for (const auto &name : fieldNames) {
+         const auto fieldId = desc.FindFieldId(name);
+         if (fieldId == RNT::kInvalidDescriptorId)
+            throw std::runtime_error("Could not retrieve field '" + name + "' from RNTuple '" + ntupleName +
+                                     "' in file '" + fileName + '\'');
+         model->AddField(RNT::RFieldBase::Create(name, desc.GetFieldDescriptor(fieldId).GetTypeName()).Unwrap());
+      }
+   }
+
+   FieldsReader r;
+   r.fReader = std::make_unique<RNT::RNTupleReader>(std::move(model), std::move(source));
+   r.fReader->EnableMetrics();
+   const auto &metrics = r.fReader->GetMetrics();
+   r.fUnzippedBytes = metrics.GetCounter("RNTupleReader.RPageSourceFile.szUnzip");
+   r.fPayloadBytes = metrics.GetCounter("RNTupleReader.RPageSourceFile.szReadPayload");
+   return r;
+}
+
+RNTupleTaskReader::Bytes GetReaderBytes(const FieldsReader &r)
+{
+   RNTupleTaskReader::Bytes bytes;
+   if (r.fUnzippedBytes != nullptr)
+      bytes.fUncompressed = r.fUnzippedBytes->GetValueAsInt();
+   if (r.fPayloadBytes != nullptr)
+      bytes.fCompressed = r.fPayloadBytes->GetValueAsInt();
+   return bytes;
+}
+} // anonymous namespace
+
+class RNTupleTaskReader::Impl {
+public:
+   /// One reader for all fields, or one reader per field with perField.
+   std::vector<FieldsReader> fReaders;
+};
+
+RNTupleTaskReader::RNTupleTaskReader(const std::string &ntupleName, const std::string &fileName,
+                                     const std::vector<std::string> &fieldNames, bool perField)
+   : fImpl(std::make_unique<Impl>()),
+     fNTupleName(ntupleName),
+     fFileName(fileName),
+     fFieldNames(fieldNames),
+     fPerField(perField)
+{
+   if (perField) {
+      for (const auto &name : fieldNames)
+         fImpl->fReaders.emplace_back(OpenFieldsReader(ntupleName, fileName, {name}));
+   } else {
+      fImpl->fReaders.emplace_back(OpenFieldsReader(ntupleName, fileName, fieldNames));
+   }
+}
+
+RNTupleTaskReader::~RNTupleTaskReader() = default;
+
+Long64_t RNTupleTaskReader::GetEntries() const
+{
+   // without fields there is no per-field reader to ask
+   if (fImpl->fReaders.empty())
+      return OpenReader(fNTupleName, fFileName)->GetNEntries();
+   return fImpl->fReaders.front().fReader->GetNEntries();
+}
+
+void RNTupleTaskReader::LoadEntries(EntryRange range)
+{
+   for (auto &r : fImpl->fReaders)
+      for (auto e = range.fStart; e < range.fEnd; ++e)
+         r.fReader->LoadEntry(e);
+}
+
+void RNTupleTaskReader::LoadFieldEntry(std::size_t fieldIdx, Long64_t entry)
+{
+   if (!fPerField)
+      throw std::logic_error("LoadFieldEntry requires a RNTupleTaskReader with perField set");
+   fImpl->fReaders.at(fieldIdx).fReader->LoadEntry(entry);
+}
+
+RNTupleTaskReader::Bytes RNTupleTaskReader::GetBytes() const
+{
+   Bytes bytes;
+   for (const auto &r : fImpl->fReaders) {
+      const auto readerBytes = GetReaderBytes(r);
+      bytes.fUncompressed += readerBytes.fUncompressed;
+      bytes.fCompressed += readerBytes.fCompressed;
+   }
+   return bytes;
+}
+
+RNTupleTaskReader::Bytes RNTupleTaskReader::GetFieldBytes(std::size_t fieldIdx) const
+{
+   if (!fPerField)
+      throw std::logic_error("GetFieldBytes requires a RNTupleTaskReader with perField set");
+   return GetReaderBytes(fImpl->fReaders.at(fieldIdx));
+}
+
+#else // no RNTuple support
+
+namespace {
+[[noreturn]] void ThrowNoRNTupleSupport()
+{
+   throw std::runtime_error("This build of root-readspeed cannot read RNTuples: it requires ROOT v6.32 or later, "
+                            "built with RNTuple support");
+}
+} // anonymous namespace
+
+bool ReadSpeed::HasRNTupleSupport()
+{
+   return false;
+}
+
+RNTupleLayout ReadSpeed::GetRNTupleLayout(const std::string &, const std::string &)
+{
+   ThrowNoRNTupleSupport();
+}
+
+class RNTupleTaskReader::Impl {
+};
+
+RNTupleTaskReader::RNTupleTaskReader(const std::string &, const std::string &, const std::vector<std::string> &,
+                                     bool)
+{
+   ThrowNoRNTupleSupport();
+}
+
+RNTupleTaskReader::~RNTupleTaskReader() = default;
+
+Long64_t RNTupleTaskReader::GetEntries() const
+{
+   ThrowNoRNTupleSupport();
+}
+
+void RNTupleTaskReader::LoadEntries(EntryRange)
+{
+   ThrowNoRNTupleSupport();
+}
+
+void RNTupleTaskReader::LoadFieldEntry(std::size_t, Long64_t)
+{
+   ThrowNoRNTupleSupport();
+}
+
+RNTupleTaskReader::Bytes RNTupleTaskReader::GetBytes() const
+{
+   ThrowNoRNTupleSupport();
+}
+
+RNTupleTaskReader::Bytes RNTupleTaskReader::GetFieldBytes(std::size_t) const
+{
+   ThrowNoRNTupleSupport();
+}
+
+#endif // ROOTREADSPEED_RNTUPLE
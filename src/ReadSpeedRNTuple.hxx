@@ -0,0 +1,89 @@
+/* Copyright (C) 2020 Enrico Guiraud
+   See the LICENSE file in the top directory for more information. */
+
+/* This header contains the RNTuple side of the readers: retrieving the layout of an RNTuple and reading the entries of
+   a task, for datasets with Data::fFormat set to EFormat::kRNTuple. Runs go through the same scheduling as TTrees do,
+   see ReadRNTuple in ReadSpeed.hxx.
+   RNTuple support requires ROOT v6.32 or later built with RNTuple, and is only compiled in if ROOTREADSPEED_RNTUPLE
+   is defined (CMake does so when ROOT provides it): otherwise all functions below throw. */
+
+#ifndef ROOTREADSPEEDRNTUPLE
+#define ROOTREADSPEEDRNTUPLE
+
+#include "ReadSpeed.hxx"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ReadSpeed {
+
+// Whether this build of the library can read RNTuples.
+bool HasRNTupleSupport();
+
+struct RNTupleLayout {
+   /// Entry ranges of the clusters of the RNTuple, in entry order.
+   std::vector<EntryRange> fClusters;
+   /// Names of the top-level fields of the RNTuple.
+   std::vector<std::string> fFieldNames;
+   /// For each top-level field, the size on storage of its pages (including those of its sub-fields) in each cluster.
+   std::map<std::string, std::vector<ULong64_t>> fFieldClusterBytes;
+   Long64_t fEntries = 0;
+};
+
+// Open RNTuple ntupleName in file fileName and retrieve its layout from the descriptor, without reading any page.
+RNTupleLayout GetRNTupleLayout(const std::string &ntupleName, const std::string &fileName);
+
+// Reads the given top-level fields of an RNTuple entry by entry, with an RNTupleReader whose model only contains those
+// fields. Meant to be kept open by a thread across the tasks it runs on the same RNTuple.
+// With perField set, each field gets an RNTupleReader of its own, so that fields can be read and their bytes counted
+// separately (see LoadFieldEntry and GetFieldBytes).
+class RNTupleTaskReader {
+   class Impl;
+   std::unique_ptr<Impl> fImpl;
+   std::string fNTupleName;
+   std::string fFileName;
+   std::vector<std::string> fFieldNames;
+   bool fPerField = false;
+
+public:
+   struct Bytes {
+      /// Bytes of the pages after decompression.
+      ULong64_t fUncompressed = 0;
+      /// Bytes of the pages read from storage.
+      ULong64_t fCompressed = 0;
+   };
+
+   RNTupleTaskReader(const std::string &ntupleName, const std::string &fileName,
+                     const std::vector<std::string> &fieldNames, bool perField = false);
+   ~RNTupleTaskReader();
+   RNTupleTaskReader(const RNTupleTaskReader &) = delete;
+   RNTupleTaskReader &operator=(const RNTupleTaskReader &) = delete;
+
+   // Whether this reader reads exactly the given fields of the given RNTuple, in the same way.
+   bool Reads(const std::string &ntupleName, const std::string &fileName, const std::vector<std::string> &fieldNames,
+              bool perField) const
+   {
+      return fNTupleName == ntupleName && fFileName == fileName && fFieldNames == fieldNames && fPerField == perField;
+   }
+
+   Long64_t GetEntries() const;
+
+   // Load all entries in range into the fields of the model.
+   void LoadEntries(EntryRange range);
+
+   // Load entry of the field with index fieldIdx in the field names only. Requires perField.
+   void LoadFieldEntry(std::size_t fieldIdx, Long64_t entry);
+
+   // The bytes this reader decompressed and read from storage since it was opened. The reader does not prefetch
+   // clusters in the background, so these are the bytes of the entries loaded.
+   Bytes GetBytes() const;
+
+   // Like GetBytes, for the field with index fieldIdx in the field names only. Requires perField.
+   Bytes GetFieldBytes(std::size_t fieldIdx) const;
+};
+
+} // namespace ReadSpeed
+
+#endif // ROOTREADSPEEDRNTUPLE
@@ -3,6 +3,10 @@
 
 #include "ReadSpeedCLI.hxx"
 #include "ReadSpeed.hxx"
+#include "ReadSpeedDistributed.hxx"
+#include "ReadSpeedOutput.hxx"
+
+#include <iostream>
 
 using namespace ReadSpeed;
 
@@ -13,7 +17,47 @@ int main(int argc, char **argv)
    if (!args.fShouldRun)
       return 1; // ParseArgs has printed the --help, has run the --test or has encountered an issue and logged about it
 
-   PrintThroughput(EvalThroughput(args.fData, args.fNThreads));
+   if (!args.fCoordinatorHost.empty()) {
+      RunWorker(args.fData, args.fCoordinatorHost, args.fWorkerPort, args.fNThreads, args.fOptions);
+      return 0;
+   }
+
+   if (!args.fOptions.fTryCompression.empty()) {
+      // a single-thread run, followed by the requested multi-thread run or thread counts
+      std::vector<unsigned int> nThreads{0u};
+      if (args.fNThreads > 0)
+         nThreads.push_back(args.fNThreads);
+      nThreads.insert(nThreads.end(), args.fThreadsSweep.begin(), args.fThreadsSweep.end());
+      PrintRecompression(EvalRecompression(args.fData, nThreads, args.fOptions));
+      return 0;
+   }
+
+   // keep progress messages printed during the run out of machine-readable output
+   std::streambuf *coutBuf = nullptr;
+   if (args.fOutputFormat != EOutputFormat::kText)
+      coutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+
+   std::vector<Result> results;
+   if (args.fCoordinatorPort > 0)
+      results.emplace_back(RunCoordinator(args.fData, args.fCoordinatorPort, args.fNWorkers, args.fOptions));
+   else if (!args.fThreadsSweep.empty())
+      results = EvalThroughputScaling(args.fData, args.fThreadsSweep, args.fOptions);
+   else
+      results.emplace_back(EvalThroughput(args.fData, args.fNThreads, args.fOptions));
+
+   if (coutBuf != nullptr)
+      std::cout.rdbuf(coutBuf);
+
+   switch (args.fOutputFormat) {
+   case EOutputFormat::kJSON: WriteJSON(std::cout, args.fData, args.fNThreads, args.fOptions, results); break;
+   case EOutputFormat::kCSV: WriteCSV(std::cout, args.fData, args.fNThreads, args.fOptions, results); break;
+   case EOutputFormat::kText:
+      if (!args.fThreadsSweep.empty())
+         PrintScaling(results);
+      else
+         PrintThroughput(results.front());
+      break;
+   }
 
    return 0;
 }
@@ -5,11 +5,28 @@
 #include "doctest/doctest.h"
 #include "ReadSpeed.hxx"
 #include "ReadSpeedCLI.hxx"
+#include "ReadSpeedDataset.hxx"
+#include "ReadSpeedDistributed.hxx"
+#include "ReadSpeedIndex.hxx"
+#include "ReadSpeedOutput.hxx"
+#include "ReadSpeedRNTuple.hxx"
 
 #include "ROOT/TTreeProcessorMT.hxx" // for TTreeProcessorMT::GetTasksPerWorkerHint
 #include "TFile.h"
 #include "TSystem.h"
 #include "TTree.h"
+#ifdef ROOTREADSPEED_RNTUPLE
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+#endif
+
+#include <algorithm> // std::count
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <numeric> // std::accumulate
+#include <sstream>
+#include <thread>
 
 using namespace ReadSpeed;
 
@@ -31,6 +48,67 @@ void RequireFile(const std::string &fname, const std::vector<std::string> &branc
    t.Write();
 }
 
+// Like RequireFile, but with a smaller tree split in clusters of clusterSize entries.
+void RequireClusteredFile(const std::string &fname, int nEntries, int clusterSize)
+{
+   if (gSystem->AccessPathName(fname.c_str()) == false)
+      return;
+
+   TFile f(fname.c_str(), "recreate");
+   TTree t("t", "t");
+   t.SetAutoFlush(clusterSize);
+
+   int var = 42;
+   t.Branch("x", &var);
+   for (int i = 0; i < nEntries; ++i)
+      t.Fill();
+   t.Write();
+}
+
+// Like RequireClusteredFile, but with two trees, "ft" and "gt", each with a branch called y.
+void RequireFriendFile(const std::string &fname, int nEntries, int clusterSize)
+{
+   if (gSystem->AccessPathName(fname.c_str()) == false)
+      return;
+
+   TFile f(fname.c_str(), "recreate");
+   int var = 42;
+   for (const auto *treeName : {"ft", "gt"}) {
+      TTree t(treeName, treeName);
+      t.SetAutoFlush(clusterSize);
+      t.Branch("y", &var);
+      for (int i = 0; i < nEntries; ++i)
+         t.Fill();
+      t.Write();
+   }
+}
+
+void WriteTextFile(const std::string &fname, const std::string &contents)
+{
+   std::ofstream(fname) << contents;
+}
+
+#ifdef ROOTREADSPEED_RNTUPLE
+// Like RequireClusteredFile, but with an RNTuple called "ntpl" with fields x and y.
+void RequireRNTupleFile(const std::string &fname, int nEntries, int clusterSize)
+{
+   if (gSystem->AccessPathName(fname.c_str()) == false)
+      return;
+
+   auto model = ROOT::Experimental::RNTupleModel::Create();
+   auto x = model->MakeField<int>("x");
+   auto y = model->MakeField<float>("y");
+   auto writer = ROOT::Experimental::RNTupleWriter::Recreate(std::move(model), "ntpl", fname);
+   for (int i = 0; i < nEntries; ++i) {
+      *x = 42;
+      *y = 42.f;
+      writer->Fill();
+      if ((i + 1) % clusterSize == 0)
+         writer->CommitCluster();
+   }
+}
+#endif
+
 std::vector<std::string> ConcatVectors(const std::vector<std::string> &first, const std::vector<std::string> &second)
 {
    std::vector<std::string> all;
@@ -58,6 +136,470 @@ TEST_CASE("Integration test")
       CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
       CHECK_MESSAGE(result.fCompressedBytesRead == 643934, "Wrong number of compressed bytes read");
    }
+   SUBCASE("Single-thread run with split phases")
+   {
+      Options opts;
+      opts.fSplitPhases = true;
+      const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(result.fCompressedBytesRead > 0, "Wrong number of compressed bytes read");
+      CHECK_MESSAGE(result.fPhaseTimes.fIORealTime > 0., "Raw I/O phase not timed");
+      CHECK_MESSAGE(result.fPhaseTimes.fUnzipRealTime > 0., "Decompression phase not timed");
+      CHECK_MESSAGE(result.fPhaseTimes.fDeserializeRealTime > 0., "Deserialization phase not timed");
+      // all baskets are loaded from the TTreeCache after the raw I/O phase, none from the file
+      CHECK_MESSAGE(result.fCacheStats.fCacheHits > 0, "Baskets not loaded from the TTreeCache");
+      CHECK_MESSAGE(result.fCacheStats.fCacheMisses == 0, "Baskets read again from the file");
+   }
+   SUBCASE("Multi-thread run with work stealing")
+   {
+      Options opts;
+      opts.fScheduler = EScheduler::kWorkStealing;
+      const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(result.fCompressedBytesRead == 643934, "Wrong number of compressed bytes read");
+   }
+   SUBCASE("Bulk read")
+   {
+      Options opts;
+      opts.fBulkRead = true;
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(stResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(stResult.fCompressedBytesRead > 0, "Wrong number of compressed bytes read");
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(mtResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+   }
+   SUBCASE("Raw I/O")
+   {
+      Options opts;
+      opts.fRawIO = true;
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(stResult.fUncompressedBytesRead == 0, "Data decompressed in a raw I/O run");
+      CHECK_MESSAGE(stResult.fCompressedBytesRead > 0, "Wrong number of compressed bytes read");
+      CHECK_MESSAGE(stResult.fPhaseTimes.fIORealTime > 0., "Raw I/O not timed");
+
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(mtResult.fUncompressedBytesRead == 0, "Data decompressed in a raw I/O run");
+      CHECK_MESSAGE(mtResult.fCompressedBytesRead > 0, "Wrong number of compressed bytes read");
+   }
+   SUBCASE("Decompression only")
+   {
+      Options opts;
+      opts.fUnzipOnly = true;
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(stResult.fUncompressedBytesRead > 0, "Nothing decompressed");
+      CHECK_MESSAGE(stResult.fCompressedBytesRead > 0, "No compressed baskets loaded");
+      CHECK_MESSAGE(stResult.fPhaseTimes.fUnzipRealTime > 0., "Decompression not timed");
+      REQUIRE_MESSAGE(stResult.fBranchStats.size() == 1, "Wrong number of branches in the per-branch breakdown");
+      CHECK_MESSAGE(stResult.fBranchStats.at("x").fNBaskets > 0, "Baskets of the branch not counted");
+
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(mtResult.fUncompressedBytesRead == stResult.fUncompressedBytesRead,
+                    "Different number of bytes decompressed in ST and MT runs");
+      CHECK_MESSAGE(mtResult.fThreadPoolSize == 2, "Decompression not run on the thread pool");
+
+      Options limitedOpts = opts;
+      limitedOpts.fMemoryLimit = stResult.fCompressedBytesRead / 2;
+      const auto limitedResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, limitedOpts);
+      CHECK_MESSAGE(limitedResult.fCompressedBytesRead <= limitedOpts.fMemoryLimit, "Memory limit not respected");
+      CHECK_MESSAGE(limitedResult.fCompressedBytesRead > 0, "No compressed baskets loaded");
+   }
+   SUBCASE("Recompression")
+   {
+      Options opts;
+      opts.fTryCompression = {101, 404};
+      const auto results = EvalRecompression({{"t"}, {"test1.root", "test2.root"}, {"x"}}, {0, 2}, opts);
+      REQUIRE_MESSAGE(results.size() == 3, "Wrong number of recompression results");
+      CHECK_MESSAGE(results[0].fCompressionSettings == -1, "First result does not refer to the baskets as stored");
+      CHECK_MESSAGE(results[1].fCompressionSettings == 101, "Wrong compression settings");
+      CHECK_MESSAGE(results[2].fCompressionSettings == 404, "Wrong compression settings");
+      for (const auto &r : results) {
+         REQUIRE_MESSAGE(r.fDecompression.size() == 2, "Wrong number of decompression runs");
+         CHECK_MESSAGE(r.fUncompressedBytes == results[0].fUncompressedBytes,
+                       "Recompressed data decompresses to a different size");
+         CHECK_MESSAGE(r.fCompressedBytes > 0, "Recompressed data has no size");
+         CHECK_MESSAGE(r.fDecompression[0].fThreadPoolSize == 0, "First decompression run is not single-thread");
+         CHECK_MESSAGE(r.fDecompression[1].fThreadPoolSize == 2, "Second decompression run is not on 2 threads");
+         CHECK_MESSAGE(r.fDecompression[1].fUncompressedBytesRead == r.fUncompressedBytes,
+                       "Different number of bytes decompressed in ST and MT runs");
+      }
+      CHECK_MESSAGE(results[1].fCompressRealTime > 0., "Compression not timed");
+   }
+   SUBCASE("Branch-major read order")
+   {
+      Options opts;
+      opts.fReadOrder = EReadOrder::kBranchMajor;
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(stResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(stResult.fCompressedBytesRead > 0, "Wrong number of compressed bytes read");
+      REQUIRE_MESSAGE(stResult.fBranchStats.size() == 1, "Wrong number of branches in the per-branch breakdown");
+      CHECK_MESSAGE(stResult.fBranchStats.at("x").fUncompressedBytesRead == 80000000,
+                    "Wrong number of bytes read in the per-branch breakdown");
+
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(mtResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      REQUIRE_MESSAGE(mtResult.fBranchStats.size() == 1, "Wrong number of branches in the per-branch breakdown");
+      CHECK_MESSAGE(mtResult.fBranchStats.at("x").fUncompressedBytesRead == 80000000,
+                    "Wrong number of bytes read in the per-branch breakdown");
+
+      const auto defaultResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0);
+      CHECK_MESSAGE(defaultResult.fBranchStats.empty(), "Per-branch breakdown filled in entry-major order");
+   }
+   SUBCASE("Per-branch statistics")
+   {
+      Options opts;
+      opts.fPerBranch = true;
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      REQUIRE_MESSAGE(stResult.fBranchStats.size() == 1, "Wrong number of branches in the per-branch breakdown");
+      const auto &stStats = stResult.fBranchStats.at("x");
+      CHECK_MESSAGE(stStats.fUncompressedBytesRead == 80000000, "Wrong number of bytes read for the branch");
+      CHECK_MESSAGE(stStats.fCompressedBytes > 0, "Compressed size of the branch not filled");
+      CHECK_MESSAGE(stStats.fNBaskets > 0, "Baskets of the branch not counted");
+      CHECK_MESSAGE(stStats.fCompressionSettings >= 0, "Compression settings of the branch not filled");
+      CHECK_MESSAGE(stStats.fRealTime > 0., "Branch not timed");
+
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      REQUIRE_MESSAGE(mtResult.fBranchStats.size() == 1, "Wrong number of branches in the per-branch breakdown");
+      const auto &mtStats = mtResult.fBranchStats.at("x");
+      CHECK_MESSAGE(mtStats.fUncompressedBytesRead == 80000000, "Wrong number of bytes read for the branch");
+      CHECK_MESSAGE(mtStats.fNBaskets == stStats.fNBaskets, "Baskets counted differently in ST and MT runs");
+      CHECK_MESSAGE(mtStats.fCompressedBytes == stStats.fCompressedBytes,
+                    "Compressed size of the branch differs between ST and MT runs");
+   }
+   SUBCASE("TTreeCache configuration")
+   {
+      Options opts;
+      opts.fCacheSize = 10 * 1024 * 1024;
+      opts.fCacheAddBranches = true;
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(stResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(stResult.fCacheStats.fReadCalls > 0, "Read calls not counted");
+      CHECK_MESSAGE(stResult.fCacheStats.fCacheHits > 0, "No TTreeCache hits with the branch added to the cache");
+
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(mtResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(mtResult.fCacheStats.fReadCalls > 0, "Read calls not counted");
+
+      Options noCacheOpts;
+      noCacheOpts.fCacheSize = 0;
+      const auto noCacheResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, noCacheOpts);
+      CHECK_MESSAGE(noCacheResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(noCacheResult.fCacheStats.fCacheHits == 0, "TTreeCache hits with the TTreeCache disabled");
+      CHECK_MESSAGE(noCacheResult.fCacheStats.fReadCalls > stResult.fCacheStats.fReadCalls,
+                    "Not more read calls with the TTreeCache disabled");
+
+      CHECK_MESSAGE(noCacheResult.fCacheStats.fCacheMisses == 0, "TTreeCache misses with the TTreeCache disabled");
+
+      // the counts of a run do not include those of earlier runs over the same files
+      const auto repeatedResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(repeatedResult.fCacheStats.fCacheHits == stResult.fCacheStats.fCacheHits,
+                    "TTreeCache hits of a run not counted on their own");
+   }
+   SUBCASE("Repeated trials")
+   {
+      Options opts;
+      opts.fRepeat = 3;
+      opts.fWarmup = 1;
+      opts.fDropCache = true;
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      REQUIRE_MESSAGE(stResult.fTrials.size() == 3, "Wrong number of trials");
+      for (const auto &t : stResult.fTrials)
+         CHECK_MESSAGE(t.fUncompressedBytesRead == 80000000, "Wrong number of bytes read in a trial");
+      std::vector<double> realTimes;
+      for (const auto &t : stResult.fTrials)
+         realTimes.push_back(t.fRealTime);
+      CHECK_MESSAGE(stResult.fRealTime == Summarize(realTimes).fMedian, "Result is not the median trial");
+
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      REQUIRE_MESSAGE(mtResult.fTrials.size() == 3, "Wrong number of trials");
+      CHECK_MESSAGE(mtResult.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+
+      const auto singleResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0);
+      CHECK_MESSAGE(singleResult.fTrials.empty(), "Trials filled for a single run");
+   }
+   SUBCASE("Entry selection")
+   {
+      Options opts;
+      opts.fEntries = {1000000, 3000000};
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(stResult.fUncompressedBytesRead == 16000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(stResult.fProjection.fTotalClusters == 0, "Projection filled without sampling");
+      const auto mtResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(mtResult.fUncompressedBytesRead == 16000000, "Wrong number of bytes read");
+
+      opts.fMaxEntriesPerFile = 500000;
+      const auto limitedResult = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(limitedResult.fUncompressedBytesRead == 4000000, "Wrong number of bytes read");
+   }
+   SUBCASE("Cluster sampling")
+   {
+      RequireClusteredFile("test_clusters1.root", 1000000, 10000);
+      RequireClusteredFile("test_clusters2.root", 1000000, 10000);
+      Options opts;
+      opts.fSampleClusters = 0.5;
+      for (const auto nThreads : {0u, 2u}) {
+         const auto result =
+            EvalThroughput({{"t"}, {"test_clusters1.root", "test_clusters2.root"}, {"x"}}, nThreads, opts);
+         const auto &p = result.fProjection;
+         CHECK_MESSAGE(p.fTotalEntries == 2000000, "Wrong number of selected entries");
+         CHECK_MESSAGE(p.fTotalClusters == 200, "Wrong number of selected clusters");
+         CHECK_MESSAGE(p.fSampledClusters == 100, "Wrong number of sampled clusters");
+         CHECK_MESSAGE(p.fSampledEntries == 1000000, "Wrong number of sampled entries");
+         CHECK_MESSAGE(result.fUncompressedBytesRead == 4000000, "Wrong number of bytes read");
+         CHECK_MESSAGE(std::abs(double(p.fUncompressedBytesRead) - 8000000.) < 10., "Wrong projected bytes");
+         CHECK_MESSAGE(p.fRealTime > result.fRealTime, "Projected real time not larger than the sample's");
+         CHECK_MESSAGE((p.fRealTimeLow <= p.fRealTime && p.fRealTime <= p.fRealTimeHigh),
+                       "Invalid confidence interval");
+      }
+   }
+   SUBCASE("Progress sampling")
+   {
+      Options opts;
+      opts.fSampleInterval = 0.01;
+      for (const auto nThreads : {0u, 2u}) {
+         const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, nThreads, opts);
+         const auto &series = result.fTimeSeries;
+         REQUIRE_MESSAGE(series.size() >= 2, "Progress not sampled");
+         CHECK_MESSAGE(series.front().fUncompressedBytesRead == 0, "First sample is not at the beginning of the run");
+         CHECK_MESSAGE(series.back().fUncompressedBytesRead == 80000000, "Last sample is not at the end of the run");
+         CHECK_MESSAGE(series.back().fActiveTasks == 0, "Tasks still active at the end of the run");
+         for (auto i = 1u; i < series.size(); ++i) {
+            CHECK(series[i].fTime >= series[i - 1].fTime);
+            CHECK(series[i].fUncompressedBytesRead >= series[i - 1].fUncompressedBytesRead);
+         }
+      }
+
+      const auto unsampled = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 0);
+      CHECK_MESSAGE(unsampled.fTimeSeries.empty(), "Progress sampled when it should not");
+   }
+   SUBCASE("Open file counters")
+   {
+      const auto stResult = EvalThroughput({{"t"}, {"test1.root", "test2.root", "test1.root"}, {"x"}}, 0);
+      CHECK_MESSAGE(stResult.fFileOpens == 3, "Wrong number of file opens");
+      CHECK_MESSAGE(stResult.fFileReopens == 1, "Wrong number of file re-opens");
+
+      Options opts;
+      opts.fOpenFilesPerThread = 2;
+      const auto cachedResult = EvalThroughput({{"t"}, {"test1.root", "test2.root", "test1.root"}, {"x"}}, 0, opts);
+      CHECK_MESSAGE(cachedResult.fFileOpens == 2, "Wrong number of file opens with two open files per thread");
+      CHECK_MESSAGE(cachedResult.fFileReopens == 0, "Wrong number of file re-opens with two open files per thread");
+   }
+   SUBCASE("Multi-thread task statistics")
+   {
+      const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2);
+      REQUIRE_MESSAGE(!result.fTaskStats.empty(), "No task statistics recorded");
+      ULong64_t taskBytes = 0;
+      unsigned int nTasks = 0;
+      for (const auto &t : result.fTaskStats) {
+         CHECK_MESSAGE(t.fThreadIdx < result.fThreadStats.size(), "Task assigned to an unknown thread");
+         taskBytes += t.fUncompressedBytesRead;
+      }
+      for (const auto &t : result.fThreadStats)
+         nTasks += t.fNTasks;
+      CHECK_MESSAGE(taskBytes == result.fUncompressedBytesRead, "Task bytes do not add up to the total");
+      CHECK_MESSAGE(nTasks == result.fTaskStats.size(), "Thread task counts do not add up to the number of tasks");
+      CHECK_MESSAGE(result.fNTasks == result.fTaskStats.size(), "Wrong number of tasks");
+      CHECK_MESSAGE(result.fTaskSetupRealTime > 0., "Task setup time not measured");
+   }
+   SUBCASE("Pinned multi-thread runs")
+   {
+      Options opts;
+      for (const auto pin : {EPin::kCores, EPin::kNuma}) {
+         opts.fPin = pin;
+         const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+         CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+         if (pin == EPin::kCores) {
+            CHECK_MESSAGE(result.fNumaStats.empty(), "NUMA statistics without NUMA pinning");
+            continue;
+         }
+#ifdef __linux__
+         REQUIRE_MESSAGE(!result.fNumaStats.empty(), "No NUMA statistics");
+#endif
+         ULong64_t bytes = 0;
+         unsigned int nThreads = 0, nFiles = 0;
+         for (const auto &n : result.fNumaStats) {
+            bytes += n.fUncompressedBytesRead;
+            nThreads += n.fNThreads;
+            nFiles += n.fNFiles;
+            CHECK(n.fRealTime <= result.fRealTime);
+         }
+         if (!result.fNumaStats.empty()) {
+            CHECK_MESSAGE(bytes == result.fUncompressedBytesRead, "NUMA node bytes do not add up to the total");
+            CHECK_MESSAGE(nThreads == 2, "NUMA node threads do not add up to the pool size");
+            CHECK_MESSAGE(nFiles == 2, "NUMA node files do not add up to the number of files");
+         }
+      }
+   }
+   SUBCASE("Multi-thread run with split phases")
+   {
+      Options opts;
+      opts.fSplitPhases = true;
+      const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+      CHECK_MESSAGE(result.fCompressedBytesRead > 0, "Wrong number of compressed bytes read");
+      CHECK_MESSAGE(result.fPhaseTimes.fDeserializeRealTime > 0., "Deserialization phase not timed");
+      CHECK_MESSAGE(result.fCacheStats.fCacheMisses == 0, "Baskets read again from the file");
+   }
+   SUBCASE("Memory statistics")
+   {
+      for (const auto nThreads : {0u, 2u}) {
+         const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, nThreads);
+         const auto &mem = result.fMemory;
+#ifdef __linux__
+         CHECK_MESSAGE(mem.fPeakRSS > 0, "Peak RSS not measured");
+#endif
+         CHECK_MESSAGE(mem.fPeakBasketBytes > 0, "Basket memory not measured");
+#ifdef ROOTREADSPEED_COUNT_ALLOCATIONS
+         CHECK_MESSAGE(mem.fNAllocations > 0, "Allocations not counted");
+         CHECK_MESSAGE(AllocatedBytesPerMB(result) > 0., "Allocated bytes not counted");
+#else
+         CHECK_MESSAGE(mem.fNAllocations == -1, "Allocations counted without ROOTREADSPEED_COUNT_ALLOCATIONS");
+#endif
+         for (const auto &t : result.fThreadStats)
+            CHECK_MESSAGE(t.fBasketBytes <= mem.fPeakBasketBytes, "Thread basket memory above the run's peak");
+      }
+   }
+   SUBCASE("Hardware performance counters")
+   {
+      Options opts;
+      opts.fPerfCounters = true;
+      opts.fSplitPhases = true;
+      Result result{};
+      try {
+         result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      } catch (const std::runtime_error &e) {
+         MESSAGE(std::string("Skipping, hardware performance counters are not available: ") + e.what());
+         return;
+      }
+      const auto &pc = result.fPerfCounters;
+      CHECK_MESSAGE(pc.fCycles > 0, "Cycles not counted");
+      CHECK_MESSAGE(pc.fInstructions > 0, "Instructions not counted");
+      CHECK_MESSAGE(InstructionsPerCycle(pc) > 0., "Wrong instructions per cycle");
+      const auto &p = result.fPhaseTimes;
+      CHECK_MESSAGE(p.fDeserializeCounters.fCycles > 0, "Deserialization phase not counted");
+      CHECK_MESSAGE(p.fUnzipCounters.fCycles + p.fDeserializeCounters.fCycles <= pc.fCycles,
+                    "Phases counted more cycles than their tasks");
+   }
+   SUBCASE("RNTuple run")
+   {
+      Data d{{"ntpl"}, {"test_rntuple.root"}, {"x"}};
+      d.fFormat = EFormat::kRNTuple;
+      if (!HasRNTupleSupport()) {
+         CHECK_THROWS(EvalThroughput(d, 0));
+         return;
+      }
+#ifdef ROOTREADSPEED_RNTUPLE
+      RequireRNTupleFile("test_rntuple.root", 100000, 10000);
+      CHECK_MESSAGE(GetClusters(d).front().size() == 10, "Wrong number of RNTuple clusters");
+
+      const auto st = EvalThroughput(d, 0);
+      CHECK_MESSAGE(st.fUncompressedBytesRead >= 100000 * sizeof(int), "Wrong number of bytes read");
+      CHECK_MESSAGE(st.fCompressedBytesRead > 0, "No compressed bytes read");
+      const auto mt = EvalThroughput(d, 2);
+      CHECK_MESSAGE(mt.fUncompressedBytesRead == st.fUncompressedBytesRead,
+                    "Multi-thread run read different bytes than the single-thread run");
+      CHECK_MESSAGE(mt.fNTasks > 1, "Multi-thread run not split in tasks");
+
+      Data regexData = d;
+      regexData.fBranchNames = {"[xy]"};
+      regexData.fUseRegex = true;
+      const auto both = EvalThroughput(regexData, 0);
+      CHECK_MESSAGE(both.fUncompressedBytesRead >= 2 * st.fUncompressedBytesRead, "Regex did not match both fields");
+
+      for (const auto order : {EReadOrder::kEntryMajor, EReadOrder::kBranchMajor}) {
+         Options perField;
+         perField.fPerBranch = true;
+         perField.fReadOrder = order;
+         perField.fSampleInterval = 0.001;
+         const auto fields = EvalThroughput(regexData, 2, perField);
+         CHECK_MESSAGE(fields.fUncompressedBytesRead == both.fUncompressedBytesRead,
+                       "Reading fields separately read different bytes");
+         REQUIRE_MESSAGE(fields.fBranchStats.size() == 2, "Wrong number of field statistics");
+         ULong64_t fieldBytes = 0;
+         for (const auto &stats : fields.fBranchStats) {
+            CHECK_MESSAGE(stats.second.fRealTime > 0., "Field " << stats.first << " not timed");
+            CHECK_MESSAGE(stats.second.fCompressedBytes > 0, "No compressed bytes for field " << stats.first);
+            fieldBytes += stats.second.fUncompressedBytesRead;
+         }
+         CHECK_MESSAGE(fieldBytes == fields.fUncompressedBytesRead, "Field bytes do not add up to the total");
+         REQUIRE_MESSAGE(!fields.fTimeSeries.empty(), "Progress not sampled");
+         CHECK_MESSAGE(fields.fTimeSeries.back().fUncompressedBytesRead == fields.fUncompressedBytesRead,
+                       "Sampled progress does not reach the bytes read");
+      }
+
+      Options bulk;
+      bulk.fBulkRead = true;
+      CHECK_THROWS(EvalThroughput(d, 0, bulk));
+      CHECK_THROWS(EvalThroughput({{"ntpl"}, {"test_rntuple.root"}, {"z"}, false, EFormat::kRNTuple}, 0));
+#endif
+   }
+   SUBCASE("Pipelined multi-thread run")
+   {
+      Options opts;
+      opts.fPipelineDepth = 4;
+      opts.fIOThreads = 2;
+      const auto result = EvalThroughput({{"t"}, {"test1.root", "test2.root"}, {"x"}}, 2, opts);
+      CHECK_MESSAGE(result.fUncompressedBytesRead > 0, "Nothing decompressed");
+      CHECK_MESSAGE(result.fCompressedBytesRead > 0, "No compressed baskets fetched");
+      CHECK_MESSAGE(result.fNTasks > 0, "No tasks run");
+      CHECK_MESSAGE(result.fPipeline.fDepth == 4, "Wrong pipeline depth");
+      CHECK_MESSAGE(result.fPipeline.fNIOThreads == 2, "Wrong number of I/O threads");
+      CHECK_MESSAGE((result.fPipeline.fNWorkers >= 1 && result.fPipeline.fNWorkers <= result.fThreadPoolSize),
+                    "Wrong number of decompressing workers");
+      CHECK_MESSAGE(result.fPipeline.fMaxQueued <= 4, "More fetched tasks queued than the pipeline depth");
+      CHECK(result.fPipeline.fMeanQueued <= result.fPipeline.fMaxQueued);
+   }
+   SUBCASE("Thread scaling sweep")
+   {
+      const auto results = EvalThroughputScaling({{"t"}, {"test1.root", "test2.root"}, {"x"}}, {1, 2});
+      REQUIRE_MESSAGE(results.size() == 3, "Wrong number of runs in the sweep");
+      CHECK_MESSAGE(results[0].fThreadPoolSize == 0, "First run of the sweep is not single-thread");
+      CHECK_MESSAGE(results[2].fThreadPoolSize == 2, "Wrong thread pool size");
+      for (const auto &r : results) {
+         CHECK_MESSAGE(r.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+         CHECK_MESSAGE(r.fMemory.fPeakRSS > 0, "Peak RSS not measured for a run of the sweep");
+      }
+
+      const auto stOnly = EvalThroughputScaling({{"t"}, {"test1.root", "test2.root"}, {"x"}}, {});
+      REQUIRE_MESSAGE(stOnly.size() == 1, "A sweep without thread counts should only make the single-thread run");
+      CHECK_MESSAGE(stOnly[0].fThreadPoolSize == 0, "The run of the sweep is not single-thread");
+   }
+   SUBCASE("Index file")
+   {
+      const Data d{{"t"}, {"test1.root", "test2.root"}, {"x"}};
+      const auto firstLayout = GetDatasetLayout(d, nullptr, "test.rsidx");
+      CHECK_MESSAGE(firstLayout.fNFilesFromIndex == 0, "Layout read from a non-existing index");
+      const auto secondLayout = GetDatasetLayout(d, nullptr, "test.rsidx");
+      CHECK_MESSAGE(secondLayout.fNFilesFromIndex == 2, "Layout not read from the index");
+      CHECK_MESSAGE(secondLayout.fBranchNames == firstLayout.fBranchNames, "Wrong branch names read from the index");
+      CHECK_MESSAGE(secondLayout.fClusters.size() == firstLayout.fClusters.size(),
+                    "Wrong clusters read from the index");
+      CHECK_MESSAGE(secondLayout.fMetadata[0].fEntries == 10000000, "Wrong number of entries read from the index");
+      CHECK_MESSAGE(secondLayout.fClusterBytes == firstLayout.fClusterBytes, "Wrong cluster sizes read from the index");
+      REQUIRE(firstLayout.fClusterBytes[0].size() == firstLayout.fClusters[0].size());
+      CHECK_MESSAGE(std::accumulate(firstLayout.fClusterBytes[0].begin(), firstLayout.fClusterBytes[0].end(),
+                                    ULong64_t(0)) > 0,
+                    "Cluster sizes not computed");
+
+      Options opts;
+      opts.fIndexFile = "test.rsidx";
+      const auto result = EvalThroughput(d, 2, opts);
+      CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+
+      // a different branch selection invalidates the index
+      const auto otherLayout = GetDatasetLayout({{"t"}, {"test1.root"}, {".*"}, true}, nullptr, "test.rsidx");
+      CHECK_MESSAGE(otherLayout.fNFilesFromIndex == 0, "Layout read from an index built for different branches");
+
+      gSystem->Unlink("test.rsidx");
+
+      // a file that can no longer be stat'ed does not match its entry
+      RequireFile("test_removed.root");
+      const Data removedData{{"t"}, {"test_removed.root"}, {"x"}};
+      GetDatasetLayout(removedData, nullptr, "test.rsidx");
+      gSystem->Unlink("test_removed.root");
+      CHECK_THROWS_WITH(GetDatasetLayout(removedData, nullptr, "test.rsidx"),
+                        "There was a problem opening file 'test_removed.root'");
+      gSystem->Unlink("test.rsidx");
+   }
    SUBCASE("Invalid filename")
    {
       CHECK_THROWS_WITH(EvalThroughput({{"t"}, {"test_fake.root"}, {"x"}}, 0), "Could not open file 'test_fake.root'");
@@ -93,6 +635,21 @@ TEST_CASE("Branch test")
       CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of uncompressed bytes read");
       CHECK_MESSAGE(result.fCompressedBytesRead == 661576, "Wrong number of compressed bytes read");
    }
+   SUBCASE("Pattern branches, multi-thread")
+   {
+      const auto result = EvalThroughput({{"t"}, {"test3.root"}, {"(x|y)_.*nch"}, true}, 2);
+      CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of uncompressed bytes read");
+      CHECK_MESSAGE(result.fCompressedBytesRead == 661576, "Wrong number of compressed bytes read");
+   }
+   SUBCASE("Branch matcher reuse")
+   {
+      BranchMatcher matcher({"(x|y)_.*nch", "mis.*"});
+      const std::vector<std::string> expected{"x_branch", "y_brunch", "mismatched"};
+      CHECK(matcher.GetMatchingBranchNames("test3.root", "t") == expected);
+      // the second call is served from the cache of matches for this tree schema
+      CHECK(matcher.GetMatchingBranchNames("test3.root", "t") == expected);
+      CHECK_THROWS(BranchMatcher({"z_.*"}).GetMatchingBranchNames("test3.root", "t"));
+   }
    SUBCASE("No matches")
    {
       CHECK_THROWS(EvalThroughput({{"t"}, {"test3.root"}, {"x_.*"}, false}, 0));
@@ -104,10 +661,438 @@ TEST_CASE("Branch test")
       CHECK_MESSAGE(result.fUncompressedBytesRead == 160000000, "Wrong number of uncompressed bytes read");
       CHECK_MESSAGE(result.fCompressedBytesRead == 1316837, "Wrong number of compressed bytes read");
    }
+   SUBCASE("Decompression of a sample of all branches")
+   {
+      Options opts;
+      opts.fUnzipOnly = true;
+      opts.fMemoryLimit = 1316837 / 4;
+      const auto result = EvalThroughput({{"t"}, {"test3.root"}, {".*"}, true}, 0, opts);
+      CHECK_MESSAGE(result.fCompressedBytesRead <= opts.fMemoryLimit, "Memory limit not respected");
+      CHECK_MESSAGE(result.fBranchStats.size() == 4, "The memory limit is not spread over all branches");
+   }
 
    gSystem->Unlink("test3.root");
 }
 
+TEST_CASE("Distributed test")
+{
+   RequireFile("test1.root");
+   RequireFile("test2.root");
+   const Data d{{"t"}, {"test1.root", "test2.root"}, {"x"}};
+   const int port = 29375;
+
+   Result result;
+   std::exception_ptr coordinatorError;
+   std::thread coordinator([&] {
+      try {
+         result = RunCoordinator(d, port, 1);
+      } catch (...) {
+         coordinatorError = std::current_exception();
+      }
+   });
+   // the worker's read options decide which statistics it sends back
+   Options workerOpts;
+   workerOpts.fPerBranch = true;
+   RunWorker(d, "localhost", port, 2, workerOpts);
+   coordinator.join();
+
+   REQUIRE_MESSAGE(!coordinatorError, "The coordinator failed");
+   CHECK_MESSAGE(result.fUncompressedBytesRead == 80000000, "Wrong number of bytes read");
+   CHECK_MESSAGE(result.fThreadPoolSize == 2, "Wrong total number of worker threads");
+   REQUIRE_MESSAGE(result.fNodeStats.size() == 1, "Wrong number of nodes");
+   const auto &batches = result.fNodeStats[0].fBatches;
+   REQUIRE_MESSAGE(!batches.empty(), "No batches run");
+   ULong64_t nTasks = 0;
+   for (auto i = 0u; i < batches.size(); ++i) {
+      nTasks += batches[i].fNTasks;
+      CHECK(batches[i].fEndTime >= batches[i].fStartTime);
+      // queued batches start when the previous one completes
+      if (i > 0)
+         CHECK(batches[i].fStartTime >= batches[i - 1].fEndTime);
+   }
+   CHECK_MESSAGE(nTasks == result.fNTasks, "Batch task counts do not add up to the number of tasks");
+   CHECK_MESSAGE(result.fNTasks > 0, "No tasks run");
+   REQUIRE_MESSAGE(result.fBranchStats.count("x") == 1, "Per-branch statistics not sent by the worker");
+   CHECK_MESSAGE(result.fBranchStats.at("x").fUncompressedBytesRead == 80000000, "Wrong per-branch bytes");
+   CHECK_MESSAGE(result.fCacheStats.fReadCalls > 0, "Read calls not sent by the worker");
+
+   CHECK_THROWS(RunCoordinator({{"t"}, {}, {"x"}}, port, 1));
+   Options sampled;
+   sampled.fSampleInterval = 0.1;
+   CHECK_THROWS(RunCoordinator(d, port, 1, sampled));
+}
+
+TEST_CASE("Read plan test")
+{
+   RequireClusteredFile("test_clusters1.root", 1000000, 10000);
+   RequireClusteredFile("test_clusters2.root", 1000000, 10000);
+   const Data d{{"t"}, {"test_clusters1.root", "test_clusters2.root"}, {"x"}};
+   Options clusterOpts;
+   clusterOpts.fPartition = EPartition::kClusters;
+   const auto plan = MakeReadPlan(d, 2, clusterOpts);
+   REQUIRE_MESSAGE(plan.fSelectedClusters.size() == 2, "Wrong number of files in the plan");
+   CHECK_MESSAGE(plan.fSelectedClusters[0].size() == 100, "Wrong number of selected clusters");
+   CHECK_MESSAGE(plan.fTasks == PartitionTasks(plan, 2), "Tasks not partitioned for the requested threads");
+
+   // tasks cover the selected clusters of each file, in order and without gaps
+   auto checkTasks = [&plan](const std::vector<std::vector<EntryRange>> &tasks, std::size_t maxTasksPerFile) {
+      REQUIRE(tasks.size() == plan.fSelectedClusters.size());
+      for (auto fileIdx = 0u; fileIdx < tasks.size(); ++fileIdx) {
+         const auto &fileTasks = tasks[fileIdx];
+         REQUIRE(!fileTasks.empty());
+         CHECK(fileTasks.size() <= maxTasksPerFile);
+         CHECK(fileTasks.front().fStart == plan.fSelectedClusters[fileIdx].front().fStart);
+         CHECK(fileTasks.back().fEnd == plan.fSelectedClusters[fileIdx].back().fEnd);
+         for (auto i = 1u; i < fileTasks.size(); ++i)
+            CHECK(fileTasks[i].fStart == fileTasks[i - 1].fEnd);
+      }
+   };
+
+   SUBCASE("Partitioning")
+   {
+      checkTasks(PartitionTasks(plan, 0), 1);
+      for (const auto nThreads : {1u, 2u, 4u}) {
+         const auto maxTasksPerFile = std::ceil(ROOT::TTreeProcessorMT::GetTasksPerWorkerHint() * nThreads / 2.);
+         checkTasks(PartitionTasks(plan, nThreads), maxTasksPerFile);
+      }
+
+      // files of the same size get the same share of the tasks
+      auto bytesPlan = plan;
+      bytesPlan.fPartition = EPartition::kBytes;
+      const auto bytesTasks = PartitionTasks(bytesPlan, 2);
+      checkTasks(bytesTasks, plan.fSelectedClusters[0].size());
+      CHECK(bytesTasks[0].size() == bytesTasks[1].size());
+   }
+   SUBCASE("Execution")
+   {
+      for (const auto nThreads : {0u, 1u, 2u}) {
+         const auto result = EvalThroughput(plan, nThreads);
+         CHECK_MESSAGE(result.fUncompressedBytesRead == 8000000, "Wrong number of bytes read");
+         CHECK_MESSAGE(result.fThreadPoolSize == nThreads, "Wrong thread pool size");
+      }
+
+      Options opts;
+      opts.fSampleClusters = 10;
+      const auto sampledPlan = MakeReadPlan(d, 2, opts);
+      CHECK_MESSAGE(sampledPlan.fSampled, "Sampled plan not marked as such");
+      CHECK_MESSAGE(PartitionTasks(sampledPlan, 4) == sampledPlan.fSelectedClusters, "Sampled clusters were merged");
+      const auto result = EvalThroughput(sampledPlan, 2);
+      CHECK_MESSAGE(result.fUncompressedBytesRead == 400000, "Wrong number of bytes read");
+      CHECK_MESSAGE(result.fProjection.fTotalClusters == 200, "Wrong number of clusters in the projection");
+   }
+   SUBCASE("Save and load")
+   {
+      SaveReadPlan(plan, "test.rsplan");
+      const auto loaded = LoadReadPlan("test.rsplan");
+      gSystem->Unlink("test.rsplan");
+      CHECK(loaded.fData.fFileNames == d.fFileNames);
+      CHECK(loaded.fData.fTreeNames == d.fTreeNames);
+      CHECK(loaded.fData.fBranchNames == d.fBranchNames);
+      CHECK(loaded.fLayout.fClusters == plan.fLayout.fClusters);
+      CHECK(loaded.fLayout.fBranchNames == plan.fLayout.fBranchNames);
+      CHECK(loaded.fLayout.fMetadata[1].fEntries == 1000000);
+      CHECK(loaded.fSelectedClusters == plan.fSelectedClusters);
+      CHECK(loaded.fTasks == plan.fTasks);
+      CHECK(loaded.fLayout.fClusterBytes == plan.fLayout.fClusterBytes);
+      CHECK(loaded.fPartition == EPartition::kClusters);
+      CHECK(loaded.fNThreads == 2);
+      CHECK_MESSAGE(EvalThroughput(loaded, 2).fUncompressedBytesRead == 8000000, "Wrong number of bytes read");
+   }
+}
+
+TEST_CASE("Dataset test")
+{
+   RequireClusteredFile("test_clusters1.root", 1000000, 10000);
+   RequireClusteredFile("test_clusters2.root", 1000000, 10000);
+   RequireFriendFile("test_friend1.root", 1000000, 10000);
+   RequireFriendFile("test_friend2.root", 1000000, 10000);
+   const std::vector<std::string> mainFiles{"test_clusters1.root", "test_clusters2.root"};
+   const std::vector<std::string> friendFiles{"test_friend1.root", "test_friend2.root"};
+
+   SUBCASE("Globbing")
+   {
+      CHECK(ExpandFilePattern("test_clusters[12].root") == mainFiles);
+      CHECK(ExpandFilePattern("test_clusters1.root") == std::vector<std::string>{"test_clusters1.root"});
+      CHECK(ExpandFilePattern("root://host//store/*.root") == std::vector<std::string>{"root://host//store/*.root"});
+      CHECK_THROWS(ExpandFilePattern("test_no_such_file_*.root"));
+   }
+   SUBCASE("Dataset file")
+   {
+      WriteTextFile("test_dataset.txt", "# two trees per file\n"
+                                        "trees ft gt\n"
+                                        "files test_friend*.root\n"
+                                        "\n"
+                                        "friend t test_clusters1.root test_clusters2.root\n"
+                                        "branches y x\n");
+      const auto d = LoadDatasetFile("test_dataset.txt");
+      CHECK(d.fFileNames == std::vector<std::string>{"test_friend1.root", "test_friend1.root", "test_friend2.root",
+                                                     "test_friend2.root"});
+      CHECK(d.fTreeNames == std::vector<std::string>{"ft", "gt", "ft", "gt"});
+      CHECK(d.fBranchNames == std::vector<std::string>{"y", "x"});
+      CHECK(!d.fUseRegex);
+      REQUIRE(d.fFriends.size() == 1);
+      CHECK(d.fFriends[0].fTreeName == "t");
+      CHECK(d.fFriends[0].fFileNames == std::vector<std::string>{"test_clusters1.root", "test_clusters1.root",
+                                                                 "test_clusters2.root", "test_clusters2.root"});
+      // each task reads y from one of the two trees and x from the friend
+      CHECK_MESSAGE(EvalThroughput(d, 2).fUncompressedBytesRead == 32000000, "Wrong number of bytes read");
+
+      WriteTextFile("test_dataset.txt", "trees t\nfiles test_clusters*.root\nfriend ft test_friend1.root\n");
+      CHECK_THROWS(LoadDatasetFile("test_dataset.txt"));
+      WriteTextFile("test_dataset.txt", "trees t\nfile test_clusters1.root\n");
+      CHECK_THROWS(LoadDatasetFile("test_dataset.txt"));
+      WriteTextFile("test_dataset.txt", "trees t\nfiles test_clusters1.root\nbranches x\nall-branches\n");
+      CHECK_THROWS(LoadDatasetFile("test_dataset.txt"));
+      gSystem->Unlink("test_dataset.txt");
+      CHECK_THROWS(LoadDatasetFile("test_dataset.txt"));
+   }
+   SUBCASE("Friend trees")
+   {
+      Data d{{"t"}, mainFiles, {"x", "y"}};
+      d.fFriends.push_back({"ft", friendFiles});
+      const auto mainOnly = EvalThroughput({{"t"}, mainFiles, {"x"}}, 0);
+      const auto st = EvalThroughput(d, 0);
+      CHECK_MESSAGE(st.fUncompressedBytesRead == 2 * mainOnly.fUncompressedBytesRead,
+                    "Friend branches not read in lockstep");
+      CHECK_MESSAGE(st.fCompressedBytesRead > mainOnly.fCompressedBytesRead, "Bytes read from friends not counted");
+      CHECK_MESSAGE(st.fFileOpens == 4, "Friend file opens not counted");
+      CHECK_MESSAGE(EvalThroughput(d, 2).fUncompressedBytesRead == st.fUncompressedBytesRead,
+                    "Multi-thread run read different bytes than the single-thread run");
+
+      // branches of friends are matched by regexes too
+      Data regexData{{"t"}, mainFiles, {"[xy]"}, true};
+      regexData.fFriends = d.fFriends;
+      CHECK_MESSAGE(EvalThroughput(regexData, 2).fUncompressedBytesRead == st.fUncompressedBytesRead,
+                    "Regexes did not match the branches of friends");
+
+      // friends in the same file as the main tree, selected through an alias
+      Data sameFile{{"ft"}, friendFiles, {"y", "g.y"}};
+      sameFile.fFriends.push_back({"g=gt", {}});
+      const auto sameFileResult = EvalThroughput(sameFile, 0);
+      CHECK_MESSAGE(sameFileResult.fUncompressedBytesRead == st.fUncompressedBytesRead,
+                    "Branches of friends in the same file not read");
+      CHECK_MESSAGE(sameFileResult.fFileOpens == 2, "Friends in the same file counted as file opens");
+
+      // layouts of friends are stored in index files for the same friends only
+      Options opts;
+      opts.fIndexFile = "test_friends.rsidx";
+      EvalThroughput(d, 2, opts);
+      CHECK(GetDatasetLayout(d, nullptr, opts.fIndexFile).fNFilesFromIndex == 2);
+      CHECK(GetDatasetLayout({{"t"}, mainFiles, {"x", "y"}}, nullptr, opts.fIndexFile).fNFilesFromIndex == 0);
+      gSystem->Unlink("test_friends.rsidx");
+
+      Options rawIO;
+      rawIO.fRawIO = true;
+      CHECK_THROWS(EvalThroughput(d, 0, rawIO));
+      Data shortFriend{{"t"}, {"test_clusters1.root"}, {"x"}};
+      shortFriend.fFriends.push_back({"t", {"test1k.root"}});
+      RequireClusteredFile("test1k.root", 1000, 100);
+      CHECK_THROWS(EvalThroughput(shortFriend, 0));
+      gSystem->Unlink("test1k.root");
+   }
+   SUBCASE("Multiple trees per file")
+   {
+      const Data d{{"ft", "gt", "ft", "gt"}, {friendFiles[0], friendFiles[0], friendFiles[1], friendFiles[1]}, {"y"}};
+      const auto layout = GetDatasetLayout(d, nullptr, "test_trees.rsidx");
+      CHECK(layout.fMetadata[1].fTreeName == "gt");
+      CHECK_MESSAGE(GetDatasetLayout(d, nullptr, "test_trees.rsidx").fNFilesFromIndex == 4,
+                    "Trees of the same file overwrite each other in the index");
+      gSystem->Unlink("test_trees.rsidx");
+      CHECK_MESSAGE(EvalThroughput(d, 2).fUncompressedBytesRead == 16000000, "Wrong number of bytes read");
+   }
+   SUBCASE("Read plan with friends")
+   {
+      Data d{{"ft"}, friendFiles, {"y", "x"}};
+      d.fFriends.push_back({"t", mainFiles});
+      d.fFriends.push_back({"g=gt", {}});
+      SaveReadPlan(MakeReadPlan(d, 2), "test_friends.rsplan");
+      const auto loaded = LoadReadPlan("test_friends.rsplan");
+      gSystem->Unlink("test_friends.rsplan");
+      REQUIRE(loaded.fData.fFriends.size() == 2);
+      CHECK(loaded.fData.fFriends[0].fTreeName == "t");
+      CHECK(loaded.fData.fFriends[0].fFileNames == mainFiles);
+      CHECK(loaded.fData.fFriends[1].fTreeName == "g=gt");
+      CHECK(loaded.fData.fFriends[1].fFileNames.empty());
+      CHECK_MESSAGE(EvalThroughput(loaded, 2).fUncompressedBytesRead == 16000000, "Wrong number of bytes read");
+   }
+}
+
+TEST_CASE("CPU list test")
+{
+   CHECK((ParseCpuList("0-3,8,10-11\n") == std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+   CHECK(ParseCpuList("5") == std::vector<int>{5});
+   CHECK(ParseCpuList("").empty());
+   CHECK_THROWS(ParseCpuList("3-1"));
+   CHECK_THROWS(ParseCpuList("a"));
+   CHECK_THROWS(ParseCpuList("1-2x"));
+}
+
+TEST_CASE("Percentile test")
+{
+   const std::vector<double> values{5., 1., 4., 2., 3.};
+   CHECK(Percentile(values, 50) == 3.);
+   CHECK(Percentile(values, 90) == 5.);
+   CHECK(Percentile(values, 100) == 5.);
+   CHECK(Percentile(values, 0) == 1.);
+   CHECK(Percentile({}, 50) == 0.);
+}
+
+TEST_CASE("Summary statistics test")
+{
+   const auto stats = Summarize({4., 1., 3., 2.});
+   CHECK(stats.fMean == 2.5);
+   CHECK(stats.fMin == 1.);
+   CHECK(stats.fMedian == 2.5);
+   CHECK(std::abs(stats.fStdDev - std::sqrt(5. / 3.)) < 1e-12);
+
+   CHECK(Summarize({7.}).fStdDev == 0.);
+   CHECK(Summarize({7.}).fMedian == 7.);
+   CHECK(Summarize({}).fMean == 0.);
+}
+
+TEST_CASE("Cluster selection test")
+{
+   const std::vector<std::vector<EntryRange>> clusters{{{0, 10}, {10, 20}, {20, 30}, {30, 40}}, {{0, 5}, {5, 10}}};
+
+   SUBCASE("Clipping")
+   {
+      const auto clipped = ClipClusters(clusters, {15, 35}, -1);
+      REQUIRE(clipped[0].size() == 3);
+      CHECK(clipped[0][0].fStart == 15);
+      CHECK(clipped[0][2].fEnd == 35);
+      CHECK(clipped[1].empty());
+
+      const auto limited = ClipClusters(clusters, {-1, -1}, 12);
+      REQUIRE(limited[0].size() == 2);
+      CHECK(limited[0][1].fEnd == 12);
+      REQUIRE(limited[1].size() == 2);
+      CHECK(limited[1][1].fEnd == 10);
+
+      const auto both = ClipClusters(clusters, {5, -1}, 10);
+      REQUIRE(both[0].size() == 2);
+      CHECK(both[0][0].fStart == 5);
+      CHECK(both[0][1].fEnd == 15);
+   }
+
+   SUBCASE("Sampling")
+   {
+      const auto byCount = SampleClusters(clusters, 3, 42);
+      CHECK(byCount[0].size() == 2);
+      CHECK(byCount[1].size() == 1);
+      const auto byFraction = SampleClusters(clusters, 0.5, 42);
+      CHECK(byFraction[0].size() == 2);
+      CHECK(byFraction[1].size() == 1);
+      CHECK(SampleClusters(clusters, 0.01, 42)[0].size() == 1);
+      CHECK(SampleClusters(clusters, 100, 42)[0].size() == 4);
+
+      for (const auto &c : byCount[0])
+         CHECK(std::find_if(clusters[0].begin(), clusters[0].end(), [&c](const EntryRange &o) {
+                  return o.fStart == c.fStart && o.fEnd == c.fEnd;
+               }) != clusters[0].end());
+      CHECK(byCount[0][0].fStart < byCount[0][1].fStart);
+
+      const auto again = SampleClusters(clusters, 3, 42);
+      CHECK(again[0][0].fStart == byCount[0][0].fStart);
+      CHECK(again[0][1].fStart == byCount[0][1].fStart);
+   }
+
+   SUBCASE("Partitioning by cost")
+   {
+      // a large file with ten clusters of cost 10 and a small one with two clusters of cost 1
+      const std::vector<std::vector<EntryRange>> clusters{
+         {{0, 10}, {10, 20}, {20, 30}, {30, 40}, {40, 50}, {50, 60}, {60, 70}, {70, 80}, {80, 90}, {90, 100}},
+         {{0, 5}, {5, 10}}};
+      const std::vector<std::vector<double>> costs{std::vector<double>(10, 10.), {1., 1.}};
+      const auto tasks = MergeClustersByCost(clusters, costs, 5);
+      REQUIRE(tasks.size() == 2);
+      REQUIRE(tasks[0].size() == 5);
+      for (auto i = 0u; i < tasks[0].size(); ++i)
+         CHECK((tasks[0][i] == EntryRange{20 * Long64_t(i), 20 * Long64_t(i) + 20}));
+      REQUIRE(tasks[1].size() == 1);
+      CHECK((tasks[1][0] == EntryRange{0, 10}));
+
+      const auto oneTask = MergeClustersByCost(clusters, costs, 1);
+      CHECK(oneTask[0].size() == 1);
+      CHECK(oneTask[1].size() == 1);
+      CHECK(MergeClustersByCost({{}}, {{}}, 4)[0].empty());
+   }
+   SUBCASE("Projection")
+   {
+      std::vector<TaskStats> sample(2);
+      sample[0].fRange = {0, 10};
+      sample[0].fRealTime = 1.;
+      sample[0].fUncompressedBytesRead = 40;
+      sample[1].fRange = {10, 20};
+      sample[1].fRealTime = 3.;
+      sample[1].fUncompressedBytesRead = 40;
+      const auto p = ProjectFromSample(sample, 4., 100, 10);
+      CHECK(p.fSampledEntries == 20);
+      CHECK(p.fSampledClusters == 2);
+      CHECK(std::abs(p.fRealTime - 20.) < 1e-9);
+      CHECK(p.fUncompressedBytesRead == 400);
+      CHECK(p.fRealTimeLow < p.fRealTime);
+      CHECK(p.fRealTimeHigh > p.fRealTime);
+
+      // the whole population was read: there is no uncertainty left
+      const auto full = ProjectFromSample(sample, 4., 20, 2);
+      CHECK(full.fRealTimeLow == full.fRealTime);
+      CHECK(full.fRealTimeHigh == full.fRealTime);
+   }
+}
+
+TEST_CASE("Output test")
+{
+   Result r{};
+   r.fRealTime = 2.;
+   r.fUncompressedBytesRead = 4 * 1024 * 1024;
+   r.fBranchStats["x"].fUncompressedBytesRead = 4 * 1024 * 1024;
+   r.fTaskStats.push_back(TaskStats{0u, {0, 100}, 0u, 1., 1., 0.1, 100ull, 10ull});
+   const Data d{{"t"}, {"test1.root", "test2.root"}, {"x"}, false};
+
+   SUBCASE("File list hash")
+   {
+      const auto hash = HashFileList(d.fFileNames);
+      CHECK_MESSAGE(hash.size() == 16, "Wrong length of the file list hash");
+      CHECK_MESSAGE(hash == HashFileList({"test1.root", "test2.root"}), "File list hash is not deterministic");
+      CHECK_MESSAGE(hash != HashFileList({"test2.root", "test1.root"}), "File list hash ignores the order of files");
+      CHECK_MESSAGE(hash != HashFileList({"test1.root"}), "File list hash ignores some files");
+   }
+   SUBCASE("JSON")
+   {
+      std::ostringstream os;
+      WriteJSON(os, d, 2, Options{}, {r, r});
+      const auto json = os.str();
+      CHECK_MESSAGE(json.front() == '{', "JSON output is not an object");
+      CHECK_MESSAGE(json.find("\"file_list_hash\":\"" + HashFileList(d.fFileNames) + '"') != std::string::npos,
+                    "File list hash missing from JSON output");
+      CHECK_MESSAGE(json.find("\"uncompressed_throughput_mbps\":2") != std::string::npos,
+                    "Throughput missing from JSON output");
+      CHECK_MESSAGE(json.find("\"branch_stats\":[{\"name\":\"x\"") != std::string::npos,
+                    "Per-branch breakdown missing from JSON output");
+      CHECK_MESSAGE(json.find("\"task_stats\":[{\"file_index\":0") != std::string::npos,
+                    "Per-task breakdown missing from JSON output");
+      CHECK_MESSAGE(json.find("\"time_series\":[") != std::string::npos, "Time series missing from JSON output");
+      CHECK_MESSAGE(json.find("\"memory\":{\"peak_rss\":") != std::string::npos,
+                    "Memory statistics missing from JSON output");
+      CHECK_MESSAGE(std::count(json.begin(), json.end(), '{') == std::count(json.begin(), json.end(), '}'),
+                    "Unbalanced braces in JSON output");
+   }
+   SUBCASE("CSV")
+   {
+      std::ostringstream os;
+      WriteCSV(os, d, 2, Options{}, {r, r});
+      std::istringstream is(os.str());
+      std::vector<std::string> lines;
+      for (std::string line; std::getline(is, line);)
+         lines.push_back(line);
+      REQUIRE_MESSAGE(lines.size() == 3, "Wrong number of lines in CSV output");
+      const auto nColumns = std::count(lines[0].begin(), lines[0].end(), ',');
+      CHECK_MESSAGE(std::count(lines[1].begin(), lines[1].end(), ',') == nColumns, "Wrong number of CSV columns");
+      CHECK_MESSAGE(lines[0].find("uncompressed_throughput_mbps") != std::string::npos,
+                    "Throughput missing from CSV header");
+   }
+}
+
 TEST_CASE("CLI test")
 {
    SUBCASE("Filename list")
@@ -192,6 +1177,471 @@ TEST_CASE("CLI test")
       CHECK_MESSAGE(!parsedArgs.fData.fUseRegex, "Program using regex when it should not");
       CHECK_MESSAGE(parsedArgs.fNThreads == 0, "Program not set to single thread mode");
    }
+   SUBCASE("Threads sweep args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--threads-sweep", "1,2,4,8",
+      };
+      const std::vector<unsigned int> sweep{1, 2, 4, 8};
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fThreadsSweep == sweep, "Thread counts of the sweep not parsed correctly");
+   }
+   SUBCASE("Invalid threads sweep args")
+   {
+      for (const std::string sweep : {"1,-1", "0,2", "1,,2", "1,two", "1,"}) {
+         const std::vector<std::string> allArgs{
+            "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--threads-sweep", sweep,
+         };
+
+         const auto parsedArgs = ParseArgs(allArgs);
+
+         CHECK_MESSAGE(!parsedArgs.fShouldRun, "Program running with invalid thread counts in the sweep: " << sweep);
+      }
+   }
+   SUBCASE("Threads and threads sweep args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees",         "t",
+         "--branches",     "x",      "--threads", "2",         "--threads-sweep", "1,2",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(!parsedArgs.fShouldRun, "Program running when using mutually exclusive options");
+   }
+   SUBCASE("Phases args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--phases",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fSplitPhases, "Program not splitting reading phases when it should");
+
+      auto withAsyncPrefetch = allArgs;
+      withAsyncPrefetch.emplace_back("--async-prefetch");
+      CHECK_MESSAGE(!ParseArgs(withAsyncPrefetch).fShouldRun, "Program running with --phases and --async-prefetch");
+   }
+   SUBCASE("Index args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--index", "dataset.rsidx",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fIndexFile == "dataset.rsidx", "Index file not parsed correctly");
+   }
+   SUBCASE("Scheduler args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--scheduler", "steal",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fScheduler == EScheduler::kWorkStealing, "Scheduler not parsed correctly");
+
+      auto invalidArgs = allArgs;
+      invalidArgs.back() = "fifo";
+      CHECK_MESSAGE(!ParseArgs(invalidArgs).fShouldRun, "Program running with an invalid scheduler");
+   }
+   SUBCASE("Partition args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--partition", "clusters",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fPartition == EPartition::kClusters, "Partitioning not parsed correctly");
+      CHECK_MESSAGE(ParseArgs({"root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x"})
+                          .fOptions.fPartition == EPartition::kBytes,
+                    "Wrong default partitioning");
+
+      auto invalidArgs = allArgs;
+      invalidArgs.back() = "entries";
+      CHECK_MESSAGE(!ParseArgs(invalidArgs).fShouldRun, "Program running with an invalid partitioning");
+   }
+   SUBCASE("Pin args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--pin", "numa",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fPin == EPin::kNuma, "Pinning not parsed correctly");
+
+      auto invalidArgs = allArgs;
+      invalidArgs.back() = "sockets";
+      CHECK_MESSAGE(!ParseArgs(invalidArgs).fShouldRun, "Program running with an invalid pinning");
+   }
+   SUBCASE("Perf counters args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--perf-counters",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fPerfCounters, "Perf counters not enabled");
+
+      auto unzipArgs = allArgs;
+      unzipArgs.push_back("--unzip-only");
+      CHECK_MESSAGE(!ParseArgs(unzipArgs).fShouldRun, "Program running with --perf-counters and --unzip-only");
+   }
+   SUBCASE("Pipeline args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--threads", "2",
+         "--pipeline",     "8",       "--io-threads", "2",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fPipelineDepth == 8, "Pipeline depth not parsed correctly");
+      CHECK_MESSAGE(parsedArgs.fOptions.fIOThreads == 2, "Number of I/O threads not parsed correctly");
+
+      auto zeroDepthArgs = allArgs;
+      zeroDepthArgs[10] = "0";
+      CHECK_MESSAGE(!ParseArgs(zeroDepthArgs).fShouldRun, "Program running with a pipeline of depth 0");
+
+      const std::vector<std::string> singleThreadArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--pipeline", "8",
+      };
+      CHECK_MESSAGE(!ParseArgs(singleThreadArgs).fShouldRun, "Program running with a single-thread pipeline");
+
+      auto phasesArgs = allArgs;
+      phasesArgs.push_back("--phases");
+      CHECK_MESSAGE(!ParseArgs(phasesArgs).fShouldRun, "Program running with --pipeline and --phases");
+
+      const std::vector<std::string> ioThreadsOnlyArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--io-threads", "2",
+      };
+      CHECK_MESSAGE(!ParseArgs(ioThreadsOnlyArgs).fShouldRun, "Program running with --io-threads but no --pipeline");
+   }
+   SUBCASE("Open files per thread args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--open-files-per-thread", "4",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fOpenFilesPerThread == 4, "Open files per thread not parsed correctly");
+   }
+   SUBCASE("Bulk args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--bulk",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fBulkRead, "Program not reading in bulk when it should");
+
+      auto withPhases = allArgs;
+      withPhases.emplace_back("--phases");
+      CHECK_MESSAGE(!ParseArgs(withPhases).fShouldRun, "Program running when using mutually exclusive options");
+   }
+   SUBCASE("Format args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "ntpl", "--branches", "x", "--format", "rntuple",
+      };
+
+      auto invalidArgs = allArgs;
+      invalidArgs.back() = "random";
+      CHECK_MESSAGE(!ParseArgs(invalidArgs).fShouldRun, "Program running with an invalid format");
+
+      const auto parsedArgs = ParseArgs(allArgs);
+      if (!HasRNTupleSupport()) {
+         CHECK_MESSAGE(!parsedArgs.fShouldRun, "Program running without RNTuple support");
+         return;
+      }
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fData.fFormat == EFormat::kRNTuple, "Format not parsed correctly");
+
+      auto withBulk = allArgs;
+      withBulk.emplace_back("--bulk");
+      CHECK_MESSAGE(!ParseArgs(withBulk).fShouldRun, "Program running when using incompatible options");
+
+      auto withPerBranch = allArgs;
+      withPerBranch.emplace_back("--per-branch");
+      CHECK_MESSAGE(ParseArgs(withPerBranch).fShouldRun, "Program not running with per-field statistics");
+   }
+   SUBCASE("Dataset args")
+   {
+      WriteTextFile("test_dataset_args.txt", "trees t\nfiles a.root b.root\nbranches-regex x.*\n");
+      const std::vector<std::string> allArgs{"root-readspeed", "--dataset", "test_dataset_args.txt"};
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK(parsedArgs.fData.fTreeNames == std::vector<std::string>{"t"});
+      CHECK(parsedArgs.fData.fFileNames == std::vector<std::string>{"a.root", "b.root"});
+      CHECK(parsedArgs.fData.fBranchNames == std::vector<std::string>{"x.*"});
+      CHECK(parsedArgs.fData.fUseRegex);
+
+      auto withBranches = allArgs;
+      withBranches.insert(withBranches.end(), {"--branches", "y"});
+      const auto overridden = ParseArgs(withBranches);
+      CHECK_MESSAGE(overridden.fData.fBranchNames == std::vector<std::string>{"y"}, "Branches not overridden");
+      CHECK(!overridden.fData.fUseRegex);
+
+      auto withFiles = allArgs;
+      withFiles.insert(withFiles.end(), {"--files", "c.root"});
+      CHECK_MESSAGE(!ParseArgs(withFiles).fShouldRun, "Program running with both --dataset and --files");
+
+      gSystem->Unlink("test_dataset_args.txt");
+      CHECK_MESSAGE(!ParseArgs(allArgs).fShouldRun, "Program running with a missing dataset file");
+   }
+   SUBCASE("Read order args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--read-order", "branch-major",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fReadOrder == EReadOrder::kBranchMajor, "Read order not parsed correctly");
+
+      auto invalidArgs = allArgs;
+      invalidArgs.back() = "random";
+      CHECK_MESSAGE(!ParseArgs(invalidArgs).fShouldRun, "Program running with an invalid read order");
+
+      auto withBulk = allArgs;
+      withBulk.emplace_back("--bulk");
+      CHECK_MESSAGE(!ParseArgs(withBulk).fShouldRun, "Program running when using incompatible options");
+   }
+   SUBCASE("Decompression only args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--unzip-only", "--memory-limit",
+         "512",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fUnzipOnly, "Program not running decompression only when it should");
+      CHECK_MESSAGE(parsedArgs.fOptions.fMemoryLimit == 512ull * 1024 * 1024, "Memory limit not parsed correctly");
+
+      auto withRawIO = allArgs;
+      withRawIO.emplace_back("--raw-io");
+      CHECK_MESSAGE(!ParseArgs(withRawIO).fShouldRun, "Program running when using incompatible options");
+   }
+   SUBCASE("Recompression args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--try-compression",
+         "zstd:5,lz4:4",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE((parsedArgs.fOptions.fTryCompression == std::vector<int>{505, 404}),
+                    "Compression settings not parsed correctly");
+
+      for (const std::string invalid : {"zstd", "zstd:0", "zstd:10", "brotli:1"}) {
+         auto invalidArgs = allArgs;
+         invalidArgs.back() = invalid;
+         CHECK_MESSAGE(!ParseArgs(invalidArgs).fShouldRun, "Program running with invalid compression settings");
+      }
+   }
+   SUBCASE("Raw I/O args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--raw-io",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fRawIO, "Program not reading raw baskets when it should");
+
+      auto withPhases = allArgs;
+      withPhases.emplace_back("--phases");
+      CHECK_MESSAGE(!ParseArgs(withPhases).fShouldRun, "Program running when using incompatible options");
+   }
+   SUBCASE("Repeat args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--repeat", "5", "--warmup", "2",
+         "--drop-cache",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fRepeat == 5, "Number of trials not parsed correctly");
+      CHECK_MESSAGE(parsedArgs.fOptions.fWarmup == 2, "Number of warm-up trials not parsed correctly");
+      CHECK_MESSAGE(parsedArgs.fOptions.fDropCache, "Page cache not dropped when it should");
+
+      auto withSweep = allArgs;
+      withSweep.insert(withSweep.end(), {"--threads-sweep", "1,2"});
+      CHECK_MESSAGE(ParseArgs(withSweep).fShouldRun, "Program not running with repeated trials in a thread sweep");
+   }
+   SUBCASE("Threads sweep with warm-up args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--threads-sweep", "1,2",
+         "--warmup", "1",
+      };
+      const std::vector<unsigned int> sweep{1, 2};
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fThreadsSweep == sweep, "Thread counts of the sweep not parsed correctly");
+      CHECK_MESSAGE(parsedArgs.fOptions.fWarmup == 1, "Number of warm-up trials not parsed correctly");
+   }
+   SUBCASE("Entry selection args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed",  "--files", "file.root", "--trees", "t", "--branches", "x", "--entries", "100:2000",
+         "--max-entries-per-file", "500", "--sample-clusters", "0.25", "--sample-seed", "7",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      const auto &opts = parsedArgs.fOptions;
+      CHECK_MESSAGE((opts.fEntries.fStart == 100 && opts.fEntries.fEnd == 2000), "Entry range not parsed correctly");
+      CHECK_MESSAGE(opts.fMaxEntriesPerFile == 500, "Maximum entries per file not parsed correctly");
+      CHECK_MESSAGE(opts.fSampleClusters == 0.25, "Cluster sample not parsed correctly");
+      CHECK_MESSAGE(opts.fSampleSeed == 7, "Sample seed not parsed correctly");
+
+      const auto openEnded = ParseArgs({"root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x",
+                                        "--entries", "100:"});
+      CHECK_MESSAGE((openEnded.fOptions.fEntries.fStart == 100 && openEnded.fOptions.fEntries.fEnd == -1),
+                    "Open-ended entry range not parsed correctly");
+
+      CHECK_MESSAGE(!ParseArgs({"root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x",
+                                "--entries", "100"})
+                        .fShouldRun,
+                    "Program running with an invalid entry range");
+      CHECK_MESSAGE(!ParseArgs({"root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x",
+                                "--entries", "100:100"})
+                        .fShouldRun,
+                    "Program running with an empty entry range");
+      auto withUnzip = allArgs;
+      withUnzip.push_back("--unzip-only");
+      CHECK_MESSAGE(!ParseArgs(withUnzip).fShouldRun, "Program running when using incompatible options");
+   }
+   SUBCASE("Sample interval args")
+   {
+      const std::vector<std::string> baseArgs{"root-readspeed", "--files", "file.root", "--trees", "t", "--branches",
+                                              "x", "--sample-interval"};
+      auto withArg = [&baseArgs](const std::string &interval) {
+         auto args = baseArgs;
+         args.push_back(interval);
+         return ParseArgs(args);
+      };
+
+      CHECK_MESSAGE(withArg("100ms").fOptions.fSampleInterval == 0.1, "Interval in milliseconds not parsed correctly");
+      CHECK_MESSAGE(withArg("2s").fOptions.fSampleInterval == 2., "Interval in seconds not parsed correctly");
+      CHECK_MESSAGE(withArg("0.5").fOptions.fSampleInterval == 0.5, "Interval without unit not parsed correctly");
+      CHECK_MESSAGE(!withArg("10min").fShouldRun, "Program running with an invalid interval");
+      CHECK_MESSAGE(!withArg("0ms").fShouldRun, "Program running with an empty interval");
+   }
+   SUBCASE("Distributed args")
+   {
+      const std::vector<std::string> baseArgs{"root-readspeed", "--files", "file.root", "--trees", "t", "--branches",
+                                              "x"};
+      auto withArgs = [&baseArgs](const std::vector<std::string> &extra) {
+         auto args = baseArgs;
+         args.insert(args.end(), extra.begin(), extra.end());
+         return ParseArgs(args);
+      };
+
+      const auto coordinator = withArgs({"--coordinator", "9090", "--workers", "200"});
+      CHECK_MESSAGE(coordinator.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(coordinator.fCoordinatorPort == 9090, "Coordinator port not parsed correctly");
+      CHECK_MESSAGE(coordinator.fNWorkers == 200, "Number of workers not parsed correctly");
+
+      const auto worker = withArgs({"--worker", "head.example.org:9090", "--threads", "8"});
+      CHECK_MESSAGE(worker.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(worker.fCoordinatorHost == "head.example.org", "Coordinator host not parsed correctly");
+      CHECK_MESSAGE(worker.fWorkerPort == 9090, "Coordinator port not parsed correctly");
+
+      CHECK_MESSAGE(!withArgs({"--coordinator", "9090"}).fShouldRun, "Program running without --workers");
+      CHECK_MESSAGE(!withArgs({"--worker", "head.example.org"}).fShouldRun, "Program running without a port");
+      CHECK_MESSAGE(!withArgs({"--worker", "head:9090", "--repeat", "3"}).fShouldRun,
+                    "Program running when using incompatible options");
+      CHECK_MESSAGE(!withArgs({"--coordinator", "9090", "--workers", "2", "--sample-interval", "1"}).fShouldRun,
+                    "Program running when sampling a distributed run");
+   }
+   SUBCASE("Output format args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--output", "json",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOutputFormat == EOutputFormat::kJSON, "Output format not parsed correctly");
+
+      auto csvArgs = allArgs;
+      csvArgs.back() = "csv";
+      CHECK_MESSAGE(ParseArgs(csvArgs).fOutputFormat == EOutputFormat::kCSV, "Output format not parsed correctly");
+
+      auto invalidArgs = allArgs;
+      invalidArgs.back() = "xml";
+      CHECK_MESSAGE(!ParseArgs(invalidArgs).fShouldRun, "Program running with an invalid output format");
+   }
+   SUBCASE("Per-branch args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--per-branch",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fPerBranch, "Per-branch statistics not enabled when they should");
+
+      auto withPhases = allArgs;
+      withPhases.emplace_back("--phases");
+      CHECK_MESSAGE(!ParseArgs(withPhases).fShouldRun, "Program running when using incompatible options");
+   }
+   SUBCASE("TTreeCache args")
+   {
+      const std::vector<std::string> allArgs{
+         "root-readspeed", "--files", "file.root", "--trees", "t", "--branches", "x", "--cache-size", "1000000",
+         "--cache-learn-entries", "50", "--cache-add-branches", "--async-prefetch",
+      };
+
+      const auto parsedArgs = ParseArgs(allArgs);
+
+      CHECK_MESSAGE(parsedArgs.fShouldRun, "Program not running when given valid arguments");
+      CHECK_MESSAGE(parsedArgs.fOptions.fCacheSize == 1000000, "Cache size not parsed correctly");
+      CHECK_MESSAGE(parsedArgs.fOptions.fCacheLearnEntries == 50, "Cache learn entries not parsed correctly");
+      CHECK_MESSAGE(parsedArgs.fOptions.fCacheAddBranches, "Branches not added to the cache when they should");
+      CHECK_MESSAGE(parsedArgs.fOptions.fAsyncPrefetch, "Async prefetching not enabled when it should");
+
+      auto noCacheArgs = allArgs;
+      noCacheArgs[8] = "0";
+      CHECK_MESSAGE(!ParseArgs(noCacheArgs).fShouldRun, "Program running with cache options and no cache");
+   }
    SUBCASE("Regex args")
    {
       const std::vector<std::string> allArgs{